@@ -22,6 +22,7 @@
 #include "Bucket.h"
 #include <dolfin.h>
 #include <string>
+#include <fstream>
 #include "SignalHandler.h"
 #include "EventHandler.h"
 #include "StatisticsFile.h"
@@ -37,7 +38,10 @@ boost::timer::cpu_timer Bucket::timer_;
 //*******************************************************************|************************************************************//
 // default constructor
 //*******************************************************************|************************************************************//
-Bucket::Bucket()
+Bucket::Bucket() : timestep_walltime_(-1.0), checkpoint_walltime_(-1.0), 
+                   previous_walltime_(0.0), terminate_signal_(0),
+                   timestep_maxretries_(0), timestep_minretry_(0.0), timestep_retries_(0),
+                   retryable_(false), solvefailed_(false)
 {
                                                                      // do nothing
 }
@@ -45,7 +49,11 @@ Bucket::Bucket()
 //*******************************************************************|************************************************************//
 // specific constructor
 //*******************************************************************|************************************************************//
-Bucket::Bucket(const std::string &name) : name_(name)
+Bucket::Bucket(const std::string &name) : name_(name), 
+                                           timestep_walltime_(-1.0), checkpoint_walltime_(-1.0), 
+                                           previous_walltime_(0.0), terminate_signal_(0),
+                                           timestep_maxretries_(0), timestep_minretry_(0.0), timestep_retries_(0),
+                                           retryable_(false), solvefailed_(false)
 {
                                                                      // do nothing
 }
@@ -79,9 +87,47 @@ Bucket::~Bucket()
 }
 
 //*******************************************************************|************************************************************//
-// run the model described by this bucket
+// run the model described by this bucket (once for each member if running an ensemble)
 //*******************************************************************|************************************************************//
 void Bucket::run()
+{
+  if (ensemble_.empty())
+  {
+    run_member_();
+    return;
+  }
+
+  const double setupwalltime = elapsed_walltime();                   // the setup shared by all the members (the first member is
+  double memberswalltime = 0.0;                                      // set up by fill)
+  for (uint i = 0; i < ensemble_.size(); i++)
+  {
+    const double startwalltime = elapsed_walltime();
+    if (i > 0)
+    {
+      start_ensemble_member_(i);                                     // reset the bucket and apply the parameters of this member
+    }
+
+    log(INFO, "Running ensemble member %s (%d of %d).", ensemble_[i].c_str(), i+1, (int) ensemble_.size());
+    run_member_();
+
+    const double memberwalltime = elapsed_walltime() - startwalltime;
+    log(INFO, "Ensemble member %s took %g s.", ensemble_[i].c_str(), memberwalltime);
+    memberswalltime += memberwalltime;
+  }
+
+  const double ensemblewalltime = setupwalltime + memberswalltime;   // separate runs are not measured but estimated assuming each
+  const double separatewalltime = ensemble_.size()*setupwalltime + memberswalltime;// would repeat the setup and then take as
+  log(INFO, "Ensemble of %d members took %g s (setup %g s, members %g s).", // long as its member did here
+                                (int) ensemble_.size(), ensemblewalltime, setupwalltime, memberswalltime);
+  log(INFO, "Estimate (not measured) for %d separate runs: %g s (%d x setup + members), ensemble throughput about %g times higher.", 
+                                (int) ensemble_.size(), separatewalltime, (int) ensemble_.size(), 
+                                separatewalltime/ensemblewalltime);
+}
+
+//*******************************************************************|************************************************************//
+// run the model described by this bucket from its current (initial) state to completion
+//*******************************************************************|************************************************************//
+void Bucket::run_member_()
 {
   update_timedependent();
   update_nonlinear();
@@ -93,28 +139,48 @@ void Bucket::run()
   solve_at_start_();
 
   log(INFO, "Entering timeloop.");
+  previous_walltime_ = elapsed_walltime();                           // start timing the timesteps (for walltime predictions)
   bool continue_timestepping = !complete_timestepping();
   while (continue_timestepping) 
   {                                                                  // loop over time
 
-    *old_time_ = *current_time_;                                     // old time is now the previous time??
-    *current_time_ += timestep();                                    // increment time with the timestep 
+    const double unreduced_timestep = timestep();                    // the timestep before any retries
+    timestep_retries_ = 0;
+    if (timestep_retryfactor_)                                       // keep the system functions in memory so that this timestep can
+    {                                                                // be rolled back and retried if a solver fails
+      for (SystemBucket_const_it s_it = systems_begin(); 
+                                 s_it != systems_end(); s_it++)
+      {
+        (*(*s_it).second).snapshot();
+      }
+      retryable_ = true;
+    }
+
+    bool retry = true;
+    while (retry)
+    {
+      *old_time_ = *current_time_;                                   // old time is now the previous time??
+      *current_time_ += timestep();                                  // increment time with the timestep 
                                                                      // (we do this now so that time dependent expressions are
                                                                      // evaluating at the right time, i.e. symbol_i, which is
                                                                      // attached to current_time, is at the next
                                                                      // time level, and symbol_n, which is attached to old_time
                                                                      // is at the previous time level throughout the whole timestep)
-    (*timestep_count_)++;                                            // increment the number of timesteps taken
+      (*timestep_count_)++;                                          // increment the number of timesteps taken
 
-    log(INFO, "Timestep numbers: %d -> %d", timestep_count()-1, timestep_count());
-    log(INFO, "Times: %g -> %g", old_time(), current_time());
-    log(INFO, "Timestep: %g", timestep());
+      log(INFO, "Timestep numbers: %d -> %d", timestep_count()-1, timestep_count());
+      log(INFO, "Times: %g -> %g", old_time(), current_time());
+      log(INFO, "Timestep: %g", timestep());
 
-    update_timedependent();                                          // now we know the new time, update functions that are
+      update_timedependent();                                        // now we know the new time, update functions that are
                                                                      // potentially time dependent
-    update_nonlinear();
+      update_nonlinear();
 
-    solve_in_timeloop_();                                            // this is where the magic happens
+      solve_in_timeloop_();                                          // this is where the magic happens
+
+      retry = rollback_timestep_();                                  // roll back (and reduce the timestep) if a solver failed
+    }
+    retryable_ = false;
 
     update_timedependent();
     update_nonlinear();
@@ -131,10 +197,22 @@ void Bucket::run()
       checkpoint(CHECKPOINT_TIMELOOP);                               // standard checkpointing
     }
 
+    if ((timestep_retries_ > 0) && timestep_constraints_.empty())    // without adaptive timestepping go back to the original timestep
+    {                                                                // after a successful retry
+      *(timestep_.second) = unreduced_timestep;
+    }
+
     update_timestep();                                               // update the timestep
 
     update();                                                        // update all functions in the bucket
 
+    if (continue_timestepping)
+    {
+      adapt_meshes_();                                               // adapt the meshes (if requested) now the functions are
+                                                                     // up to date
+      rebalance_meshes_();                                           // repartition the meshes (if requested and they have become
+    }                                                                // imbalanced since the last checkpoint)
+
   }                                                                  // syntax ensures at least one solve
   log(INFO, "Finished timeloop.");
 
@@ -148,7 +226,30 @@ void Bucket::solve(const int &location)
   for (SystemBucket_const_it s_it = systems_begin(); 
                              s_it != systems_end(); s_it++)
   {
-    bool solved = (*(*s_it).second).solve(location);
+    if (solvefailed_)                                                // a solver has failed so this attempt at the timestep will be
+    {                                                                // rolled back
+      break;
+    }
+
+    SystemBucket_ptr system = (*s_it).second;
+    if (location == SOLVE_TIMELOOP)
+    {
+      if (!(*system).solve_in_timestep(timestep_count()))            // multirate systems that are not due a solve this timestep keep
+      {                                                              // their last solution
+        continue;
+      }
+      if ((*system).subcycles() > 1)                                 // multirate systems that take substeps
+      {
+        subcycle_(system);
+        continue;
+      }
+      if ((*system).solve_period() > 1)                              // multirate systems that step over several timesteps
+      {
+        multirate_solve_(system);
+        continue;
+      }
+    }
+    bool solved = (*system).solve(location);
   }
 }
 
@@ -270,12 +371,29 @@ bool Bucket::complete()
 {
   bool completed = false;
 
-  if ((*(*SignalHandler::instance()).return_handler(SIGINT)).received())
+  int sigint =                                                       // signals may only have reached some processes so every
+    (*(*SignalHandler::instance()).return_handler(SIGINT)).received();// process must take part in the reductions before any of them
+  sigint = dolfin::MPI::max(MPI_COMM_WORLD, sigint);                 // can decide to stop
+  int terminate = 0;
+  if (terminate_signal_ > 0)
+  {
+    terminate = 
+      (*(*SignalHandler::instance()).return_handler(terminate_signal_)).received();
+  }
+  terminate = dolfin::MPI::max(MPI_COMM_WORLD, terminate);
+
+  if (sigint > 0)
   {
     log(ERROR, "SIGINT received, terminating timeloop.");
     completed = true;
   }
 
+  if (!completed && terminate > 0)
+  {
+    log(INFO, "Signal %d received, terminating timeloop.", terminate_signal_);
+    completed = true;
+  }
+
   if (!completed)                                                    // don't bother checking for completion if we failed
   {
     completed = complete_timestepping();
@@ -294,11 +412,60 @@ bool Bucket::complete()
   {
     if (walltime_limit_)
     {
-      if (elapsed_walltime() >= walltime_limit())
-      {
-        log(INFO, "Walltime limit reached, terminating timeloop.");
-        completed = true;
-      }
+      completed = (dolfin::MPI::max(MPI_COMM_WORLD,                  // the walltime is measured on each process so agree on it
+                             (int) walltime_complete_()) > 0);
+    }
+  }
+
+  return completed;
+}
+
+//*******************************************************************|************************************************************//
+// return a boolean indicating if the walltime limit has been reached or, if predicting, if the next timestep plus a final
+// checkpoint would exceed it
+//*******************************************************************|************************************************************//
+bool Bucket::walltime_complete_()
+{
+  const double weight = 0.3;                                         // weight of the latest sample in the moving averages
+  bool completed = false;
+  const double walltime = elapsed_walltime();
+
+  if (walltime_safetyfactor_)
+  {
+    const double steptime = walltime - previous_walltime_;           // time since the last check (excluding checkpoints)
+    if (timestep_walltime_ < 0.0)
+    {
+      timestep_walltime_ = steptime;
+    }
+    else
+    {
+      timestep_walltime_ = weight*steptime + (1.0-weight)*timestep_walltime_;
+    }
+  }
+  previous_walltime_ = walltime;
+
+  if (walltime >= walltime_limit())
+  {
+    log(INFO, "Walltime limit reached, terminating timeloop.");
+    completed = true;
+  }
+  else if (walltime_safetyfactor_)
+  {
+    double checkpointtime = 0.0;
+    if (checkpoint_period_ || checkpoint_period_timesteps_)          // if we're checkpointing we have to leave time for a final
+    {                                                                // checkpoint, which until we've measured one we assume costs
+      checkpointtime = (checkpoint_walltime_ < 0.0) ?                // the same as a timestep
+                                  timestep_walltime_ : checkpoint_walltime_;
+    }
+    const double predicted = walltime + 
+                             (*walltime_safetyfactor_)*(timestep_walltime_ + checkpointtime);
+    log(DBG, "Predicted walltime after next timestep and checkpoint: %g (timestep: %g, checkpoint: %g)", 
+                                            predicted, timestep_walltime_, checkpointtime);
+    if (predicted >= walltime_limit())
+    {
+      log(INFO, "Predicted walltime (%g) of next timestep and final checkpoint exceeds walltime limit, terminating timeloop.", 
+                                                                     predicted);
+      completed = true;
     }
   }
 
@@ -342,7 +509,23 @@ double Bucket::residual_norm()
   for (SystemBucket_it s_it = systems_begin(); 
                        s_it != systems_end(); s_it++)
   {
-    norm += std::pow((*(*s_it).second).residual_norm(SOLVE_TIMELOOP), 2.0);
+    SystemBucket_ptr system = (*s_it).second;
+    if (!(*system).solve_in_timestep(timestep_count()))              // systems that aren't solved this timestep don't contribute
+    {
+      continue;
+    }
+    if ((*system).subcycles() > 1)                                   // subcycled systems are evaluated over their last substep
+    {
+      const double dt = timestep();
+      const double old_time = *old_time_;
+      *(timestep_.second) = dt/(*system).subcycles();
+      *old_time_ = *current_time_ - timestep();
+      norm += std::pow((*system).residual_norm(SOLVE_TIMELOOP), 2.0);
+      *old_time_ = old_time;
+      *(timestep_.second) = dt;
+      continue;
+    }
+    norm += std::pow((*system).residual_norm(SOLVE_TIMELOOP), 2.0);
   }
 
   norm = std::sqrt(norm);
@@ -350,6 +533,23 @@ double Bucket::residual_norm()
   return norm;
 }
 
+//*******************************************************************|************************************************************//
+// register a solver failure, returning true if the current timestep will be rolled back and retried with a reduced timestep (in
+// which case the solver should carry on as if it hadn't failed) or false if the failure should be handled by the solver as usual
+//*******************************************************************|************************************************************//
+bool Bucket::retry_failure()
+{
+  if (!retryable_ ||                                                 // not retrying (or not in the timeloop)
+      (timestep_retries_ >= timestep_maxretries_) ||                 // or run out of retries
+      (timestep()*(*timestep_retryfactor_) < timestep_minretry_))    // or the timestep would be too small
+  {
+    return false;
+  }
+
+  solvefailed_ = true;
+  return true;
+}
+
 //*******************************************************************|************************************************************//
 // loop over the selected forms and attach the coefficients they request using the bucket data maps
 //*******************************************************************|************************************************************//
@@ -685,6 +885,56 @@ SystemBucket_const_it Bucket::systems_end() const
   return systems_.get<om_key_seq>().end();
 }
 
+//*******************************************************************|************************************************************//
+// return the names of the systems that the named system depends on
+//*******************************************************************|************************************************************//
+const std::set< std::string > Bucket::system_dependencies_(const std::string &name) const
+{
+  std::map< std::string, std::set< std::string > >::const_iterator d_it = systemdependencies_.find(name);
+  if (d_it == systemdependencies_.end())
+  {
+    tf_err("SystemBucket does not exist in system dependency graph.", "SystemBucket name: %s", name.c_str());
+  }
+  return (*d_it).second;
+}
+
+//*******************************************************************|************************************************************//
+// return the level of the named system in the dependency graph
+//*******************************************************************|************************************************************//
+const int Bucket::system_level_(const std::string &name) const
+{
+  std::map< std::string, int >::const_iterator l_it = systemlevels_.find(name);
+  if (l_it == systemlevels_.end())
+  {
+    tf_err("SystemBucket does not exist in system dependency graph.", "SystemBucket name: %s", name.c_str());
+  }
+  return (*l_it).second;
+}
+
+//*******************************************************************|************************************************************//
+// return a (boost shared) pointer to the solver that the named solver replaces while the systems are being rebuilt after a mesh
+// adapt (null if we're not adapting or the solver didn't exist before)
+//*******************************************************************|************************************************************//
+const SolverBucket_ptr Bucket::adapted_solver(const std::string &systemname,
+                                              const std::string &solvername) const
+{
+  SolverBucket_ptr solver;
+  std::map< std::string, SystemBucket_ptr >::const_iterator s_it = adaptedsystems_.find(systemname);
+  if (s_it != adaptedsystems_.end())
+  {
+    for (SolverBucket_const_it sol_it = (*(*s_it).second).solvers_begin();
+                               sol_it != (*(*s_it).second).solvers_end(); sol_it++)
+    {
+      if ((*sol_it).first == solvername)
+      {
+        solver = (*sol_it).second;
+        break;
+      }
+    }
+  }
+  return solver;
+}
+
 //*******************************************************************|************************************************************//
 // register a base ufl symbol (associated with the derived ufl symbol) in the bucket data maps
 //*******************************************************************|************************************************************//
@@ -1010,6 +1260,11 @@ void Bucket::checkpoint_(const double_ptr time)
 {
   log(INFO, "Checkpointing simulation.");
 
+  double walltime = 0.0;
+  if (walltime_safetyfactor_)
+  {
+    walltime = elapsed_walltime();
+  }
  
   for (SystemBucket_it s_it = systems_begin(); 
                        s_it != systems_end(); s_it++)
@@ -1021,6 +1276,21 @@ void Bucket::checkpoint_(const double_ptr time)
 
   (*checkpoint_count_)++;
 
+  if (walltime_safetyfactor_)                                        // update the moving average of the checkpoint cost
+  {
+    const double weight = 0.3;
+    walltime = elapsed_walltime() - walltime;
+    if (checkpoint_walltime_ < 0.0)
+    {
+      checkpoint_walltime_ = walltime;
+    }
+    else
+    {
+      checkpoint_walltime_ = weight*walltime + (1.0-weight)*checkpoint_walltime_;
+    }
+    previous_walltime_ += walltime;                                  // don't count the checkpoint in the timestep cost
+  }
+
 }
 
 //*******************************************************************|************************************************************//
@@ -1068,6 +1338,102 @@ const std::string Bucket::systems_str(const int &indent) const
   return s.str();
 }
 
+//*******************************************************************|************************************************************//
+// return a string describing the (global) memory footprint of the vectors and matrices in the bucket
+//*******************************************************************|************************************************************//
+const std::string Bucket::memory_str() const
+{
+  std::stringstream s;
+  int indent = 1;
+  s << "Memory footprint of bucket " << name() << std::endl;
+  for ( SystemBucket_const_it s_it = systems_begin(); 
+                              s_it != systems_end(); s_it++ )
+  {
+    s << (*(*s_it).second).memory_str(indent);
+  }
+  return s.str();
+}
+
+//*******************************************************************|************************************************************//
+// return a string describing the system dependency graph
+//*******************************************************************|************************************************************//
+const std::string Bucket::systemgraph_str(const int &indent) const
+{
+  std::stringstream s;
+  std::string indentation (indent*2, ' ');
+  s << indentation << "System dependencies of bucket " << name() << std::endl;
+  indentation = std::string((indent+1)*2, ' ');
+  for ( SystemBucket_const_it s_it = systems_begin(); 
+                              s_it != systems_end(); s_it++ )
+  {
+    const std::string sysname = (*(*s_it).second).name();
+    s << indentation << sysname << " (level " << system_level_(sysname) << "):";
+    const std::set< std::string > dependencies = system_dependencies_(sysname);
+    if (dependencies.empty())
+    {
+      s << " none";
+    }
+    for (std::set< std::string >::const_iterator d_it = dependencies.begin();
+                                               d_it != dependencies.end(); d_it++)
+    {
+      s << " " << *d_it;
+    }
+    s << std::endl;
+  }
+  return s.str();
+}
+
+//*******************************************************************|************************************************************//
+// write the system dependency graph to a graphviz dot file (systems on the same level are ranked together)
+//*******************************************************************|************************************************************//
+void Bucket::write_systemgraph(const std::string &filename) const
+{
+  if (dolfin::MPI::rank(MPI_COMM_WORLD)!=0)                          // all processes know the graph so only rank 0 writes
+  {
+    return;
+  }
+
+  std::ofstream file(filename.c_str());
+  if (!file.is_open())
+  {
+    tf_err("Unable to open system graph file.", "Filename: %s", filename.c_str());
+  }
+
+  file << "digraph \"" << name() << "\" {" << std::endl;
+  file << "  rankdir=LR;" << std::endl;
+  std::map< int, std::vector< std::string > > levels;
+  for ( SystemBucket_const_it s_it = systems_begin(); 
+                              s_it != systems_end(); s_it++ )
+  {
+    const std::string sysname = (*(*s_it).second).name();
+    levels[system_level_(sysname)].push_back(sysname);
+    const std::set< std::string > dependencies = system_dependencies_(sysname);
+    for (std::set< std::string >::const_iterator d_it = dependencies.begin();
+                                               d_it != dependencies.end(); d_it++)
+    {
+      file << "  \"" << *d_it << "\" -> \"" << sysname << "\"";
+      if (system_level_(*d_it) >= system_level_(sysname))            // a dependency on a later system is lagged (it uses the
+      {                                                              // previous values) so mark it differently
+        file << " [style=dashed]";
+      }
+      file << ";" << std::endl;
+    }
+  }
+  for (std::map< int, std::vector< std::string > >::const_iterator l_it = levels.begin();
+                                                                  l_it != levels.end(); l_it++)
+  {
+    file << "  { rank=same;";
+    for (std::vector< std::string >::const_iterator n_it = (*l_it).second.begin();
+                                                   n_it != (*l_it).second.end(); n_it++)
+    {
+      file << " \"" << *n_it << "\";";
+    }
+    file << " }" << std::endl;
+  }
+  file << "}" << std::endl;
+  file.close();
+}
+
 //*******************************************************************|************************************************************//
 // return a string describing what functionspaces are registered for coefficients in the bucket
 //*******************************************************************|************************************************************//
@@ -1155,6 +1521,140 @@ void Bucket::fill_uflsymbols_()
   }
 }
 
+//*******************************************************************|************************************************************//
+// derive the system dependency graph from the coefficients that the solver forms (and coefficient functionals) of each
+// system pull from the bucket then assign each system a level one above the earlier systems it depends on (dependencies on
+// later systems use their lagged values and are recorded but don't affect the level)
+// coefficient functions set from expressions may read fields of other systems at run time but aren't inspected so those
+// dependencies are missing from the graph, which is only used for output
+//*******************************************************************|************************************************************//
+void Bucket::fill_systemgraph_()
+{
+  std::map< std::string, std::string > owners;                       // a map from base ufl symbols to the system that owns them
+  for (SystemBucket_const_it s_it = systems_begin();                 // loop over the systems
+                             s_it != systems_end(); s_it++)
+  {
+    SystemBucket_ptr system = (*s_it).second;
+    owners[(*system).uflsymbol()] = (*system).name();
+    for (FunctionBucket_const_it f_it = (*system).fields_begin();
+                            f_it != (*system).fields_end(); f_it++)
+    {
+      owners[(*(*f_it).second).uflsymbol()] = (*system).name();
+    }
+    for (FunctionBucket_const_it f_it = (*system).coeffs_begin();
+                            f_it != (*system).coeffs_end(); f_it++)
+    {
+      owners[(*(*f_it).second).uflsymbol()] = (*system).name();
+    }
+  }
+
+  systemdependencies_.clear();
+  systemlevels_.clear();
+  for (SystemBucket_const_it s_it = systems_begin();                 // loop over the systems again (in order)
+                             s_it != systems_end(); s_it++)
+  {
+    SystemBucket_ptr system = (*s_it).second;
+    const std::string sysname = (*system).name();
+
+    std::vector< Form_ptr > forms;                                   // collect the forms that are evaluated when this system is
+    for (SolverBucket_const_it sol_it = (*system).solvers_begin();   // solved or updated
+                               sol_it != (*system).solvers_end(); sol_it++)
+    {
+      SolverBucket_ptr solver = (*sol_it).second;
+      for (Form_const_it f_it = (*solver).forms_begin(); 
+                         f_it != (*solver).forms_end(); f_it++)
+      {
+        forms.push_back((*f_it).second);
+      }
+      for (Form_const_it f_it = (*solver).solverforms_begin(); 
+                         f_it != (*solver).solverforms_end(); f_it++)
+      {
+        forms.push_back((*f_it).second);
+      }
+    }
+    for (FunctionBucket_const_it f_it = (*system).coeffs_begin();
+                            f_it != (*system).coeffs_end(); f_it++)
+    {
+      if ((*(*f_it).second).constantfunctional())
+      {
+        forms.push_back((*(*f_it).second).constantfunctional());
+      }
+    }
+
+    std::set< std::string > &dependencies = systemdependencies_[sysname];
+    for (std::vector< Form_ptr >::const_iterator f_it = forms.begin();
+                                                f_it != forms.end(); f_it++)
+    {
+      uint ncoeff = (**f_it).num_coefficients();
+      for (uint i = 0; i < ncoeff; i++)
+      {
+        std::string uflsymbol = (**f_it).coefficient_name(i);
+        if (!contains_baseuflsymbol(uflsymbol))                      // e.g. the timestep
+        {
+          continue;
+        }
+        std::string baseuflsymbol = fetch_baseuflsymbol(uflsymbol);
+        if (uflsymbol == baseuflsymbol+"_n")                         // old values are fixed over a timestep so don't create a
+        {                                                            // dependency
+          continue;
+        }
+        std::map< std::string, std::string >::const_iterator o_it = owners.find(baseuflsymbol);
+        if (o_it != owners.end() && (*o_it).second != sysname)
+        {
+          dependencies.insert((*o_it).second);
+        }
+      }
+    }
+
+    int level = 0;                                                   // a system sits one level above the earlier systems it depends
+    for (std::set< std::string >::const_iterator d_it = dependencies.begin();      // on (dependencies on later systems are lagged
+                                               d_it != dependencies.end(); d_it++) // by the solve order so don't constrain it)
+    {
+      std::map< std::string, int >::const_iterator l_it = systemlevels_.find(*d_it);
+      if (l_it != systemlevels_.end())
+      {
+        level = std::max(level, (*l_it).second + 1);
+      }
+    }
+    systemlevels_[sysname] = level;
+  }
+
+  log(INFO, "%s", systemgraph_str().c_str());
+}
+
+//*******************************************************************|************************************************************//
+// replace the named mesh in the bucket data maps (the visualization functionspace on the old mesh is forgotten so a new one can
+// be registered)
+//*******************************************************************|************************************************************//
+void Bucket::replace_mesh_(Mesh_ptr mesh, const std::string &name)
+{
+  Mesh_hash_it m_it = meshes_.get<om_key_hash>().find(name);         // check the mesh exists
+  if (m_it == meshes_.get<om_key_hash>().end())
+  {
+    tf_err("Mesh does not exist in bucket.", "Mesh name: %s", name.c_str());
+  }
+
+  visfunctionspaces_.erase((*m_it).second);
+
+  Mesh_it s_it = meshes_.project<om_key_seq>(m_it);                  // erase the old mesh and insert the new one in its place
+  s_it = meshes_.get<om_key_seq>().erase(s_it);                      // so that the meshes stay in the same order
+  meshes_.get<om_key_seq>().insert(s_it, om_item<const std::string, Mesh_ptr>(name, mesh));
+}
+
+//*******************************************************************|************************************************************//
+// empty the systems and all the data derived from them (ufl symbols, coefficient functionspaces, timestep constraints and
+// the system graph) so that they can be filled again (e.g. after a mesh adapt)
+//*******************************************************************|************************************************************//
+void Bucket::reset_systems_()
+{
+  systems_.clear();
+  uflsymbols_.clear();
+  coefficientspaces_.clear();
+  timestep_constraints_.clear();
+  systemdependencies_.clear();
+  systemlevels_.clear();
+}
+
 //*******************************************************************|************************************************************//
 // return a boolean indicating if the simulation has reached a steady state or not
 //*******************************************************************|************************************************************//
@@ -1276,12 +1776,117 @@ void Bucket::solve_in_timeloop_()
   }
 }
 
+//*******************************************************************|************************************************************//
+// solve the in_timeloop solvers of a system over equal substeps of the current timestep, temporarily setting the timestep, old and
+// current times to those of each substep (other systems are held at their latest values)
+//*******************************************************************|************************************************************//
+void Bucket::subcycle_(SystemBucket_ptr system)
+{
+  const int nsubcycles = (*system).subcycles();
+  const double dt = timestep();
+  const double old_time = *old_time_;
+  const double current_time = *current_time_;
+
+  (*system).start_subcycling(timestep_count());                      // start from the old values at the beginning of the timestep
+                                                                     // (even in later nonlinear systems iterations)
+
+  *(timestep_.second) = dt/nsubcycles;
+  for (int k = 1; k <= nsubcycles; k++)
+  {
+    if (k > 1)
+    {
+      (*system).update();                                            // the previous substep becomes the old value
+    }
+
+    *old_time_ = old_time + (k-1)*dt/nsubcycles;
+    *current_time_ = (k == nsubcycles) ? current_time : old_time + k*dt/nsubcycles;
+    log(DBG, "Subcycle %d/%d of system %s: %g -> %g", k, nsubcycles, 
+                          (*system).name().c_str(), *old_time_, *current_time_);
+
+    (*system).update_timedependent();
+    (*system).update_nonlinear();
+
+    (*system).solve(SOLVE_TIMELOOP);
+
+    if (solvefailed_)                                                // a solver has failed so this attempt at the timestep will be
+    {                                                                // rolled back
+      break;
+    }
+  }
+
+  (*system).finish_subcycling();                                     // the old value is that at the start of the whole timestep
+
+  *old_time_ = old_time;                                             // restore the full timestep
+  *current_time_ = current_time;
+  *(timestep_.second) = dt;
+}
+
+//*******************************************************************|************************************************************//
+// solve the in_timeloop solvers of a system that is only solved every few timesteps, temporarily setting the timestep and old time to
+// span the time since it was last solved (its old value is from then as it isn't changed by the timesteps in between)
+//*******************************************************************|************************************************************//
+void Bucket::multirate_solve_(SystemBucket_ptr system)
+{
+  const double dt = timestep();
+  const double old_time = *old_time_;
+
+  if (timestep_count() > 1)                                          // the first solve steps from the start like the other systems
+  {
+    *old_time_ = (*system).last_solve_time();
+    *(timestep_.second) = *current_time_ - *old_time_;
+  }
+  log(DBG, "Multirate solve of system %s: %g -> %g", 
+                        (*system).name().c_str(), *old_time_, *current_time_);
+
+  (*system).update_timedependent();
+  (*system).update_nonlinear();
+
+  (*system).solve(SOLVE_TIMELOOP);
+
+  *old_time_ = old_time;                                             // restore the timestep of the other systems
+  *(timestep_.second) = dt;
+}
+
+//*******************************************************************|************************************************************//
+// if a solver failed during this attempt at the timestep, restore the systems to the snapshot taken at the start of the timestep,
+// reset the time and reduce the timestep, returning true if the timestep should be retried
+//*******************************************************************|************************************************************//
+bool Bucket::rollback_timestep_()
+{
+  if (!solvefailed_)
+  {
+    return false;
+  }
+  solvefailed_ = false;
+  timestep_retries_++;
+
+  for (SystemBucket_const_it s_it = systems_begin(); 
+                             s_it != systems_end(); s_it++)
+  {
+    (*(*s_it).second).rollback();
+  }
+
+  *current_time_ = *old_time_;                                       // back to the start of the timestep
+  (*timestep_count_)--;
+
+  *(timestep_.second) = timestep()*(*timestep_retryfactor_);         // a reduction can't violate any timestep constraints
+  log(WARNING, "Rolling back timestep %d, retry %d of %d with timestep %g.", timestep_count()+1, 
+                                   timestep_retries_, timestep_maxretries_, timestep());
+
+  return true;
+}
+
 //*******************************************************************|************************************************************//
 // return a boolean indicating if the timestep has finished iterating or not
 //*******************************************************************|************************************************************//
 bool Bucket::complete_iterating_(const double &aerror0)
 {
   bool completed = true;
+
+  if (solvefailed_)                                                  // a solver has failed so stop iterating as this attempt at the
+  {                                                                  // timestep will be rolled back
+    return completed;
+  }
   
   if (rtol_)
   {
@@ -1325,7 +1930,11 @@ bool Bucket::complete_iterating_(const double &aerror0)
       log(WARNING, "it = %d, maxits_ = %d", iteration_count(), maxits_);
       log(WARNING, "rerror = %.12e, rtol_ = %.12e", rerror, *rtol_);
       log(WARNING, "aerror = %.12e, atol_ = %.12e", aerror, atol_);
-      if (ignore_failures_)
+      if (retry_failure())
+      {
+        log(WARNING, "Retrying timestep: Nonlinear system failure.");
+      }
+      else if (ignore_failures_)
       {
         log(WARNING, "Ignoring: Nonlinear system failure.");
       }
@@ -1351,3 +1960,27 @@ void Bucket::checkpoint_options_(const double_ptr time)
   tf_err("Failed to find virtual function checkpoint_options_.", "Need to implement a checkpointing method.");
 }
 
+//*******************************************************************|************************************************************//
+// adapt the meshes - the base bucket doesn't know how to adapt meshes so does nothing
+//*******************************************************************|************************************************************//
+void Bucket::adapt_meshes_()
+{
+                                                                     // do nothing
+}
+
+//*******************************************************************|************************************************************//
+// rebalance the meshes - the base bucket doesn't know how to repartition meshes so does nothing
+//*******************************************************************|************************************************************//
+void Bucket::rebalance_meshes_()
+{
+                                                                     // do nothing
+}
+
+//*******************************************************************|************************************************************//
+// start the given ensemble member - the base bucket doesn't know how to reset itself so does nothing
+//*******************************************************************|************************************************************//
+void Bucket::start_ensemble_member_(const uint &member)
+{
+                                                                     // do nothing
+}
+
@@ -26,6 +26,7 @@
 #include "SystemBucket.h"
 #include "SolverBucket.h"
 #include "Logger.h"
+#include "ThreadedAssembler.h"
 
 using namespace buckettools;
 
@@ -62,20 +63,15 @@ PetscErrorCode buckettools::FormFunction(SNES snes, Vec x, Vec f,
   }
 
   Function_ptr iteratedfunction = (*system).iteratedfunction();      // collect the iterated system bucket function
-  const std::vector< std::shared_ptr<const dolfin::DirichletBC> >& bcs = 
-                                         (*system).bcs();   // get the vector of bcs
   dolfin::PETScVector rhs(f), iteratedvec(x);
 
   (*(*iteratedfunction).vector()) = iteratedvec;                     // update the iterated system bucket function
 
   (*bucket).update_nonlinear();                                      // update nonlinear coefficients
 
-  dolfin::Assembler assembler;
+  ThreadedAssembler assembler;
   assembler.assemble(rhs, *(*solver).linear_form());
-  for(uint i = 0; i < bcs.size(); ++i)                               // loop over the bcs
-  {
-    (*bcs[i]).apply(rhs, (*(*iteratedfunction).vector()));
-  }
+  (*system).apply_bcs(rhs, (*(*iteratedfunction).vector()));         // apply the bcs
   
   MatNullSpace sp = (*solver).nullspace();
   if (sp)
@@ -144,19 +140,22 @@ PetscErrorCode buckettools::FormJacobian(SNES snes, Vec x, Mat A,
     perr = VecNorm(x,NORM_INFINITY,&norm); CHKERRQ(perr);
     log(dolfin::get_log_level(), "FormJacobian(1): inf-norm x = %g", norm);
 
-    #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
-    perr = MatNorm(*A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
-    #else
-    perr = MatNorm(A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
-    #endif
-    log(dolfin::get_log_level(), "FormJacobian(1): Frobenius norm A = %g", norm);
+    if (!(*solver).matrix_free())                                    // matrix free jacobians have no norms
+    {
+      #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
+      perr = MatNorm(*A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
+      #else
+      perr = MatNorm(A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
+      #endif
+      log(dolfin::get_log_level(), "FormJacobian(1): Frobenius norm A = %g", norm);
 
-    #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
-    perr = MatNorm(*A,NORM_INFINITY,&norm); CHKERRQ(perr);
-    #else
-    perr = MatNorm(A,NORM_INFINITY,&norm); CHKERRQ(perr);
-    #endif
-    log(dolfin::get_log_level(), "FormJacobian(1): inf-norm A = %g", norm);
+      #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
+      perr = MatNorm(*A,NORM_INFINITY,&norm); CHKERRQ(perr);
+      #else
+      perr = MatNorm(A,NORM_INFINITY,&norm); CHKERRQ(perr);
+      #endif
+      log(dolfin::get_log_level(), "FormJacobian(1): inf-norm A = %g", norm);
+    }
 
     #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
     perr = MatNorm(*B,NORM_FROBENIUS,&norm); CHKERRQ(perr);
@@ -185,17 +184,47 @@ PetscErrorCode buckettools::FormJacobian(SNES snes, Vec x, Mat A,
 
   (*(*iteratedfunction).vector()) = iteratedvec;                     // update the iterated system bucket function
 
-  (*bucket).update_nonlinear();                                      // update nonlinear coefficients
+  bool reuse = false;                                                // can we reuse the matrices assembled at a previous iteration?
+  if ((*solver).jacobian_reuse() != JACOBIAN_REUSE_NEVER)
+  {
+    Vec f;
+    PetscReal fnorm;
+    perr = SNESGetFunction(snes, &f, PETSC_NULL, PETSC_NULL); CHKERRQ(perr);
+    perr = VecNorm(f, NORM_2, &fnorm); CHKERRQ(perr);                // the residual at x has already been evaluated by the snes
+    reuse = (*solver).reuse_jacobian(iter, fnorm);
+  }
 
-  dolfin::SystemAssembler assembler((*solver).bilinear_form(), (*solver).linear_form(),
-                                    bcs);
-  assembler.assemble(matrix);                                        // assemble the matrix from the context bilinear form
-  if ((*solver).ident_zeros())
+  if (!reuse)
   {
-    matrix.ident_zeros();
+    (*bucket).update_nonlinear();                                    // update nonlinear coefficients
   }
 
-  if ((*solver).bilinearpc_form())                                   // do we have a different bilinear pc form associated?
+  if ((*solver).matrix_free())                                       // the matrix free jacobian just needs to be told about the
+  {                                                                  // new linearization point (taken from the snes)
+    #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
+    perr = MatAssemblyBegin(*A, MAT_FINAL_ASSEMBLY); CHKERRQ(perr);
+    perr = MatAssemblyEnd(*A, MAT_FINAL_ASSEMBLY); CHKERRQ(perr);
+    #else
+    perr = MatAssemblyBegin(A, MAT_FINAL_ASSEMBLY); CHKERRQ(perr);
+    perr = MatAssemblyEnd(A, MAT_FINAL_ASSEMBLY); CHKERRQ(perr);
+    #endif
+  }
+  else if (!reuse)
+  {
+    dolfin::SystemAssembler assembler((*solver).bilinear_form(), (*solver).linear_form(),
+                                      bcs);
+    assembler.assemble(matrix);                                      // assemble the matrix from the context bilinear form
+    if ((*solver).ident_zeros())
+    {
+      matrix.ident_zeros();
+    }
+  }
+
+  if (reuse)                                                         // leave the matrices (and hence their states) untouched so
+  {                                                                  // that the preconditioner isn't set up again either
+    log(INFO, "Reusing Jacobian at iteration %d", iter);
+  }
+  else if ((*solver).bilinearpc_form())                              // do we have a different bilinear pc form associated?
   {
     dolfin::SystemAssembler assemblerpc((*solver).bilinearpc_form(), (*solver).linear_form(),
                                       bcs);
@@ -207,8 +236,9 @@ PetscErrorCode buckettools::FormJacobian(SNES snes, Vec x, Mat A,
   }
 
   for (Form_const_it f_it = (*solver).solverforms_begin();           // update any solver forms/matrices/submatrices as well
-                     f_it != (*solver).solverforms_end(); f_it++)    // - these will already be attached to the appropriate
-  {                                                                  // ksps so be careful just to update their pointers
+                     f_it != (*solver).solverforms_end() && !reuse;  // - these will already be attached to the appropriate
+                     f_it++)                                         // ksps so be careful just to update their pointers
+  {
     PETScMatrix_ptr solvermatrix = (*solver).fetch_solvermatrix((*f_it).first);
     dolfin::SystemAssembler assemblerform((*f_it).second, (*solver).linear_form(),
                                       bcs);
@@ -218,15 +248,23 @@ PetscErrorCode buckettools::FormJacobian(SNES snes, Vec x, Mat A,
       (*solvermatrix).ident_zeros();
     }
 
-    IS is = (*solver).fetch_solverindexset((*f_it).first);
     Mat submatrix = (*solver).fetch_solversubmatrix((*f_it).first);
-    perr = MatGetSubMatrix((*solvermatrix).mat(), is, is, MAT_REUSE_MATRIX, &submatrix);
-    CHKERRQ(perr);
+    if((*solver).solvervirtual_submatrix((*f_it).first))
+    {                                                                // virtual submatrices already see the reassembled values
+      perr = PetscObjectStateIncrease((PetscObject)submatrix);       // so just make sure the pc knows they've changed
+      CHKERRQ(perr);
+    }
+    else
+    {
+      IS is = (*solver).fetch_solverindexset((*f_it).first);
+      perr = MatGetSubMatrix((*solvermatrix).mat(), is, is, MAT_REUSE_MATRIX, &submatrix);
+      CHKERRQ(perr);
+    }
 
   }
 
   #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
-  *flag = SAME_NONZERO_PATTERN;                                      // both matrices are assumed to have the same sparsity
+  *flag = reuse ? SAME_PRECONDITIONER : SAME_NONZERO_PATTERN;        // both matrices are assumed to have the same sparsity
   #endif
 
   if ((*solver).monitor_norms())
@@ -239,19 +277,22 @@ PetscErrorCode buckettools::FormJacobian(SNES snes, Vec x, Mat A,
     perr = VecNorm(x,NORM_INFINITY,&norm); CHKERRQ(perr);
     log(dolfin::get_log_level(), "FormJacobian(2): inf-norm x = %g", norm);
 
-    #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
-    perr = MatNorm(*A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
-    #else
-    perr = MatNorm(A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
-    #endif
-    log(dolfin::get_log_level(), "FormJacobian(2): Frobenius norm A = %g", norm);
+    if (!(*solver).matrix_free())                                    // matrix free jacobians have no norms
+    {
+      #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
+      perr = MatNorm(*A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
+      #else
+      perr = MatNorm(A,NORM_FROBENIUS,&norm); CHKERRQ(perr);
+      #endif
+      log(dolfin::get_log_level(), "FormJacobian(2): Frobenius norm A = %g", norm);
 
-    #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
-    perr = MatNorm(*A,NORM_INFINITY,&norm); CHKERRQ(perr);
-    #else
-    perr = MatNorm(A,NORM_INFINITY,&norm); CHKERRQ(perr);
-    #endif
-    log(dolfin::get_log_level(), "FormJacobian(2): inf-norm A = %g", norm);
+      #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
+      perr = MatNorm(*A,NORM_INFINITY,&norm); CHKERRQ(perr);
+      #else
+      perr = MatNorm(A,NORM_INFINITY,&norm); CHKERRQ(perr);
+      #endif
+      log(dolfin::get_log_level(), "FormJacobian(2): inf-norm A = %g", norm);
+    }
 
     #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 5
     perr = MatNorm(*B,NORM_FROBENIUS,&norm); CHKERRQ(perr);
@@ -290,37 +331,45 @@ PetscErrorCode buckettools::SNESCustomMonitor(SNES snes, PetscInt its,
 
   (*solver).iteration_count(its);                                    // set the iteration count
 
+  ConvergenceFile_ptr convfile = (*solver).convergence_file();
+  const bool copy = (*solver).visualization_monitor() ||             // only copy the snes vectors into the system functions if the
+                    (convfile && !(*convfile).norms_only());         // visualization or a full convergence file needs the fields
+
   Vec x;
   perr = SNESGetSolution(snes, &x);  CHKERRQ(perr);                  // get the solution vector from snes
   dolfin::PETScVector sol(x);
 
-  *(*(*system).iteratedfunction()).vector() = sol;
-
-  Vec rx;
-  perr = SNESGetFunction(snes, &rx, PETSC_NULL, PETSC_NULL);         // get the residual function vector from snes
-  CHKERRQ(perr);
-  dolfin::PETScVector solresid(rx);
-
-  *(*(*system).residualfunction()).vector() = solresid;
+  *(*(*system).iteratedfunction()).vector() = sol;                   // always keep the iterated function up to date
 
   Vec dx;
   perr = SNESGetSolutionUpdate(snes, &dx);  CHKERRQ(perr);           // get the solution update vector from snes
-  dolfin::PETScVector solupdate(dx);
-
-  *(*(*system).snesupdatefunction()).vector() = solupdate;
 
-  std::vector< GenericFunction_ptr > functions;                      // create a list of subfunctions
-  for (FunctionBucket_const_it f_it = (*system).fields_begin(); 
-                               f_it != (*system).fields_end(); 
-                                                        f_it++)
+  if (copy)
   {
-    functions.push_back((*(*f_it).second).iteratedfunction());
-    functions.push_back((*(*f_it).second).residualfunction());
-    functions.push_back((*(*f_it).second).snesupdatefunction());
+    Vec rx;
+    perr = SNESGetFunction(snes, &rx, PETSC_NULL, PETSC_NULL);       // get the residual function vector from snes
+    CHKERRQ(perr);
+    dolfin::PETScVector solresid(rx);
+
+    *(*(*system).residualfunction()).vector() = solresid;
+
+    dolfin::PETScVector solupdate(dx);
+
+    *(*(*system).snesupdatefunction()).vector() = solupdate;
   }
 
   if (((*solver).visualization_monitor()))
   {
+    std::vector< GenericFunction_ptr > functions;                    // create a list of subfunctions
+    for (FunctionBucket_const_it f_it = (*system).fields_begin(); 
+                                 f_it != (*system).fields_end(); 
+                                                          f_it++)
+    {
+      functions.push_back((*(*f_it).second).iteratedfunction());
+      functions.push_back((*(*f_it).second).residualfunction());
+      functions.push_back((*(*f_it).second).snesupdatefunction());
+    }
+
     if (its==0)
     {
       buffer.str(""); buffer << (*bucket).output_basename() << "_" 
@@ -337,10 +386,20 @@ PetscErrorCode buckettools::SNESCustomMonitor(SNES snes, PetscInt its,
     (*(*snesctx).pvdfile).write(functions, *visfuncspace, (double) its);
   }
 
-  if ((*solver).convergence_file())
+  if (convfile)
   {
 
-    (*(*solver).convergence_file()).write_data();
+    if ((*convfile).norms_only())                                    // the norms can be taken straight from the snes vectors (the
+    {                                                                // residual norm is passed in)
+      PetscReal solnorm, updatenorm;
+      perr = VecNorm(x, NORM_2, &solnorm); CHKERRQ(perr);
+      perr = VecNorm(dx, NORM_2, &updatenorm); CHKERRQ(perr);
+      (*convfile).write_norms(solnorm, norm, updatenorm);
+    }
+    else
+    {
+      (*convfile).write_data();
+    }
 
   }
 
@@ -364,25 +423,23 @@ PetscErrorCode buckettools::KSPCustomMonitor(KSP ksp, int it,
   SystemBucket* system = (*solver).system();                         // retrieve a (standard) pointer to the parent system of this solver
   Bucket*       bucket = (*system).bucket();                         // retrieve a (standard) pointer to the parent bucket of this solver
 
-  Vec x;
-  perr = KSPBuildSolution(ksp, PETSC_NULL, &x);  CHKERRQ(perr);      // get the solution vector from the ksp
-  dolfin::PETScVector sol(x);
+  KSPConvergenceFile_ptr kspconvfile = (*solver).ksp_convergence_file();
+  const bool build = (*solver).kspvisualization_monitor() ||         // building the solution and residual typically costs an extra
+                     (kspconvfile && !(*kspconvfile).norms_only());  // matrix-vector product so only do it if they're needed
 
-  *(*(*system).iteratedfunction()).vector() = sol;
+  if (build)
+  {
+    Vec x;
+    perr = KSPBuildSolution(ksp, PETSC_NULL, &x);  CHKERRQ(perr);    // get the solution vector from the ksp
+    dolfin::PETScVector sol(x);
 
-  Vec rx;
-  perr = KSPBuildResidual(ksp, PETSC_NULL, PETSC_NULL, &rx);  CHKERRQ(perr);// get the residual vector from the ksp
-  dolfin::PETScVector solresid(rx);
+    *(*(*system).iteratedfunction()).vector() = sol;
 
-  *(*(*system).residualfunction()).vector() = solresid;
+    Vec rx;
+    perr = KSPBuildResidual(ksp, PETSC_NULL, PETSC_NULL, &rx);  CHKERRQ(perr);// get the residual vector from the ksp
+    dolfin::PETScVector solresid(rx);
 
-  std::vector< GenericFunction_ptr > functions;                      // create a list of subfunctions
-  for (FunctionBucket_const_it f_it = (*system).fields_begin(); 
-                               f_it != (*system).fields_end(); 
-                                                        f_it++)
-  {
-    functions.push_back((*(*f_it).second).iteratedfunction());
-    functions.push_back((*(*f_it).second).residualfunction());
+    *(*(*system).residualfunction()).vector() = solresid;
   }
 
   if ((*solver).type()=="SNES")
@@ -394,6 +451,15 @@ PetscErrorCode buckettools::KSPCustomMonitor(KSP ksp, int it,
 
   if (((*solver).kspvisualization_monitor()))
   {
+    std::vector< GenericFunction_ptr > functions;                    // create a list of subfunctions
+    for (FunctionBucket_const_it f_it = (*system).fields_begin(); 
+                                 f_it != (*system).fields_end(); 
+                                                          f_it++)
+    {
+      functions.push_back((*(*f_it).second).iteratedfunction());
+      functions.push_back((*(*f_it).second).residualfunction());
+    }
+
     if (it==0)
     {
       buffer.str(""); buffer << (*bucket).output_basename() << "_" 
@@ -411,10 +477,17 @@ PetscErrorCode buckettools::KSPCustomMonitor(KSP ksp, int it,
     (*(*kspctx).pvdfile).write(functions, *visfuncspace, (double) it);
   }
 
-  if ((*solver).ksp_convergence_file())
+  if (kspconvfile)
   {
 
-    (*(*solver).ksp_convergence_file()).write_data(it);
+    if ((*kspconvfile).norms_only())
+    {
+      (*kspconvfile).write_norms(it, rnorm);                         // the norm the ksp is already monitoring
+    }
+    else
+    {
+      (*kspconvfile).write_data(it);
+    }
 
   }
 
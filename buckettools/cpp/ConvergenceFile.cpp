@@ -38,10 +38,12 @@ ConvergenceFile::ConvergenceFile(const std::string &name,
                                  const MPI_Comm &comm,
                                  const Bucket *bucket,
                                  const std::string &systemname, 
-                                 const std::string &solvername) :
+                                 const std::string &solvername,
+                                 const bool &normsonly) :
                                       DiagnosticsFile(name, comm, bucket),
                                       systemname_(systemname),
-                                      solvername_(solvername)
+                                      solvername_(solvername),
+                                      normsonly_(normsonly)
 {
                                                                      // do nothing... all handled by DiagnosticsFile constructor
 }
@@ -81,14 +83,60 @@ void ConvergenceFile::write_data()
   
 }
 
+//*******************************************************************|************************************************************//
+// write the system norms for a norms only file (these are passed in by the monitor so that no vectors need to be copied)
+//*******************************************************************|************************************************************//
+void ConvergenceFile::write_norms(const double &solnorm, 
+                                  const double &resnorm, 
+                                  const double &updatenorm)
+{
+  assert(normsonly_);
+
+  data_timestep_();                                                  // write the timestepping information
+  data_iteration_();                                                 // write the iteration information
+
+  SolverBucket_ptr sol_ptr = (*(*bucket_).fetch_system(systemname_)).fetch_solver(solvername_);
+  std::vector<double> values;
+  values.push_back(solnorm);
+  values.push_back(resnorm);
+  if ((*sol_ptr).type()=="SNES")
+  {
+    values.push_back(updatenorm);
+  }
+  data_(values);
+
+  data_endlineflush_();
+}
+
+//*******************************************************************|************************************************************//
+// recollect the fields after the bucket systems have been rebuilt (without rewriting the header)
+//*******************************************************************|************************************************************//
+void ConvergenceFile::refresh_bucket()
+{
+  const uint ncolumns = ncolumns_;                                   // header_bucket_ counts the columns again so reset them after
+  fields_.clear();
+
+  quiet_ = true;
+  header_bucket_();
+  quiet_ = false;
+
+  ncolumns_ = ncolumns;
+}
+
 //*******************************************************************|************************************************************//
 // write lines of the xml header for values relating to iterations
 //*******************************************************************|************************************************************//
 void ConvergenceFile::header_iteration_()
 {
   
+  SolverBucket_ptr sol_ptr = (*(*bucket_).fetch_system(systemname_)).fetch_solver(solvername_);
+
   tag_("NonlinearSystemsIteration", "value");                        // the nonlinear systems iteration
   tag_("NonlinearIteration", "value");                               // the nonlinear solver iteration
+  if ((*sol_ptr).type()=="SNES")
+  {
+    tag_("JacobianReused", "value");                                 // whether the jacobian used for this iteration was reused
+  }
   
 }
 
@@ -100,6 +148,12 @@ void ConvergenceFile::header_bucket_()
   SystemBucket_ptr sys_ptr = (*bucket_).fetch_system(systemname_);
   SolverBucket_ptr sol_ptr = (*sys_ptr).fetch_solver(solvername_);
 
+  if (normsonly_)
+  {
+    header_norms_(sys_ptr, sol_ptr);                                 // only the system norms
+    return;
+  }
+
   header_system_(sys_ptr, sol_ptr);                                  // write the header for the system itself
 
   for (FunctionBucket_const_it f_it = (*sys_ptr).fields_begin(); 
@@ -130,6 +184,20 @@ void ConvergenceFile::header_system_(const SystemBucket_ptr sys_ptr,
   }
 }
 
+//*******************************************************************|************************************************************//
+// write a header for the system norms (norms only files)
+//*******************************************************************|************************************************************//
+void ConvergenceFile::header_norms_(const SystemBucket_ptr sys_ptr, 
+                                    const SolverBucket_ptr sol_ptr)
+{
+  tag_((*sys_ptr).name(), "norm(l2)");
+  tag_((*sys_ptr).name(), "res_norm(l2)");
+  if ((*sol_ptr).type()=="SNES")
+  {
+    tag_((*sys_ptr).name(), "update_norm(l2)");
+  }
+}
+
 //*******************************************************************|************************************************************//
 // write a header for a set of model fields
 //*******************************************************************|************************************************************//
@@ -201,6 +269,10 @@ void ConvergenceFile::data_iteration_()
   
   data_((*bucket_).iteration_count());
   data_((*sol_ptr).iteration_count());
+  if ((*sol_ptr).type()=="SNES")
+  {
+    data_((int)(*sol_ptr).jacobian_reused());
+  }
 }
 
 //*******************************************************************|************************************************************//
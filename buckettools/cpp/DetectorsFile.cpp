@@ -123,6 +123,22 @@ void DetectorsFile::write_data()
   
 }
 
+//*******************************************************************|************************************************************//
+// recollect the detectors and functions after the bucket systems have been rebuilt (without rewriting the header)
+//*******************************************************************|************************************************************//
+void DetectorsFile::refresh_bucket()
+{
+  const uint ncolumns = ncolumns_;                                   // header_bucket_ counts the columns again so reset them after
+  detectors_.clear();
+  functions_.clear();
+
+  quiet_ = true;
+  header_bucket_();
+  quiet_ = false;
+
+  ncolumns_ = ncolumns;
+}
+
 //*******************************************************************|************************************************************//
 // write data to the file for values relating to timestepping
 //*******************************************************************|************************************************************//
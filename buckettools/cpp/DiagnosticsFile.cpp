@@ -38,7 +38,8 @@ using namespace buckettools;
 DiagnosticsFile::DiagnosticsFile(const std::string &name, 
                                  const MPI_Comm &comm,
                                  const Bucket *bucket) : 
-                                 name_(name), mpicomm_(comm), bucket_(bucket), ncolumns_(0)
+                                 name_(name), mpicomm_(comm), bucket_(bucket), ncolumns_(0),
+                                 quiet_(false)
 {
   if (dolfin::MPI::rank(mpicomm_)==0)
   {
@@ -54,6 +55,14 @@ DiagnosticsFile::~DiagnosticsFile()
   close();                                                           // close the file_ member
 }
 
+//*******************************************************************|************************************************************//
+// recollect any pointers into the bucket - nothing to do in the base class as it doesn't cache any
+//*******************************************************************|************************************************************//
+void DiagnosticsFile::refresh_bucket()
+{
+                                                                     // do nothing
+}
+
 //*******************************************************************|************************************************************//
 // write opening lines of the xml header
 //*******************************************************************|************************************************************//
@@ -186,7 +195,7 @@ void DiagnosticsFile::tag_(const std::string &name,
                     const uint &components)
 {
   
-  if (dolfin::MPI::rank(mpicomm_)==0)
+  if (!quiet_ && dolfin::MPI::rank(mpicomm_)==0)                     // quiet when only recollecting pointers into the bucket
   {
     file_ << "<field column=\"" << ncolumns_+1
           << "\" name=\"" << name
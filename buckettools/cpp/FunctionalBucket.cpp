@@ -27,6 +27,8 @@
 #include "DolfinPETScBase.h"
 #include "BucketPETScBase.h"
 #include "Logger.h"
+#include "ThreadedAssembler.h"
+#include "MultiFunctionalAssembler.h"
 #include <dolfin.h>
 #include <string>
 
@@ -76,36 +78,22 @@ void FunctionalBucket::attach_form_coeffs()
 //*******************************************************************|************************************************************//
 double FunctionalBucket::value(const bool& force)
 {
-  if(!calculated_ || force)
+  if (force)
   {
+    reset_outputfunctions_();
 
-    if (output_cellfunction())
-    {
-      if (!cellfunction_)
-      {
-        cellfunction_ = new dolfin::CellFunction<double>((*system()).mesh());
-      }
-      (*cellfunction_).set_all(0.0);
-    }
-
-    if (output_facetfunction())
-    {
-      if (!facetfunction_)
-      {
-        facetfunction_ = new dolfin::FacetFunction<double>((*system()).mesh());
-      }
-      (*facetfunction_).set_all(0.0);
-    }
-
-    dolfin::Assembler assembler;
+    ThreadedAssembler assembler;
     dolfin::Scalar value;
     assembler.assemble(value, *form_, cellfunction_, facetfunction_);
-    value_ = value.get_scalar_value();
-    if (!force)                                                      // if this has been forced it is outside the normal scope
-    {                                                                // of us calculating the functional value for output
-      calculated_ = true;                                            // so don't update the calculated flag or it'll throw off
-    }                                                                // our output assumptions
+    value_ = value.get_scalar_value();                               // if this has been forced it is outside the normal scope
+                                                                     // of us calculating the functional value for output
+                                                                     // so don't update the calculated flag or it'll throw off
+                                                                     // our output assumptions
   }
+  else if (!calculated_)
+  {
+    calculate_system_functionals_();                                 // calculate this and any other outstanding functionals in
+  }                                                                  // this system in a single pass over the mesh
   return value_;
 }
 
@@ -129,7 +117,7 @@ dolfin::CellFunction<double> FunctionalBucket::cellfunction(const bool& force) c
     l_cellfunction.set_all(0.0);
     dolfin::FacetFunction<double>* l_facetfunction = NULL;
   
-    dolfin::Assembler assembler;
+    ThreadedAssembler assembler;
     dolfin::Scalar value;
     assembler.assemble(value, *form_, &l_cellfunction, l_facetfunction);
 
@@ -149,7 +137,7 @@ dolfin::FacetFunction<double> FunctionalBucket::facetfunction(const bool& force)
   // only calculate the cell function if we haven't calculated it yet or we're not
   // outputing the cell function (in which case it won't be included in our normal
   // calculation of the functional anyway) or if we're forcing it
-  if (!force && calculated_ && output_cellfunction())
+  if (!force && calculated_ && output_facetfunction())
   {
     l_facetfunction = *facetfunction_;
   }
@@ -158,7 +146,7 @@ dolfin::FacetFunction<double> FunctionalBucket::facetfunction(const bool& force)
     l_facetfunction.set_all(0.0);
     dolfin::CellFunction<double>* l_cellfunction = NULL;
   
-    dolfin::Assembler assembler;
+    ThreadedAssembler assembler;
     dolfin::Scalar value;
     assembler.assemble(value, *form_, l_cellfunction, &l_facetfunction);
 
@@ -181,9 +169,9 @@ double FunctionalBucket::change()
 //*******************************************************************|************************************************************//
 void FunctionalBucket::update()
 {
-  if (include_in_steadystate())
-  {
-    double fvalue = value();                                         // check that the value has been calculated this timestep
+  if (include_in_steadystate() && !calculated_)                      // check that the value has been calculated this timestep but
+  {                                                                  // don't calculate functionals that weren't output this timestep
+    calculate_system_functionals_(true);                             // and aren't needed for the steady state
   }
   oldvalue_ = value_;
 }
@@ -229,6 +217,76 @@ void FunctionalBucket::output()
 
 }
 
+//*******************************************************************|************************************************************//
+// calculate this functional and any other uncalculated functionals of the parent system that will be needed for output this
+// timestep (or, if steadystateonly, just for the steady state) together, using a single pass over the mesh
+//*******************************************************************|************************************************************//
+void FunctionalBucket::calculate_system_functionals_(const bool &steadystateonly)
+{
+  std::vector< FunctionalBucket* > functionals;
+  functionals.push_back(this);
+  for (FunctionalBucket_it f_it = (*system_).functionals_begin(); 
+                           f_it != (*system_).functionals_end(); f_it++)
+  {
+    FunctionalBucket* functional = (*f_it).second.get();
+    if (functional == this || (*functional).calculated_)
+    {
+      continue;
+    }
+    if (steadystateonly ? (*functional).include_in_steadystate() : 
+        ((*functional).include_in_statistics() || (*functional).include_in_steadystate() ||
+         (*functional).output_cellfunction() || (*functional).output_facetfunction()))
+    {
+      functionals.push_back(functional);
+    }
+  }
+
+  std::vector< Form_ptr > forms;
+  std::vector< dolfin::CellFunction<double>* > cellvalues;
+  std::vector< dolfin::FacetFunction<double>* > facetvalues;
+  for (std::vector< FunctionalBucket* >::iterator f_it = functionals.begin(); f_it != functionals.end(); f_it++)
+  {
+    (**f_it).reset_outputfunctions_();
+    forms.push_back((**f_it).form_);
+    cellvalues.push_back((**f_it).output_cellfunction() ? (**f_it).cellfunction_ : NULL);
+    facetvalues.push_back((**f_it).output_facetfunction() ? (**f_it).facetfunction_ : NULL);
+  }
+
+  MultiFunctionalAssembler assembler;
+  std::vector<double> values;
+  assembler.assemble(values, forms, cellvalues, facetvalues);
+
+  for (std::size_t i = 0; i < functionals.size(); i++)
+  {
+    (*functionals[i]).value_ = values[i];
+    (*functionals[i]).calculated_ = true;
+  }
+}
+
+//*******************************************************************|************************************************************//
+// allocate (if necessary) and zero the cell and facet functions used for output
+//*******************************************************************|************************************************************//
+void FunctionalBucket::reset_outputfunctions_()
+{
+  if (output_cellfunction())
+  {
+    if (!cellfunction_)
+    {
+      cellfunction_ = new dolfin::CellFunction<double>((*system()).mesh());
+    }
+    (*cellfunction_).set_all(0.0);
+  }
+
+  if (output_facetfunction())
+  {
+    if (!facetfunction_)
+    {
+      facetfunction_ = new dolfin::FacetFunction<double>((*system()).mesh());
+    }
+    (*facetfunction_).set_all(0.0);
+  }
+}
+
 //*******************************************************************|************************************************************//
 // reset calculated flag
 //*******************************************************************|************************************************************//
@@ -34,7 +34,7 @@ InitialConditionExpression::InitialConditionExpression(std::map< std::size_t,
                                             dolfin::Expression(), 
                                             expressions_(expressions)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -45,7 +45,7 @@ InitialConditionExpression::InitialConditionExpression(const uint &dim,
                       dolfin::Expression(dim), 
                       expressions_(expressions)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -56,7 +56,7 @@ InitialConditionExpression::InitialConditionExpression(const std::vector<std::si
                       dolfin::Expression(value_shape), 
                       expressions_(expressions)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -75,19 +75,40 @@ void InitialConditionExpression::eval(dolfin::Array<double>& values,
                                       const dolfin::Array<double>& x, 
                                       const ufc::cell &cell) const
 {
-  for (uint i = 0; i < values.size(); i++)                           // zero the full value array
+  if (zero_)
   {
-    values[i] = 0.0;
+    for (uint i = 0; i < values.size(); i++)                         // zero the full value array
+    {
+      values[i] = 0.0;
+    }
   }
+  for (uint c = 0; c < components_.size(); c++)                      // loop over the component expressions
+  {
+    dolfin::Array<double> component_values(sizes_[c],                // a view of this component's part of the full value array
+                                           values.data() + offsets_[c]);
+    (*components_[c]).eval(component_values, x, cell);               // evaluate the component expression straight into it
+  }
+  
+}
+
+//*******************************************************************|************************************************************//
+// flatten the map of component expressions into vectors of expressions, offsets and sizes
+//*******************************************************************|************************************************************//
+void InitialConditionExpression::init_()
+{
+  components_.clear();
+  offsets_.clear();
+  sizes_.clear();
+
+  std::size_t covered = 0;                                           // number of values set by the components
   for (size_t_Expression_const_it expr = expressions_.begin();         // loop over the expressions in the map
                     expr != expressions_.end(); expr++)
   {
-    dolfin::Array<double> tmp_values((*(*expr).second).value_size());// set up a temporary value array
-    (*(*expr).second).eval(tmp_values, x, cell);                     // evaluate the component expression
-    for (uint i = 0; i< tmp_values.size(); i++)                      // loop over the temporary value array
-    {
-      values[(*expr).first+i] = tmp_values[i];                       // insert component value into the full value array
-    }
+    components_.push_back((*expr).second.get());
+    offsets_.push_back((*expr).first);
+    sizes_.push_back((*(*expr).second).value_size());
+    covered += sizes_.back();
   }
-  
+
+  zero_ = (covered != value_size());                                 // components are disjoint so full coverage means no zeroing
 }
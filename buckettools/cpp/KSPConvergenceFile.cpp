@@ -38,10 +38,12 @@ KSPConvergenceFile::KSPConvergenceFile(const std::string &name,
                                        const MPI_Comm &comm, 
                                        const Bucket *bucket,
                                        const std::string &systemname, 
-                                       const std::string &solvername) :
+                                       const std::string &solvername,
+                                       const bool &normsonly) :
                                         DiagnosticsFile(name, comm, bucket),
                                         systemname_(systemname),
-                                        solvername_(solvername)
+                                        solvername_(solvername),
+                                        normsonly_(normsonly)
 {
                                                                      // do nothing... all handled by DiagnosticsFile constructor
 }
@@ -81,6 +83,35 @@ void KSPConvergenceFile::write_data(const int &kspit)
   
 }
 
+//*******************************************************************|************************************************************//
+// write the residual norm monitored by the ksp for a norms only file (so the solution and residual never need to be built)
+//*******************************************************************|************************************************************//
+void KSPConvergenceFile::write_norms(const int &kspit, const double &resnorm)
+{
+  assert(normsonly_);
+
+  data_timestep_();                                                  // write the timestepping information
+  data_iteration_(kspit);                                            // write the iteration information
+  data_(resnorm);
+  
+  data_endlineflush_();
+}
+
+//*******************************************************************|************************************************************//
+// recollect the fields after the bucket systems have been rebuilt (without rewriting the header)
+//*******************************************************************|************************************************************//
+void KSPConvergenceFile::refresh_bucket()
+{
+  const uint ncolumns = ncolumns_;                                   // header_bucket_ counts the columns again so reset them after
+  fields_.clear();
+
+  quiet_ = true;
+  header_bucket_();
+  quiet_ = false;
+
+  ncolumns_ = ncolumns;
+}
+
 //*******************************************************************|************************************************************//
 // write lines of the xml header for values relating to iterations
 //*******************************************************************|************************************************************//
@@ -100,6 +131,12 @@ void KSPConvergenceFile::header_bucket_()
 {
   SystemBucket_ptr sys_ptr = (*bucket_).fetch_system(systemname_);
 
+  if (normsonly_)
+  {
+    tag_((*sys_ptr).name(), "res_norm(ksp)");                        // only the norm monitored by the ksp
+    return;
+  }
+
   header_system_(sys_ptr);                                           // write the header for the system itself
 
   for (FunctionBucket_const_it f_it = (*sys_ptr).fields_begin(); 
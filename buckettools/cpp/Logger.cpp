@@ -22,19 +22,26 @@
 #include "Logger.h"
 #include "Usage.h"
 #include "SignalHandler.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
 
 using namespace buckettools;
 
 static boost::scoped_array<char> va_buffer_(0);
 static unsigned int va_buffer_size_= 0;
 
+// Format string access
+static const char* va_cstr(const char* msg) { return msg; }
+static const char* va_cstr(const std::string &msg) { return msg.c_str(); }
+
 // Buffer allocation
-void allocate_va_buffer(std::string msg)
+void allocate_va_buffer(const char* msg)
 {
   // vsnprintf requires a char pointer of fixed size so we
   // need to allocate the va_buffer here. We allocate twice the size of
   // the format string and at least 1000.
-  unsigned int new_size = std::max(static_cast<unsigned int>(2*msg.size()),
+  unsigned int new_size = std::max(static_cast<unsigned int>(2*std::strlen(msg)),
                                    static_cast<unsigned int>(1000));
   //static_cast<unsigned int>(DOLFIN_LINELENGTH));
   if (new_size > va_buffer_size_)
@@ -46,19 +53,30 @@ void allocate_va_buffer(std::string msg)
 
 // Macro for parsing arguments
 #define va_read(va_buffer, msg) \
-  allocate_va_buffer(msg); \
+  allocate_va_buffer(va_cstr(msg)); \
   va_list va_ptr; \
   va_start(va_ptr, msg); \
-  vsnprintf(va_buffer, va_buffer_size_, msg.c_str(), va_ptr); \
+  vsnprintf(va_buffer, va_buffer_size_, va_cstr(msg), va_ptr); \
   va_end(va_ptr);
 
+static const std::size_t max_logbuffer_size_ = 65536;               // flush the log buffer once it gets this big
+
+// Flush the logger when the program exits
+void flush_at_exit()
+{
+  (*Logger::instance()).stop_flusher();
+  buckettools::flush_log();
+}
+
 Logger* Logger::instance_ = NULL;                                    // initialize the global static class variables
 
 //*******************************************************************|************************************************************//
 // default constructor
 //*******************************************************************|************************************************************//
 Logger::Logger() : logstream_(&std::cout), errstream_(&std::cerr),
-                   loglevel_(WARNING)
+                   loglevel_(WARNING), logactive_(true),
+                   flushinterval_(1.0), lastflush_(std::chrono::steady_clock::now()),
+                   stopflusher_(false)
 {
                                                                      // do nothing
 }
@@ -66,8 +84,14 @@ Logger::Logger() : logstream_(&std::cout), errstream_(&std::cerr),
 Logger::Logger(const Logger &logger)
 {
   loglevel_ = logger.loglevel_;
+  logactive_ = logger.logactive_;
   logstream_ = logger.logstream_;
   errstream_ = logger.errstream_;
+  logfile_ = logger.logfile_;
+  errfile_ = logger.errfile_;
+  flushinterval_ = logger.flushinterval_;
+  lastflush_ = logger.lastflush_;
+  stopflusher_ = false;
 }
 
 //*******************************************************************|************************************************************//
@@ -75,6 +99,8 @@ Logger::Logger(const Logger &logger)
 //*******************************************************************|************************************************************//
 void Logger::set_log_stream(std::ostream& logstream)
 {
+  std::lock_guard< std::mutex > lock(mutex_);
+  flush_();
   logstream_ = &logstream;
 }
 
@@ -83,9 +109,108 @@ void Logger::set_log_stream(std::ostream& logstream)
 //*******************************************************************|************************************************************//
 void Logger::set_err_stream(std::ostream& errstream)
 {
+  std::lock_guard< std::mutex > lock(mutex_);
+  flush_();
   errstream_ = &errstream;
 }
 
+//*******************************************************************|************************************************************//
+// write the log and errors to files named basename.log-rank and basename.err-rank, either on every rank or only on rank 0
+// (in which case other ranks only write warnings and errors to their existing error stream)
+// messages to these files are buffered and flushed at least every flushinterval_ seconds by a separate thread
+//*******************************************************************|************************************************************//
+void Logger::set_log_files(const std::string &basename, const bool &allranks)
+{
+  const int rank = dolfin::MPI::rank(MPI_COMM_WORLD);
+  if (!allranks && rank != 0)
+  {
+    flush();
+    logactive_ = false;
+    return;
+  }
+
+  std::stringstream logname, errname;
+  logname << basename << ".log-" << rank;
+  errname << basename << ".err-" << rank;
+
+  logfile_.reset( new std::ofstream(logname.str().c_str()) );
+  if (!(*logfile_))
+  {
+    buckettools::error(__FILE__, __LINE__, "Failed to open log file.",  // not tf_err as that would call Logger::error
+                       "Filename: %s", logname.str().c_str());
+  }
+  errfile_.reset( new std::ofstream(errname.str().c_str()) );
+  if (!(*errfile_))
+  {
+    buckettools::error(__FILE__, __LINE__, "Failed to open error file.",  // not tf_err as that would call Logger::error
+                       "Filename: %s", errname.str().c_str());
+  }
+
+  set_log_stream(*logfile_);
+  set_err_stream(*errfile_);
+
+  if (!flusher_thread_.joinable())
+  {
+    flusher_thread_ = std::thread(&Logger::flusher_, this);
+  }
+}
+
+//*******************************************************************|************************************************************//
+// flush any buffered messages to the log stream
+//*******************************************************************|************************************************************//
+void Logger::flush()
+{
+  std::lock_guard< std::mutex > lock(mutex_);
+  flush_();
+}
+
+//*******************************************************************|************************************************************//
+// flush any buffered messages to the log stream (assumes the mutex is already locked)
+//*******************************************************************|************************************************************//
+void Logger::flush_()
+{
+  if (!logbuffer_.empty())
+  {
+    *logstream_ << logbuffer_;
+    logbuffer_.clear();
+  }
+  (*logstream_).flush();
+  (*errstream_).flush();
+  lastflush_ = std::chrono::steady_clock::now();
+}
+
+//*******************************************************************|************************************************************//
+// flush buffered messages every flushinterval_ seconds, even if nothing else is written, until told to stop
+//*******************************************************************|************************************************************//
+void Logger::flusher_()
+{
+  std::unique_lock< std::mutex > lock(mutex_);
+  while (!stopflusher_)
+  {
+    flusher_wakeup_.wait_for(lock, std::chrono::duration<double>(flushinterval_));
+    if (!logbuffer_.empty())
+    {
+      flush_();
+    }
+  }
+}
+
+//*******************************************************************|************************************************************//
+// stop the flusher thread (if it's running)
+//*******************************************************************|************************************************************//
+void Logger::stop_flusher()
+{
+  {
+    std::lock_guard< std::mutex > lock(mutex_);
+    stopflusher_ = true;
+  }
+  flusher_wakeup_.notify_all();
+  if (flusher_thread_.joinable())
+  {
+    flusher_thread_.join();
+  }
+}
+
 //*******************************************************************|************************************************************//
 // set log level
 //*******************************************************************|************************************************************//
@@ -100,7 +225,7 @@ void Logger::set_log_level(int &loglevel)
 void Logger::failure(const std::string &filename, 
                      const int &line,
                      const std::string &errstr,
-                     const std::string &reason) const
+                     const std::string &reason)
 {
   std::stringstream s;
   s << "*** ERROR: terminating at the end of the timestep."
@@ -119,7 +244,7 @@ void Logger::failure(const std::string &filename,
 void Logger::error(const std::string &filename, 
                    const int &line,
                    const std::string &errstr,
-                   const std::string &reason) const
+                   const std::string &reason)
 {
   std::stringstream s;
   s << "*** ERROR: terminating immediately!"
@@ -128,6 +253,7 @@ void Logger::error(const std::string &filename,
     << std::endl;
 
   write(ERROR, s.str());
+  flush();                                                           // make sure everything's out before we unwind
 
   throw std::runtime_error("std::runtime_error thrown.");
 }
@@ -138,7 +264,7 @@ void Logger::error(const std::string &filename,
 void Logger::warning(const std::string &filename, 
                      const int &line,
                      const std::string &errstr,
-                     const std::string &reason) const
+                     const std::string &reason)
 {
   std::stringstream s;
   s << std::endl
@@ -177,22 +303,39 @@ std::string Logger::description(const std::string &filename,
 
 //*******************************************************************|************************************************************//
 // write to the log or the error output (depending on the loglevel)
+// log messages written to our own log files are buffered and flushed when the buffer gets large, every flushinterval_
+// seconds or whenever a warning or error is written, warnings and errors are written immediately
+// log messages written to stdout are not buffered so that they stay in order with petsc and dolfin output (which is
+// also written to stdout and may be redirected to the same file by -l)
 //*******************************************************************|************************************************************//
-void Logger::write(int loglevel, std::string msg) const
+void Logger::write(const int &loglevel, const std::string &msg)
 {
-  if (loglevel<loglevel_)
+  if (!enabled(loglevel))
   {
     return;
   }
 
+  std::lock_guard< std::mutex > lock(mutex_);
+
   if (loglevel>=WARNING)
   {
+    flush_();                                                        // keep the log up to date with the error output
     *errstream_ << msg << std::endl;
   }
-  else
+  else if (!buffered_())
   {
     *logstream_ << msg << std::endl;
   }
+  else
+  {
+    logbuffer_ += msg;
+    logbuffer_ += '\n';
+    if (logbuffer_.size() > max_logbuffer_size_ || 
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - lastflush_).count() > flushinterval_)
+    {
+      flush_();
+    }
+  }
 }
 
 //*******************************************************************|************************************************************//
@@ -203,6 +346,7 @@ Logger* Logger::instance()
   if(!instance_)
   {
     instance_ = new Logger;
+    std::atexit(flush_at_exit);                                      // don't lose buffered messages on exit
   }
   return instance_;
 }
@@ -212,12 +356,30 @@ void buckettools::set_log_level(int &loglevel)
   (*Logger::instance()).set_log_level(loglevel);
 }
 
-void buckettools::log(int loglevel, std::string msg, ...)
+void buckettools::log(int loglevel, const char* msg, ...)
 {
+  if (!(*Logger::instance()).enabled(loglevel))                      // don't bother formatting messages that won't be written
+  {
+    return;
+  }
   va_read(va_buffer_.get(), msg);
   (*Logger::instance()).write(loglevel, va_buffer_.get());
 }
 
+void buckettools::log(int loglevel, const std::string &msg)
+{
+  if (!(*Logger::instance()).enabled(loglevel))
+  {
+    return;
+  }
+  (*Logger::instance()).write(loglevel, msg);
+}
+
+void buckettools::flush_log()
+{
+  (*Logger::instance()).flush();
+}
+
 void buckettools::failure(const std::string &filename, 
                           const int &line,
                           const std::string &errstr,
@@ -241,6 +403,10 @@ void buckettools::warning(const std::string &filename,
                           const std::string &errstr,
                           const std::string &reason, ...)
 {
+  if (!(*Logger::instance()).enabled(WARNING))
+  {
+    return;
+  }
   va_read(va_buffer_.get(), reason);
   (*Logger::instance()).warning(filename, line, errstr, va_buffer_.get());
 }
@@ -0,0 +1,251 @@
+// Copyright (C) 2013 Columbia University in the City of New York and others.
+//
+// Please see the AUTHORS file in the main source directory for a full list
+// of contributors.
+//
+// This file is part of TerraFERMA.
+//
+// TerraFERMA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TerraFERMA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TerraFERMA. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "MultiFunctionalAssembler.h"
+#include "ThreadedAssembler.h"
+#include "MPIBase.h"
+#include "Logger.h"
+#include <dolfin.h>
+
+using namespace buckettools;
+
+//*******************************************************************|************************************************************//
+// default constructor
+//*******************************************************************|************************************************************//
+MultiFunctionalAssembler::MultiFunctionalAssembler() : dolfin::AssemblerBase()
+{
+                                                                     // do nothing
+}
+
+//*******************************************************************|************************************************************//
+// default destructor
+//*******************************************************************|************************************************************//
+MultiFunctionalAssembler::~MultiFunctionalAssembler()
+{
+                                                                     // do nothing
+}
+
+//*******************************************************************|************************************************************//
+// assemble the functionals in forms into values in a single pass over the mesh
+//*******************************************************************|************************************************************//
+void MultiFunctionalAssembler::assemble(std::vector<double> &values,
+                                        const std::vector< Form_ptr > &forms,
+                                        const std::vector< dolfin::CellFunction<double>* > &cellvalues,
+                                        const std::vector< dolfin::FacetFunction<double>* > &facetvalues)
+{
+  const std::size_t nforms = forms.size();
+  assert(cellvalues.size() == nforms);
+  assert(facetvalues.size() == nforms);
+
+  values.assign(nforms, 0.0);
+  if (nforms == 0)
+  {
+    return;
+  }
+
+  const dolfin::Mesh &mesh = *(*forms[0]).mesh();
+  const std::size_t D = mesh.topology().dim();
+
+  std::vector<std::size_t> fused;                                    // indices of the forms in the fused assembly
+  std::vector< std::shared_ptr<dolfin::UFC> > ufcs;                  // and their ufc data
+  bool has_exterior_facet_integrals = false;
+  for (std::size_t i = 0; i < nforms; i++)
+  {
+    (*forms[i]).check();
+    if (fusable_(*forms[i], mesh))
+    {
+      fused.push_back(i);
+      ufcs.push_back(std::make_shared<dolfin::UFC>(*forms[i]));
+      has_exterior_facet_integrals = has_exterior_facet_integrals || 
+                                            (*(*forms[i]).ufc_form()).has_exterior_facet_integrals();
+    }
+    else
+    {
+      dolfin::Assembler assembler;                                   // assemble anything we can't fuse individually
+      dolfin::Scalar value;
+      assembler.assemble(value, *forms[i], cellvalues[i], facetvalues[i]);
+      values[i] = value.get_scalar_value();
+    }
+  }
+
+  const std::size_t nfused = fused.size();
+  if (nfused == 0)
+  {
+    return;
+  }
+
+  std::vector<double> fusedvalues(nfused, 0.0);
+  std::vector<double> coordinate_dofs;
+  ufc::cell ufc_cell;
+
+  if (ThreadedAssembler::threaded(mesh))                             // one threaded loop over the cells for all functionals (also
+  {                                                                  // recording their cost if requested)
+    std::vector< const dolfin::Form* > fusedforms;
+    std::vector< dolfin::CellFunction<double>* > fusedcellvalues;
+    for (std::size_t j = 0; j < nfused; j++)
+    {
+      fusedforms.push_back(forms[fused[j]].get());
+      fusedcellvalues.push_back(cellvalues[fused[j]]);
+    }
+    ThreadedAssembler assembler;
+    assembler.assemble_functional_cells(fusedvalues, fusedforms, ufcs, fusedcellvalues);
+  }
+  else
+  {
+    for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell)       // one serial loop over the cells for all functionals
+    {
+      bool initialized = false;
+      for (std::size_t j = 0; j < nfused; j++)
+      {
+        const std::size_t i = fused[j];
+        dolfin::UFC &ufc = *ufcs[j];
+
+        const ufc::cell_integral *integral = ufc.default_cell_integral.get();
+        std::shared_ptr<const dolfin::MeshFunction<std::size_t> > domains = (*forms[i]).cell_domains();
+        if (domains && !(*domains).empty())
+        {
+          integral = ufc.get_cell_integral((*domains)[*cell]);
+        }
+        if (!integral)
+        {
+          continue;
+        }
+
+        if (!initialized)                                            // only fetch the cell geometry once for all functionals
+        {
+          (*cell).get_coordinate_dofs(coordinate_dofs);
+          (*cell).get_cell_data(ufc_cell);
+          initialized = true;
+        }
+
+        ufc.update(*cell, coordinate_dofs, ufc_cell, (*integral).enabled_coefficients());
+        (*integral).tabulate_tensor(ufc.A.data(), ufc.w(), coordinate_dofs.data(), ufc_cell.orientation);
+
+        fusedvalues[j] += ufc.A[0];
+        if (cellvalues[i])
+        {
+          (*cellvalues[i])[*cell] += ufc.A[0];
+        }
+      }
+    }
+  }
+
+  if (has_exterior_facet_integrals)
+  {
+    mesh.init(D - 1);
+    mesh.init(D - 1, D);
+
+    for (dolfin::FacetIterator facet(mesh); !facet.end(); ++facet)   // one loop over the exterior facets for all functionals
+    {
+      if (!(*facet).exterior())
+      {
+        continue;
+      }
+
+      bool initialized = false;
+      dolfin::Cell mesh_cell(mesh, (*facet).entities(D)[0]);
+      const std::size_t local_facet = mesh_cell.index(*facet);
+
+      for (std::size_t j = 0; j < nfused; j++)
+      {
+        const std::size_t i = fused[j];
+        dolfin::UFC &ufc = *ufcs[j];
+
+        const ufc::exterior_facet_integral *integral = ufc.default_exterior_facet_integral.get();
+        std::shared_ptr<const dolfin::MeshFunction<std::size_t> > domains = (*forms[i]).exterior_facet_domains();
+        if (domains && !(*domains).empty())
+        {
+          integral = ufc.get_exterior_facet_integral((*domains)[*facet]);
+        }
+        if (!integral)
+        {
+          continue;
+        }
+
+        if (!initialized)
+        {
+          mesh_cell.get_coordinate_dofs(coordinate_dofs);
+          mesh_cell.get_cell_data(ufc_cell, local_facet);
+          initialized = true;
+        }
+
+        ufc.update(mesh_cell, coordinate_dofs, ufc_cell, (*integral).enabled_coefficients());
+        (*integral).tabulate_tensor(ufc.A.data(), ufc.w(), coordinate_dofs.data(), local_facet, ufc_cell.orientation);
+
+        fusedvalues[j] += ufc.A[0];
+        if (facetvalues[i])
+        {
+          (*facetvalues[i])[*facet] += ufc.A[0];
+        }
+      }
+    }
+  }
+
+#ifdef HAS_MPI
+  if (dolfin::MPI::size(mesh.mpi_comm()) > 1)                        // a single reduction for all the fused functionals
+  {
+    int mpierr = MPI_Allreduce(MPI_IN_PLACE, fusedvalues.data(), nfused, MPI_DOUBLE, MPI_SUM, mesh.mpi_comm());
+    mpi_err(mpierr);
+  }
+#endif
+
+  for (std::size_t j = 0; j < nfused; j++)
+  {
+    values[fused[j]] = fusedvalues[j];
+  }
+}
+
+//*******************************************************************|************************************************************//
+// can this functional be included in the fused assembly?
+// only rank 0 forms on the same mesh with cell and exterior facet integrals (using subdomains attached to the form) are fused
+//*******************************************************************|************************************************************//
+const bool MultiFunctionalAssembler::fusable_(const dolfin::Form &a, const dolfin::Mesh &mesh) const
+{
+  if (a.rank() != 0)
+  {
+    return false;
+  }
+
+  if ((*a.mesh()).id() != mesh.id())
+  {
+    return false;
+  }
+
+  const ufc::form &form = *a.ufc_form();
+  if (form.has_interior_facet_integrals() || form.has_vertex_integrals() ||
+      form.has_custom_integrals())
+  {
+    return false;
+  }
+
+  if (form.max_cell_subdomain_id() > 0 && !a.cell_domains())
+  {
+    return false;
+  }
+
+  if (form.max_exterior_facet_subdomain_id() > 0 && !a.exterior_facet_domains())
+  {
+    return false;
+  }
+
+  return true;
+}
+
@@ -23,7 +23,16 @@
 #include "PythonInstance.h"
 #include <dolfin.h>
 #include "Python.h"
+#include "Logger.h"
+#include <boost/functional/hash.hpp>
 #include <string>
+#include <set>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace buckettools;
 
@@ -58,6 +67,20 @@ void PythonPeriodicMap::map(const dolfin::Array<double>& x,
   meshdim = x.size();                                                // the coordinates dimension
   assert(valdim==meshdim);
 
+  if (!pairs_.empty())                                               // have we mapped this coordinate already?
+  {
+    std::map< std::vector<double>, std::vector<double> >::const_iterator p = 
+                                  pairs_.find(std::vector<double>(x.data(), x.data() + meshdim));
+    if (p != pairs_.end())
+    {
+      for (std::size_t i = 0; i<valdim; i++)
+      {
+        y[i] = (*p).second[i];
+      }
+      return;
+    }
+  }
+
   pPos=PyTuple_New(meshdim);                                         // prepare a python tuple for the coordinates
   
   pArgs = PyTuple_New(1);                                            // set up the input arguments tuple
@@ -112,3 +135,272 @@ void PythonPeriodicMap::map(const dolfin::Array<double>& x,
   
 }
 
+//*******************************************************************|************************************************************//
+// map all the candidate slave coordinates of the mesh (the vertices and entity midpoints of the slave facets) in one go, reading
+// them from the on-disk cache if this mesh and map have been seen before
+//*******************************************************************|************************************************************//
+void PythonPeriodicMap::prepare(const dolfin::Mesh &mesh, 
+                                const dolfin::MeshFunction<std::size_t> &facetdomains,
+                                const std::vector<std::size_t> &masterids,
+                                const std::vector<std::size_t> &slaveids)
+{
+  const std::string filename = cache_filename_(mesh, masterids, slaveids);
+  if (!filename.empty() && read_cache_(filename))
+  {
+    log(INFO, "Read %d periodic coordinate pairs from %s", pairs_.size(), filename.c_str());
+    return;
+  }
+
+  const std::size_t tdim = mesh.topology().dim();
+  const std::size_t gdim = mesh.geometry().dim();
+  std::set< std::vector<double> > candidates;                        // unique candidate slave coordinates
+  for (dolfin::FacetIterator facet(mesh); !facet.end(); ++facet)
+  {
+    if (std::find(slaveids.begin(), slaveids.end(), 
+                  facetdomains[*facet]) == slaveids.end())
+    {
+      continue;
+    }
+    for (std::size_t d = 0; d < tdim; d++)                           // loop over the entities of the facet (including itself)
+    {
+      for (dolfin::MeshEntityIterator e(*facet, d); !e.end(); ++e)
+      {
+        const dolfin::Point midpoint = (*e).midpoint();
+        candidates.insert(std::vector<double>(midpoint.coordinates(), 
+                                              midpoint.coordinates() + gdim));
+      }
+    }
+  }
+
+  std::vector< std::vector<double> > xs(candidates.begin(), candidates.end());
+  std::vector< std::vector<double> > ys;
+  map_batch_(xs, ys);
+  for (std::size_t i = 0; i < xs.size(); i++)
+  {
+    pairs_[xs[i]] = ys[i];
+  }
+  log(INFO, "Mapped %d periodic slave coordinates in a single python call", xs.size());
+
+  if (!filename.empty())
+  {
+    write_cache_(filename);
+  }
+}
+
+//*******************************************************************|************************************************************//
+// map a list of coordinates with a single call to python, wrapping the user function so that it is evaluated on all the
+// coordinates as an array where possible (falling back to a python loop)
+//*******************************************************************|************************************************************//
+void PythonPeriodicMap::map_batch_(const std::vector< std::vector<double> > &xs,
+                                   std::vector< std::vector<double> > &ys)
+{
+  ys.clear();
+  if (xs.empty())
+  {
+    return;
+  }
+
+  if (!batchpyinst_)
+  {
+    std::stringstream pythonbuffer;
+    pythonbuffer << pyinst_.function() << std::endl;
+    pythonbuffer << "def val(xs, _pointval=val):" << std::endl;
+    pythonbuffer << "  def point(x):" << std::endl;
+    pythonbuffer << "    y = _pointval(tuple(x))" << std::endl;
+    pythonbuffer << "    try:" << std::endl;
+    pythonbuffer << "      return [float(v) for v in y]" << std::endl;
+    pythonbuffer << "    except TypeError:" << std::endl;
+    pythonbuffer << "      return [float(y)]" << std::endl;
+    pythonbuffer << "  try:" << std::endl;
+    pythonbuffer << "    import numpy" << std::endl;
+    pythonbuffer << "    xa = numpy.array(xs, dtype=float).T" << std::endl;
+    pythonbuffer << "    ya = _pointval(xa)" << std::endl;
+    pythonbuffer << "    if xa.shape[0] == 1 and numpy.ndim(ya) == 1:" << std::endl;
+    pythonbuffer << "      ya = [ya]" << std::endl;
+    pythonbuffer << "    ya = numpy.array(numpy.broadcast_arrays(*ya), dtype=float).T" << std::endl;
+    pythonbuffer << "    if ya.shape == (len(xs), xa.shape[0]) and \\" << std::endl;
+    pythonbuffer << "       numpy.allclose(ya[0], point(xs[0])) and numpy.allclose(ya[-1], point(xs[-1])):" << std::endl;
+    pythonbuffer << "      return ya.tolist()" << std::endl;
+    pythonbuffer << "  except Exception:" << std::endl;
+    pythonbuffer << "    pass" << std::endl;
+    pythonbuffer << "  return [point(x) for x in xs]" << std::endl;
+    batchpyinst_.reset( new PythonInstance(pythonbuffer.str()) );
+  }
+
+  PyObject *pList = PyList_New(xs.size());                           // prepare a python list of coordinate tuples
+  for (std::size_t i = 0; i < xs.size(); i++)
+  {
+    PyObject *pPos = PyTuple_New(xs[i].size());
+    for (std::size_t j = 0; j < xs[i].size(); j++)
+    {
+      PyTuple_SetItem(pPos, j, PyFloat_FromDouble(xs[i][j]));
+    }
+    PyList_SetItem(pList, i, pPos);
+  }
+  PyObject *pArgs = PyTuple_New(1);
+  PyTuple_SetItem(pArgs, 0, pList);
+
+  PyObject *pResult = (*batchpyinst_).call(pArgs);                   // call the wrapped python function once
+  
+  if (PyErr_Occurred()){                                             // error check - in running user defined function
+    (*batchpyinst_).print_error();
+    dolfin::error("In PythonPeriodicMap::map_batch_ evaluating pResult");
+  }
+
+  PyObject *pSeq = PySequence_Fast(pResult, "expected a sequence");
+  if (!pSeq || PySequence_Fast_GET_SIZE(pSeq) != (Py_ssize_t) xs.size())
+  {
+    (*batchpyinst_).print_error();
+    dolfin::error("In PythonPeriodicMap::map_batch_ wrong number of values returned");
+  }
+  ys.resize(xs.size());
+  for (std::size_t i = 0; i < xs.size(); i++)
+  {
+    PyObject *pItem = PySequence_Fast(PySequence_Fast_GET_ITEM(pSeq, i), "expected a sequence");
+    if (!pItem)
+    {
+      (*batchpyinst_).print_error();
+      dolfin::error("In PythonPeriodicMap::map_batch_ evaluating values");
+    }
+    const std::size_t valdim = PySequence_Fast_GET_SIZE(pItem);
+    ys[i].resize(xs[i].size(), 0.0);
+    for (std::size_t j = 0; j < std::min(valdim, ys[i].size()); j++)
+    {
+      ys[i][j] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(pItem, j));
+    }
+    Py_DECREF(pItem);
+  }
+
+  if (PyErr_Occurred()){                                             // check for errors in conversion
+    (*batchpyinst_).print_error();
+    dolfin::error("In PythonPeriodicMap::map_batch_ evaluating values");
+  }
+
+  Py_DECREF(pSeq);
+  Py_DECREF(pResult);
+  Py_DECREF(pArgs);
+}
+
+//*******************************************************************|************************************************************//
+// return the name of the on-disk pairing cache for this mesh (hashed across all processes), map and boundary ids on this process
+// (empty if caching is disabled through TF_CACHE_DIR)
+//*******************************************************************|************************************************************//
+const std::string PythonPeriodicMap::cache_filename_(const dolfin::Mesh &mesh,
+                                                     const std::vector<std::size_t> &masterids,
+                                                     const std::vector<std::size_t> &slaveids) const
+{
+  std::size_t key = mesh.hash();                                     // collective
+  boost::hash_combine(key, pyinst_.function());
+  boost::hash_combine(key, masterids);
+  boost::hash_combine(key, slaveids);
+
+  std::string cachedir;
+  const char* envdir = std::getenv("TF_CACHE_DIR");
+  if (envdir)
+  {
+    cachedir = envdir;
+    std::string lower(cachedir);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (cachedir.empty() || lower == "none")
+    {
+      return "";
+    }
+  }
+  else
+  {
+    const char* xdgdir = std::getenv("XDG_CACHE_HOME");
+    const char* homedir = std::getenv("HOME");
+    if (xdgdir)
+    {
+      cachedir = std::string(xdgdir) + "/terraferma";
+    }
+    else if (homedir)
+    {
+      cachedir = std::string(homedir) + "/.cache/terraferma";
+    }
+    else
+    {
+      return "";
+    }
+  }
+  cachedir += "/periodic";
+
+  for (std::size_t pos = cachedir.find('/', 1); ; pos = cachedir.find('/', pos+1))
+  {                                                                  // make the directory (and its parents) if necessary
+    mkdir(cachedir.substr(0, pos).c_str(), 0755);
+    if (pos == std::string::npos)
+    {
+      break;
+    }
+  }
+
+  std::stringstream buffer;
+  buffer.str(""); buffer << cachedir << "/" << std::hex << key << std::dec << "_" 
+                         << dolfin::MPI::size(mesh.mpi_comm()) << "_" 
+                         << dolfin::MPI::rank(mesh.mpi_comm()) << ".bin";
+  return buffer.str();
+}
+
+//*******************************************************************|************************************************************//
+// read the slave to master coordinate pairs from disk, returning true if successful
+//*******************************************************************|************************************************************//
+const bool PythonPeriodicMap::read_cache_(const std::string &filename)
+{
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+
+  std::size_t npairs, dim;
+  file.read(reinterpret_cast<char*>(&npairs), sizeof(npairs));
+  file.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+  std::vector<double> x(dim), y(dim);
+  std::map< std::vector<double>, std::vector<double> > pairs;
+  for (std::size_t i = 0; file && i < npairs; i++)
+  {
+    file.read(reinterpret_cast<char*>(x.data()), dim*sizeof(double));
+    file.read(reinterpret_cast<char*>(y.data()), dim*sizeof(double));
+    pairs[x] = y;
+  }
+  if (!file)                                                         // truncated or unreadable so ignore it
+  {
+    return false;
+  }
+
+  pairs_.swap(pairs);
+  return true;
+}
+
+//*******************************************************************|************************************************************//
+// write the slave to master coordinate pairs to disk (via a temporary file so that concurrent runs never see a partial cache)
+//*******************************************************************|************************************************************//
+void PythonPeriodicMap::write_cache_(const std::string &filename) const
+{
+  std::stringstream buffer;
+  buffer.str(""); buffer << filename << "." << getpid() << ".tmp";
+  std::ofstream file(buffer.str().c_str(), std::ios::binary);
+  if (!file)
+  {
+    log(WARNING, "Unable to write periodic pairing cache %s", filename.c_str());
+    return;
+  }
+
+  const std::size_t npairs = pairs_.size();
+  const std::size_t dim = npairs > 0 ? (*pairs_.begin()).first.size() : 0;
+  file.write(reinterpret_cast<const char*>(&npairs), sizeof(npairs));
+  file.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+  for (std::map< std::vector<double>, std::vector<double> >::const_iterator p = pairs_.begin(); 
+                                                                            p != pairs_.end(); p++)
+  {
+    file.write(reinterpret_cast<const char*>((*p).first.data()), dim*sizeof(double));
+    file.write(reinterpret_cast<const char*>((*p).second.data()), dim*sizeof(double));
+  }
+  file.close();
+
+  if (!file || std::rename(buffer.str().c_str(), filename.c_str()) != 0)
+  {
+    log(WARNING, "Unable to write periodic pairing cache %s", filename.c_str());
+    std::remove(buffer.str().c_str());
+  }
+}
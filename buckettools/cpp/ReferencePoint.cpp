@@ -24,57 +24,21 @@
 #include <dolfin.h>
 #include <string>
 #include <limits>
+#include <sstream>
 
 using namespace buckettools;
 
 //*******************************************************************|************************************************************//
-// specific constructor
+// specific constructor (from an already located dof point)
 //*******************************************************************|************************************************************//
-ReferencePoint::ReferencePoint(const std::vector<double> &coord, const FunctionSpace_ptr functionspace,
-                                       const GenericFunction_ptr value) :
-                                       dolfin::DirichletBC(functionspace, value, subdomain_(coord, functionspace),
-                                                           "pointwise")
+ReferencePoint::ReferencePoint(const std::vector<double> &point, const std::size_t &dof, 
+                               const FunctionSpace_ptr functionspace, const GenericFunction_ptr value) :
+                                       dolfin::DirichletBC(functionspace, value, 
+                                                           SubDomain_ptr(new ReferencePointSubDomain(point)),
+                                                           "pointwise"),
+                                       point_(point), localdof_(-1)
 {
-  // perform a check that dolfin::DirichetBC finds the reference point too...
-  std::unordered_map<std::size_t, double> boundary_values;
-  get_boundary_values(boundary_values);
-  std::vector<std::size_t> dofs;
-  for (std::unordered_map<std::size_t, double>::const_iterator bv = boundary_values.begin();
-                                                               bv != boundary_values.end();
-                                                               bv++)
-  {
-    dofs.push_back((*(*functionspace).dofmap()).local_to_global_index((*bv).first));
-  }
-  std::vector<std::vector<std::size_t> > all_dofs;
-  dolfin::MPI::all_gather((*(*functionspace).mesh()).mpi_comm(), dofs, all_dofs);
-  std::set<std::size_t> unique_dofs;
-  for (std::vector<std::vector<std::size_t> >::const_iterator ds = all_dofs.begin();
-                                                              ds != all_dofs.end();
-                                                              ds++)
-  {
-    for (std::vector<std::size_t>::const_iterator d = (*ds).begin(); d != (*ds).end(); d++)
-    {
-      unique_dofs.insert(*d);
-    }
-  }
-
-  if (unique_dofs.size()!=1)
-  {
-    std::stringstream buffer;
-    buffer.str("");
-    for (std::vector<double>::const_iterator c = coord.begin(); c != coord.end(); c++)
-    {
-      buffer << *c << " ";
-    }
-    if (unique_dofs.size()==0)
-    {
-      tf_err("ReferencePoint::get_boundary_values failed to find any dofs.", "coord = %s", buffer.str().c_str());
-    }
-    else if (unique_dofs.size()>1)
-    {
-      log(WARNING, "Warning: ReferencePoint::get_boundary_values found multiple dofs at coord = %s", buffer.str().c_str());
-    }
-  }
+  initialize_(dof);
 }
 
 //*******************************************************************|************************************************************//
@@ -86,41 +50,101 @@ ReferencePoint::~ReferencePoint()
 }
 
 //*******************************************************************|************************************************************//
-// intialize a reference point from a (boost shared) pointer to a dolfin array
+// create a batch of reference points, locating all of them in a single pass with a single collective
 //*******************************************************************|************************************************************//
-SubDomain_ptr ReferencePoint::subdomain_(const std::vector<double> &coord, const FunctionSpace_ptr functionspace)
+std::vector<ReferencePoint_ptr> ReferencePoint::create(const std::vector< std::vector<double> > &coords,
+                                                       const std::vector< FunctionSpace_ptr > &functionspaces,
+                                                       const std::vector< GenericFunction_ptr > &values)
 {
+  assert(coords.size()==functionspaces.size());
+  assert(coords.size()==values.size());
 
-  const uint num_sub_elements = (*(*functionspace).element()).num_sub_elements();
-  if (num_sub_elements>0)
+  std::vector<ReferencePoint_ptr> referencepoints;
+  if (coords.size()==0)
   {
-    tf_err("ReferencePoint::subdomain_ called with non-scalar functionspace.", "num_sub_elements = %d", num_sub_elements);
-                                                                     // make sure we're only going to find one point
-  }                                                                  // shouldn't actually get here (because of how we call this
-                                                                     // constructor from TF)
+    return referencepoints;
+  }
 
-  const dolfin::Mesh& mesh = *(*functionspace).mesh();
+  std::vector< std::vector<double> > points;
+  std::vector< std::size_t > dofs;
+  locate_(coords, functionspaces, points, dofs);
 
-  const std::size_t gdim = mesh.geometry().dim();
+  for (uint i = 0; i < coords.size(); i++)
+  {
+    referencepoints.push_back(ReferencePoint_ptr(new ReferencePoint(points[i], dofs[i], 
+                                                                    functionspaces[i], values[i])));
+  }
+
+  return referencepoints;
+}
 
-  const double* pos = coord.data();
-  const std::size_t dim = coord.size();
-  assert(dim==gdim);
-  const dolfin::Point dcoord(dim, pos);
-  int cellid;
-  std::vector<unsigned int> cellids = (*mesh.bounding_box_tree()).compute_entity_collisions(dcoord);
-  if (cellids.size()==0)
+//*******************************************************************|************************************************************//
+// set the reference value directly in the vector b
+//*******************************************************************|************************************************************//
+void ReferencePoint::apply_point(dolfin::GenericVector &b) const
+{
+  if (localdof_ >= 0)
   {
-    cellid = -1;
+    const double value = value_();
+    b.set_local(&value, 1, &localdof_);
   }
-  else
+  b.apply("insert");
+}
+
+//*******************************************************************|************************************************************//
+// set the reference residual (x - value) directly in the vector b
+//*******************************************************************|************************************************************//
+void ReferencePoint::apply_point(dolfin::GenericVector &b, const dolfin::GenericVector &x) const
+{
+  if (localdof_ >= 0)
   {
-    cellid = cellids[0];
+    double value;
+    x.get_local(&value, 1, &localdof_);
+    value -= value_();
+    b.set_local(&value, 1, &localdof_);
   }
+  b.apply("insert");
+}
+
+//*******************************************************************|************************************************************//
+// locate the nearest dof points to a batch of coordinates, each process searching its own cells before a single all_gather of
+// the candidates (distance, global dof and dof coordinates per point) selects the nearest
+//*******************************************************************|************************************************************//
+void ReferencePoint::locate_(const std::vector< std::vector<double> > &coords,
+                             const std::vector< FunctionSpace_ptr > &functionspaces,
+                             std::vector< std::vector<double> > &points,
+                             std::vector< std::size_t > &dofs)
+{
+  const dolfin::Mesh& mesh = *(*functionspaces[0]).mesh();           // all the points are assumed to be on the same mesh
+  const std::size_t gdim = mesh.geometry().dim();
+  const std::size_t stride = gdim + 2;
 
-  std::vector<double> point;
-  if (cellid >= 0)
+  std::vector<double> candidates(coords.size()*stride, -1.0);        // distance (-1 if not found), global dof, coordinates
+  for (uint p = 0; p < coords.size(); p++)
   {
+    const FunctionSpace_ptr functionspace = functionspaces[p];
+    const std::vector<double> &coord = coords[p];
+
+    const uint num_sub_elements = (*(*functionspace).element()).num_sub_elements();
+    if (num_sub_elements>0)
+    {
+      tf_err("ReferencePoint::locate_ called with non-scalar functionspace.", "num_sub_elements = %d", num_sub_elements);
+                                                                     // make sure we're only going to find one point
+    }                                                                // shouldn't actually get here (because of how we call this
+                                                                     // from TF)
+    if (coord.size()!=gdim)
+    {
+      tf_err("ReferencePoint coordinates do not match mesh dimension.", "coord size = %d, gdim = %d", coord.size(), gdim);
+    }
+
+    const dolfin::Point dcoord(gdim, coord.data());
+    std::vector<unsigned int> cellids = (*mesh.bounding_box_tree()).compute_entity_collisions(dcoord);
+    if (cellids.size()==0)
+    {
+      continue;
+    }
+    const int cellid = cellids[0];
+
     const dolfin::GenericDofMap& dofmap = *(*functionspace).dofmap();
     std::shared_ptr<const dolfin::FiniteElement> element = (*functionspace).element();
 
@@ -131,12 +155,7 @@ SubDomain_ptr ReferencePoint::subdomain_(const std::vector<double> &coord, const
     cell.get_coordinate_dofs(dof_coordinates);
     (*element).tabulate_dof_coordinates(coordinates, dof_coordinates, cell);
 
-    dolfin::ArrayView<const dolfin::la_index> tmp_cell_dofs = dofmap.cell_dofs(cellid);
-    std::vector<dolfin::la_index> cell_dofs;
-    for (std::size_t i = 0; i < tmp_cell_dofs.size(); i++)
-    {
-      cell_dofs.push_back(dofmap.local_to_global_index(tmp_cell_dofs[i]));
-    }
+    dolfin::ArrayView<const dolfin::la_index> cell_dofs = dofmap.cell_dofs(cellid);
 
     std::vector<double> dist(dofmap.cell_dimension(cellid), 0.0);
     for (uint i = 0; i < dofmap.cell_dimension(cellid); ++i)
@@ -148,35 +167,105 @@ SubDomain_ptr ReferencePoint::subdomain_(const std::vector<double> &coord, const
     }
 
     const uint i = std::distance(&dist[0], std::min_element(&dist[0], &dist[dist.size()]));
+    candidates[p*stride]   = dist[i];
+    candidates[p*stride+1] = dofmap.local_to_global_index(cell_dofs[i]);
     for (uint j = 0; j < gdim; ++j)
     {
-      point.push_back(coordinates[i][j]);
+      candidates[p*stride+2+j] = coordinates[i][j];
     }
   }
 
-  std::size_t num_processes = dolfin::MPI::size(mesh.mpi_comm());
-
-  std::vector<std::vector<double> > points;
-  dolfin::MPI::all_gather(mesh.mpi_comm(), point, points);
-  assert(points.size()==num_processes);
+  std::vector<std::vector<double> > allcandidates;
+  dolfin::MPI::all_gather(mesh.mpi_comm(), candidates, allcandidates);
 
-  SubDomain_ptr subdomain = NULL;
-  for (uint p = 0; p < num_processes; p++)
+  points.resize(coords.size());
+  dofs.resize(coords.size());
+  for (uint p = 0; p < coords.size(); p++)
   {
-    if (points[p].size() > 0)
+    int nearest = -1;                                                // process with the nearest candidate (lowest rank on ties)
+    for (uint q = 0; q < allcandidates.size(); q++)
     {
-      subdomain.reset(new ReferencePointSubDomain(points[p]));
-      break;
+      const double dist = allcandidates[q][p*stride];
+      if ((dist >= 0.0) && ((nearest < 0) || (dist < allcandidates[nearest][p*stride])))
+      {
+        nearest = q;
+      }
     }
+
+    if (nearest < 0)
+    {
+      std::stringstream buffer;
+      buffer.str("");
+      for (std::vector<double>::const_iterator c = coords[p].begin(); c != coords[p].end(); c++)
+      {
+        buffer << *c << " ";
+      }
+      tf_err("Failed to find reference point near requested coordinates.", "coord = %s", buffer.str().c_str());
+    }
+
+    dofs[p] = std::size_t(allcandidates[nearest][p*stride+1]);
+    points[p].assign(allcandidates[nearest].begin() + p*stride + 2, 
+                     allcandidates[nearest].begin() + (p+1)*stride);
   }
 
-  if (!subdomain)
+}
+
+//*******************************************************************|************************************************************//
+// check that dolfin::DirichletBC finds the located dof and record its local index if it is owned by this process
+//*******************************************************************|************************************************************//
+void ReferencePoint::initialize_(const std::size_t &dof)
+{
+  const dolfin::GenericDofMap& dofmap = *(*function_space()).dofmap();
+  const std::pair<std::size_t, std::size_t> range = dofmap.ownership_range();
+  const bool owned = (dof >= range.first) && (dof < range.second);
+
+  std::unordered_map<std::size_t, double> boundary_values;           // this also primes the dolfin::DirichletBC cache of cells
+  get_boundary_values(boundary_values);                              // so that later matrix applications are cheap
+  std::size_t nextra = 0;
+  for (std::unordered_map<std::size_t, double>::const_iterator bv = boundary_values.begin();
+                                                               bv != boundary_values.end();
+                                                               bv++)
   {
-    tf_err("Failed to find reference point near requested coordinates.", "cellid = %d", cellid);
+    if (dofmap.local_to_global_index((*bv).first)==dof)
+    {
+      if (owned)
+      {
+        localdof_ = (*bv).first;
+      }
+    }
+    else
+    {
+      nextra++;
+    }
   }
 
-  return subdomain;
+  std::stringstream buffer;
+  buffer.str("");
+  for (std::vector<double>::const_iterator c = point_.begin(); c != point_.end(); c++)
+  {
+    buffer << *c << " ";
+  }
+  if (owned && (localdof_ < 0))
+  {
+    tf_err("ReferencePoint::get_boundary_values failed to find the owned dof.", "point = %s", buffer.str().c_str());
+  }
+  if (nextra > 0)
+  {
+    log(WARNING, "Warning: ReferencePoint::get_boundary_values found multiple dofs at point = %s", buffer.str().c_str());
+  }
+}
 
+//*******************************************************************|************************************************************//
+// evaluate the reference value at the reference point
+//*******************************************************************|************************************************************//
+double ReferencePoint::value_() const
+{
+  double refvalue = 0.0;
+  dolfin::Array<double> values(1, &refvalue);
+  std::vector<double> point(point_);
+  const dolfin::Array<double> x(point.size(), point.data());
+  (*value()).eval(values, x);
+  return refvalue;
 }
 
 ReferencePointSubDomain::ReferencePointSubDomain(const std::vector<double> &point, const double &tolerance) :
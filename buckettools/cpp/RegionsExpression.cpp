@@ -37,7 +37,7 @@ RegionsExpression::RegionsExpression(std::map< std::size_t,
                                             expressions_(expressions),
                                             cell_ids_(cell_ids)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -51,7 +51,7 @@ RegionsExpression::RegionsExpression(const uint &dim,
                                      expressions_(expressions),
                                      cell_ids_(cell_ids)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -65,7 +65,7 @@ RegionsExpression::RegionsExpression(const uint &dim0, const uint &dim1,
                                      expressions_(expressions),
                                      cell_ids_(cell_ids)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -80,7 +80,7 @@ RegionsExpression::RegionsExpression(const std::vector<std::size_t>
                                      expressions_(expressions),
                                      cell_ids_(cell_ids)
 {
-                                                                     // do nothing
+  init_();
 }
 
 //*******************************************************************|************************************************************//
@@ -99,15 +99,28 @@ void RegionsExpression::eval(dolfin::Array<double>& values,
                                       const dolfin::Array<double>& x, 
                                       const ufc::cell &cell) const
 {
-  uint id = (*cell_ids_)[cell.index];
-  size_t_Expression_const_it e_it = expressions_.find(id);
-  if (e_it == expressions_.end())
+  const std::size_t id = (*cell_ids_)[cell.index];
+  if (id >= dispatch_.size() || !dispatch_[id])
   {
     tf_err("Unknown region id in RegionsExpression eval.", "Region id: %d", id);
   }
-  else
+  (*dispatch_[id]).eval(values, x, cell);
+}
+
+//*******************************************************************|************************************************************//
+// flatten the map of expressions into a vector indexed by region id
+//*******************************************************************|************************************************************//
+void RegionsExpression::init_()
+{
+  dispatch_.clear();
+  if (expressions_.empty())
+  {
+    return;
+  }
+  dispatch_.resize((*expressions_.rbegin()).first + 1, NULL);        // the map is ordered so the last key is the largest id
+  for (size_t_Expression_const_it e_it = expressions_.begin(); 
+                                  e_it != expressions_.end(); e_it++)
   {
-    (*(*e_it).second).eval(values, x, cell);
+    dispatch_[(*e_it).first] = (*e_it).second.get();
   }
 }
-
@@ -24,6 +24,7 @@
 #include "SystemBucket.h"
 #include "Bucket.h"
 #include "Logger.h"
+#include "ThreadedAssembler.h"
 #include <dolfin.h>
 #include <string>
 #include <signal.h>
@@ -125,14 +126,10 @@ void SolverBucket::solve()
 
   if (type()=="SNES")                                                // this is a petsc snes solver - FIXME: switch to an enumerated type
   {                                                                  // loop over the collected vector of system bcs
-    for(std::vector< std::shared_ptr<const dolfin::DirichletBC> >::const_iterator    
-                      bc = (*system_).bcs_begin(); 
-                      bc != (*system_).bcs_end(); bc++)
-    {
-      (*(*bc)).apply(*(*(*system_).function()).vector());            // apply the bcs to the solution and
-      (*(*bc)).apply(*(*(*system_).iteratedfunction()).vector());    // iterated solution
-    }
+    (*system_).apply_bcs(*(*(*system_).function()).vector());        // apply the bcs to the solution and
+    (*system_).apply_bcs(*(*(*system_).iteratedfunction()).vector());// iterated solution
     *work_ = (*(*(*system_).function()).vector());                   // set the work vector to the function vector
+    jacobianreused_ = false;                                         // nothing has been reused in this solve yet
     perr = SNESSolve(snes_, PETSC_NULL, (*work_).vec());             // call petsc to perform a snes solve
     petsc_fail(perr);
     snes_check_convergence_();
@@ -170,14 +167,10 @@ void SolverBucket::solve()
 
     assert(residual_);                                               // we need to assemble the residual again here as it may depend
                                                                      // on other systems that have been solved since the last call
-    dolfin::Assembler assemblerres;
+    ThreadedAssembler assemblerres;
     assemblerres.assemble(*res_, *residual_);                        // assemble the residual
-    for(std::vector< std::shared_ptr<const dolfin::DirichletBC> >::const_iterator bc = 
-                          (*system_).bcs_begin(); 
-                          bc != (*system_).bcs_end(); bc++)
-    {                                                                // apply bcs to residuall (should we do this?!)
-      (*(*bc)).apply(*res_, (*(*(*system_).iteratedfunction()).vector()));
-    }
+    (*system_).apply_bcs(*res_,                                      // apply bcs to residuall (should we do this?!)
+                         (*(*(*system_).iteratedfunction()).vector()));
 
     double aerror = (*res_).norm("l2");                              // work out the initial absolute l2 error (this should be
                                                                      // initialized to the right value on the first pass and still
@@ -198,18 +191,22 @@ void SolverBucket::solve()
     log(INFO, "  %u Picard Residual Norm (absolute, relative) = %g, %g\n", 
                                     iteration_count(), aerror, rerror);
 
-    if(*visualizationmonitor_ || convfile_)
+    if(*visualizationmonitor_ || (convfile_ && !(*convfile_).norms_only()))
     {
       *(*(*system()).residualfunction()).vector() = (*std::dynamic_pointer_cast< dolfin::GenericVector >(residual_vector()));
       if (*visualizationmonitor_)
       {
         (*pvdfile).write(functions, *visfuncspace, (double) iteration_count());
       }
-      if (convfile_)
+      if (convfile_ && !(*convfile_).norms_only())
       {
         (*convfile_).write_data();
       }
     }
+    if (convfile_ && (*convfile_).norms_only())                      // the norms don't need the residual to be copied
+    {
+      (*convfile_).write_norms((*(*(*system_).iteratedfunction()).vector()).norm("l2"), aerror);
+    }
 
 
     (*(*(*system_).iteratedfunction()).vector()) =                   // system iterated function gets set to the function values
@@ -278,10 +275,18 @@ void SolverBucket::solve()
           (*solvermatrix).ident_zeros();
         }
 
-        IS is = solverindexsets_[(*f_it).first];
         Mat submatrix = solversubmatrices_[(*f_it).first];
-        perr = MatGetSubMatrix((*solvermatrix).mat(), is, is, MAT_REUSE_MATRIX, &submatrix);
-        petsc_err(perr);
+        if(solvervirtual_submatrices_[(*f_it).first])
+        {                                                            // virtual submatrices already see the reassembled
+          perr = PetscObjectStateIncrease((PetscObject)submatrix);   // values so just make sure the pc knows they've changed
+          petsc_err(perr);
+        }
+        else
+        {
+          IS is = solverindexsets_[(*f_it).first];
+          perr = MatGetSubMatrix((*solvermatrix).mat(), is, is, MAT_REUSE_MATRIX, &submatrix);
+          petsc_err(perr);
+        }
 
       }
 
@@ -325,12 +330,8 @@ void SolverBucket::solve()
 
       assert(residual_);
       assemblerres.assemble(*res_, *residual_);                      // assemble the residual
-      for(std::vector< std::shared_ptr<const dolfin::DirichletBC> >::const_iterator bc = 
-                             (*system_).bcs_begin(); 
-                             bc != (*system_).bcs_end(); bc++)
-      {                                                              // apply bcs to residual (should we do this?!)
-        (*(*bc)).apply(*res_, (*(*(*system_).iteratedfunction()).vector()));
-      }
+      (*system_).apply_bcs(*res_,                                    // apply bcs to residual (should we do this?!)
+                           (*(*(*system_).iteratedfunction()).vector()));
 
       aerror = (*res_).norm("l2");                                   // work out absolute error
       rerror = aerror/aerror0;                                       // and relative error
@@ -338,18 +339,22 @@ void SolverBucket::solve()
                           iteration_count(), aerror, rerror);
                                                                      // and decide to loop or not...
 
-      if(*visualizationmonitor_ || convfile_)
+      if(*visualizationmonitor_ || (convfile_ && !(*convfile_).norms_only()))
       {
         *(*(*system()).residualfunction()).vector() = (*std::dynamic_pointer_cast< dolfin::GenericVector >(residual_vector()));
         if (*visualizationmonitor_)
         {
           (*pvdfile).write(functions, *visfuncspace, (double) iteration_count());
         }
-        if (convfile_)
+        if (convfile_ && !(*convfile_).norms_only())
         {
           (*convfile_).write_data();
         }
       }
+      if (convfile_ && (*convfile_).norms_only())                    // the norms don't need the residual to be copied
+      {
+        (*convfile_).write_norms((*(*(*system_).iteratedfunction()).vector()).norm("l2"), aerror);
+      }
 
     }
 
@@ -358,7 +363,11 @@ void SolverBucket::solve()
       log(WARNING, "it = %d, maxits_ = %d", iteration_count(), maxits_);
       log(WARNING, "rerror = %.12e, rtol_ = %.12e", rerror, rtol_);
       log(WARNING, "aerror = %.12e, atol_ = %.12e", aerror, atol_);
-      if (ignore_failures_)
+      if ((*(*system_).bucket()).retry_failure())
+      {
+        log(WARNING, "Retrying timestep: Picard failure. Solver: %s::%s.", (*system_).name().c_str(), name().c_str());
+      }
+      else if (ignore_failures_)
       {
         log(WARNING, "Ignoring: Picard failure. Solver: %s::%s.", (*system_).name().c_str(), name().c_str());
       }
@@ -390,15 +399,11 @@ void SolverBucket::solve()
 double SolverBucket::residual_norm()
 {
   assert(residual_);
-  dolfin::Assembler assembler;
+  ThreadedAssembler assembler;
 
   assembler.assemble(*res_, *residual_);
-  for(std::vector< std::shared_ptr<const dolfin::DirichletBC> >::const_iterator bc = 
-                        (*system_).bcs_begin(); 
-                        bc != (*system_).bcs_end(); bc++)
-  {                                                                  // apply bcs to residual (should we do this?!)
-    (*(*bc)).apply(*res_, (*(*(*system_).iteratedfunction()).vector()));
-  }
+  (*system_).apply_bcs(*res_,                                        // apply bcs to residual (should we do this?!)
+                       (*(*(*system_).iteratedfunction()).vector()));
 
   double norm  = (*res_).norm("l2");
   return norm;
@@ -439,6 +444,39 @@ void SolverBucket::initialize_diagnostics() const                    // doesn't
   }
 }
 
+//*******************************************************************|************************************************************//
+// close any diagnostic output from the solver and reopen it under the current output base name (e.g. for a new ensemble member)
+//*******************************************************************|************************************************************//
+void SolverBucket::reopen_diagnostics()
+{
+  std::stringstream buffer;
+  if (convfile_)
+  {
+    const bool normsonly = (*convfile_).norms_only();
+    (*convfile_).close();
+    buffer.str(""); buffer << (*(*system()).bucket()).output_basename() << "_" 
+                           << (*system()).name() << "_" 
+                           << name() << (type()=="SNES" ? "_snes.conv" : "_picard.conv");
+    convfile_.reset( new ConvergenceFile(buffer.str(), 
+                                  (*(*system_).mesh()).mpi_comm(), 
+                                  &(*(*system()).bucket()), (*system()).name(), name(), 
+                                  normsonly) );
+  }
+  if (kspconvfile_)
+  {
+    const bool normsonly = (*kspconvfile_).norms_only();
+    (*kspconvfile_).close();
+    buffer.str(""); buffer << (*(*system()).bucket()).output_basename() << "_" 
+                           << (*system()).name() << "_" 
+                           << name() << "_ksp.conv";
+    kspconvfile_.reset( new KSPConvergenceFile(buffer.str(), 
+                                  (*(*system_).mesh()).mpi_comm(), 
+                                  &(*(*system()).bucket()), (*system()).name(), name(), 
+                                  normsonly) );
+  }
+  initialize_diagnostics();
+}
+
 //*******************************************************************|************************************************************//
 // create a null space object
 //*******************************************************************|************************************************************//
@@ -480,6 +518,59 @@ void SolverBucket::iteration_count(const int &it)
   *iteration_count_ = it;
 }
 
+//*******************************************************************|************************************************************//
+// decide if the jacobian assembled at a previous iteration can be reused at this iteration according to the reuse policy, given the
+// norm of the current residual
+//*******************************************************************|************************************************************//
+const bool SolverBucket::reuse_jacobian(const int &iteration, const double &fnorm)
+{
+  const int timestep_count = (*(*system_).bucket()).timestep_count();
+  bool reuse = jacobianassembled_;                                   // nothing to reuse before the first assembly
+
+  if (reuse)
+  {
+    switch (jacobianreuse_)
+    {
+      case JACOBIAN_REUSE_ITERATIONS:                                // every jacobianlag_ iterations (always at the start of a solve)
+        reuse = (iteration%jacobianlag_) != 0;
+        break;
+      case JACOBIAN_REUSE_TIMESTEPS:                                 // only reassemble at the start of a solve every jacobianlag_
+        reuse = (iteration > 0) ||                                   // timesteps
+                ((timestep_count - jacobiantimestep_) < jacobianlag_);
+        break;
+      case JACOBIAN_REUSE_ADAPTIVE:                                  // reassemble when the convergence rate deteriorates
+        reuse = (iteration == 0) || 
+                (fnorm < jacobianthreshold_*jacobianfnorm_);
+        break;
+      default:
+        reuse = false;
+    }
+  }
+
+  if (reuse && (iteration > 0) && (fnorm >= jacobianfnorm_))         // never keep a jacobian that failed to reduce the residual
+  {
+    reuse = false;
+  }
+
+  if (!reuse)
+  {
+    jacobianassembled_ = true;
+    jacobiantimestep_ = timestep_count;
+  }
+  jacobianfnorm_ = fnorm;
+  jacobianreused_ = reuse;
+
+  return reuse;
+}
+
+//*******************************************************************|************************************************************//
+// force the jacobian to be reassembled at the next iteration regardless of the reuse policy (e.g. after a timestep is rolled back)
+//*******************************************************************|************************************************************//
+void SolverBucket::discard_jacobian()
+{
+  jacobianassembled_ = false;
+}
+
 //*******************************************************************|************************************************************//
 // return true if we're using a visualization monitor
 //*******************************************************************|************************************************************//
@@ -689,6 +780,24 @@ bool SolverBucket::solverident_zeros(const std::string &name)
   }
 }
 
+//*******************************************************************|************************************************************//
+// return a bool indicating if the named solver submatrix is a virtual view of its solver matrix (rather than a copy)
+//*******************************************************************|************************************************************//
+bool SolverBucket::solvervirtual_submatrix(const std::string &name)
+{
+  std::map< std::string, bool >::iterator s_it = 
+                               solvervirtual_submatrices_.find(name);// check if this name already exists
+  if (s_it == solvervirtual_submatrices_.end())
+  {
+    tf_err("Solver virtual submatrix does not exist in solver.", "Solver virtual submatrix name: %s, SolverBucket name: %s, SystemBucket name: %s",
+           name.c_str(), name_.c_str(), (*system_).name().c_str());
+  }
+  else
+  {
+    return (*s_it).second;                                           // if it does, return it
+  }
+}
+
 //*******************************************************************|************************************************************//
 // return a (boost shared) pointer to a petsc matrix from the solver bucket data maps
 //*******************************************************************|************************************************************//
@@ -720,6 +829,70 @@ const std::string SolverBucket::str(int indent) const
   return s.str();
 }
 
+//*******************************************************************|************************************************************//
+// return a string describing the (global) memory footprint of the vectors and matrices in the solver bucket
+//*******************************************************************|************************************************************//
+const std::string SolverBucket::memory_str(const int &indent) const
+{
+  std::stringstream s;
+  std::string indentation (indent*2, ' ');
+  PetscErrorCode perr;
+
+  std::vector< PETScVector_ptr > vectors;
+  vectors.push_back(rhs_);
+  vectors.push_back(res_);
+  vectors.push_back(work_);
+
+  std::size_t nvectors = 0;
+  double vectormemory = 0.0;
+  for (std::vector< PETScVector_ptr >::const_iterator v_it = vectors.begin(); v_it != vectors.end(); v_it++)
+  {
+    if (*v_it)
+    {
+      nvectors++;
+      vectormemory += (double)(**v_it).size()*sizeof(PetscScalar);
+    }
+  }
+
+  std::vector< Mat > matrices;
+  if (matrix_ && !matrixfree_)                                       // matrix free jacobians have no storage to report
+  {
+    matrices.push_back((*matrix_).mat());
+  }
+  if (matrixpc_)
+  {
+    matrices.push_back((*matrixpc_).mat());
+  }
+  for (std::map< std::string, PETScMatrix_ptr >::const_iterator m_it = solvermatrices_.begin(); 
+                                                                m_it != solvermatrices_.end(); m_it++)
+  {
+    matrices.push_back((*(*m_it).second).mat());
+  }
+  for (std::map< std::string, Mat >::const_iterator m_it = solversubmatrices_.begin(); 
+                                                    m_it != solversubmatrices_.end(); m_it++)
+  {
+    std::map< std::string, bool >::const_iterator v_it = solvervirtual_submatrices_.find((*m_it).first);
+    if (v_it == solvervirtual_submatrices_.end() || !(*v_it).second)// virtual submatrices share the storage of their parent
+    {
+      matrices.push_back((*m_it).second);
+    }
+  }
+
+  double matrixmemory = 0.0;
+  for (std::vector< Mat >::const_iterator m_it = matrices.begin(); m_it != matrices.end(); m_it++)
+  {
+    MatInfo info;
+    perr = MatGetInfo(*m_it, MAT_GLOBAL_SUM, &info);
+    petsc_err(perr);
+    matrixmemory += info.memory;
+  }
+
+  s << indentation << "SolverBucket " << name() << ": " 
+                   << nvectors << " vectors, " << vectormemory/1048576.0 << " MB; "
+                   << matrices.size() << " matrices, " << matrixmemory/1048576.0 << " MB" << std::endl;
+  return s.str();
+}
+
 //*******************************************************************|************************************************************//
 // return a string describing the forms in the solver bucket
 //*******************************************************************|************************************************************//
@@ -762,7 +935,11 @@ void SolverBucket::snes_check_convergence_()
                               sneslsiterations);
   if (snesreason<0)
   {
-    if (ignore_failures_)
+    if ((*(*system_).bucket()).retry_failure())
+    {
+      log(WARNING, "Retrying timestep: SNES failure. Solver: %s::%s, SNESConvergedReason %d.", (*system_).name().c_str(), name().c_str(), snesreason);
+    }
+    else if (ignore_failures_)
     {
       log(WARNING, "Ignoring: SNES failure. Solver: %s::%s, SNESConvergedReason %d.", (*system_).name().c_str(), name().c_str(), snesreason);
     }
@@ -802,7 +979,11 @@ void SolverBucket::ksp_check_convergence_(KSP &ksp, int indent)
                               indentation.c_str(), kspiterations);
   if (indent==0 && kspreason<0)
   {
-    if (ignore_failures_)
+    if ((*(*system_).bucket()).retry_failure())
+    {
+      log(WARNING, "Retrying timestep: KSP failure. Solver: %s::%s, KSPConvergedReason %d.", (*system_).name().c_str(), name().c_str(), kspreason);
+    }
+    else if (ignore_failures_)
     {
       log(WARNING, "Ignoring: KSP failure. Solver: %s::%s, KSPConvergedReason %d.", (*system_).name().c_str(), name().c_str(), kspreason);
     }
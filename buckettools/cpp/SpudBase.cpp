@@ -87,3 +87,53 @@ void buckettools::spud_error(const std::string &optionpath,
   }
 
 }
+
+//*******************************************************************|************************************************************//
+// return true if the relative optionpath name exists anywhere beneath (or directly below) the given optionpath
+//*******************************************************************|************************************************************//
+const bool buckettools::spud_have_descendant(const std::string &optionpath, const std::string &name)
+{
+  if (Spud::have_option(optionpath+"/"+name))
+  {
+    return true;
+  }
+
+  Spud::OptionError serr;
+  int nchildren = Spud::number_of_children(optionpath);
+  for (uint i = 0; i < nchildren; i++)
+  {
+    std::string child;
+    serr = Spud::get_child_name(optionpath, i, child);
+    spud_err(optionpath, serr);
+    if (spud_have_descendant(optionpath+"/"+child, name))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//*******************************************************************|************************************************************//
+// return the number of times the relative optionpath name exists anywhere beneath (or directly below) the given optionpath
+//*******************************************************************|************************************************************//
+const int buckettools::spud_count_descendants(const std::string &optionpath, const std::string &name)
+{
+  int count = 0;
+  if (Spud::have_option(optionpath+"/"+name))
+  {
+    count++;
+  }
+
+  Spud::OptionError serr;
+  int nchildren = Spud::number_of_children(optionpath);
+  for (uint i = 0; i < nchildren; i++)
+  {
+    std::string child;
+    serr = Spud::get_child_name(optionpath, i, child);
+    spud_err(optionpath, serr);
+    count += spud_count_descendants(optionpath+"/"+child, name);
+  }
+
+  return count;
+}
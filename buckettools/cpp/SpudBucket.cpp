@@ -30,6 +30,10 @@
 #include "StatisticsFile.h"
 #include "VisualizationWrapper.h"
 #include "Logger.h"
+#include "ThreadedAssembler.h"
+#include "SignalHandler.h"
+#include "TerminateEventHandler.h"
+#include "MPIBase.h"
 #include <dolfin.h>
 #include <dolfin/mesh/MeshPartitioning.h>
 #include <spud>
@@ -39,7 +43,7 @@ using namespace buckettools;
 //*******************************************************************|************************************************************//
 // default constructor
 //*******************************************************************|************************************************************//
-SpudBucket::SpudBucket() : Bucket()
+SpudBucket::SpudBucket() : Bucket(), rebalancecheckpoint_(0)
 {
                                                                      // do nothing
 }
@@ -47,7 +51,7 @@ SpudBucket::SpudBucket() : Bucket()
 //*******************************************************************|************************************************************//
 // specific constructor
 //*******************************************************************|************************************************************//
-SpudBucket::SpudBucket(const std::string &name) : Bucket(name)
+SpudBucket::SpudBucket(const std::string &name) : Bucket(name), rebalancecheckpoint_(0)
 {
                                                                      // do nothing
 }
@@ -56,7 +60,7 @@ SpudBucket::SpudBucket(const std::string &name) : Bucket(name)
 // specific constructor
 //*******************************************************************|************************************************************//
 SpudBucket::SpudBucket(const std::string &name, const std::string &optionpath) : 
-                                optionpath_(optionpath), Bucket(name)
+                                optionpath_(optionpath), Bucket(name), rebalancecheckpoint_(0)
 {
                                                                      // do nothing
 }
@@ -76,14 +80,17 @@ void SpudBucket::fill()
   std::stringstream buffer;                                          // optionpath buffer
   Spud::OptionError serr;                                            // spud error code
   
+  start_phase_("global parameters");
   fill_globalparameters_();
 
   buffer.str(""); buffer << optionpath() << "/geometry/dimension";   // geometry dimension set in the bucket to pass it down to all
   serr = Spud::get_option(buffer.str(), dimension_);                 // systems (we assume this is the length of things that do
   spud_err(buffer.str(), serr);                                      // not have them independently specified)
 
+  start_phase_("timestepping");
   fill_timestepping_();                                              // fill in the timestepping options (if there are any)
 
+  start_phase_("meshes");
   buffer.str(""); buffer << optionpath() << "/geometry/mesh";        // put the meshes into the bucket
   int nmeshes = Spud::option_count(buffer.str());
   for (uint i = 0; i<nmeshes; i++)                                   // loop over the meshes defined in the options file
@@ -93,9 +100,11 @@ void SpudBucket::fill()
     fill_meshes_(buffer.str());
   }
   
+  start_phase_("output");
   fill_output_();                                                    // fill in the output options (if there are any)
                                                                      // has to happen after fill_meshes_ as it outputs the mesh
 
+  start_phase_("ufl symbols");
   buffer.str(""); buffer << optionpath() << "/system";
   int nsystems = Spud::option_count(buffer.str());
   for (uint i = 0; i<nsystems; i++)                                  // loop over the systems registering the base uflsymbols of any
@@ -104,26 +113,37 @@ void SpudBucket::fill()
     fill_baseuflsymbols_(buffer.str());
   }
 
+  start_phase_("systems");
   for (uint i = 0; i<nsystems; i++)                                  // loop over the systems *again*, this time filling all the
   {                                                                  // systems data into the bucket data structures
     buffer.str(""); buffer << optionpath() << "/system[" << i << "]";
     fill_systems_(buffer.str());
+    std::string systemname;
+    buffer << "/name";
+    serr = Spud::get_option(buffer.str(), systemname);
+    spud_err(buffer.str(), serr);
+    end_system_(systemname);
   }
 
+  start_phase_("coefficient function allocation");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *third* time, this time filling
                                   sys_it != systems_end(); sys_it++) // in the data for the coefficient functions contained within
   {                                                                  // them
     (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).allocate_coeff_function();
+    end_system_((*sys_it).first);
   }                                                                  // we couldn't do this before because we might not have had
                                                                      // the right functionspace available
   
+  start_phase_("bcs");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *fourth* time, this time filling
                                   sys_it != systems_end(); sys_it++) // in the data for the bcs
   {                                                                  // 
     (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).allocate_bcs();
+    end_system_((*sys_it).first);
   }                                                                  // we couldn't do this before now because we allow reference
                                                                      // bcs so everything had to be allocated
   
+  start_phase_("ufl symbol registration");
   fill_uflsymbols_();                                                // now all the functions in the systems are complete we can 
                                                                      // register them in the bucket so it's easy to attach them
                                                                      // to the forms and functionals
@@ -132,16 +152,32 @@ void SpudBucket::fill()
                                                                      // this can also be done now because all relevant pointers should be
                                                                      // allocated
 
+  start_phase_("ensemble");
+  fill_ensemble_();                                                  // fill in the ensemble members (if there are any), this has
+                                                                     // to happen before the expressions are initialized as the
+                                                                     // parameters of the first member may change them
+
+  start_phase_("forms");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *fifth* time, attaching the
                                   sys_it != systems_end(); sys_it++) // coefficients to the forms and functionals
   {
     (*(*sys_it).second).initialize_forms();
+    end_system_((*sys_it).first);
+  }
+  fill_systemgraph_();                                               // now the coefficients are known derive the system dependencies
+
+  buffer.str(""); buffer << "/io/debugging/system_graph";           // output the dependency graph for visualization?
+  if (Spud::have_option(buffer.str()))
+  {
+    write_systemgraph(output_basename()+"_systems.dot");
   }
   
+  start_phase_("expressions");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *sixth* time, initializing
                                   sys_it != systems_end(); sys_it++) // the values of any expressions, functionals or functions
   {                                                                  // used by fields or coefficients
     (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_fields_and_coefficient_expressions();
+    end_system_((*sys_it).first);
   }
   
                                                                      // after this point, we are allowed to start calling evals on
@@ -153,33 +189,115 @@ void SpudBucket::fill()
                                                                      // just deal with them by evaluating coefficient functions 
                                                                      // in the order the user specified followed by fields last.
 
+  start_phase_("coefficient functions");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *seventh* time, initializing
                        sys_it != systems_end(); sys_it++)            // the values of any coefficient functions
   {                                                                  
     (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_coefficient_functions();
+    end_system_((*sys_it).first);
   }
   
+  start_phase_("initial fields");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *eighth* time, initializing
                        sys_it != systems_end(); sys_it++)            // the values of the fields
   {
     (*(*sys_it).second).evaluate_initial_fields();
+    end_system_((*sys_it).first);
   }
   
+  start_phase_("solvers");
   for (SystemBucket_it sys_it = systems_begin();                     // loop over the systems for a *eighth* time, preassembling
                                   sys_it != systems_end(); sys_it++) // the matrices
   {
     (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_solvers();
+    end_system_((*sys_it).first);
   }
+
+  log(INFO, memory_str().c_str());                                   // report the footprint of the allocated vectors and matrices
   
+  start_phase_("detectors");
   fill_detectors_();                                                 // put the detectors in the bucket
 
+  start_phase_("diagnostics");
   fill_diagnostics_();                                               // this should be called last because it initializes the
                                                                      // diagnostic files, which must use a complete bucket
+  end_phase_();
+
+  log_startup_timings_();                                            // a single reduction of all the timings
 
   log(INFO, str().c_str());
 
 }
 
+//*******************************************************************|************************************************************//
+// start timing a phase of fill (finishing the previous phase if there is one)
+//*******************************************************************|************************************************************//
+void SpudBucket::start_phase_(const std::string &phase)
+{
+  if (startup_timings_.size() > 0)
+  {
+    end_phase_();
+  }
+  startup_phase_ = startup_timings_.size();
+  startup_timings_.push_back(std::make_pair(phase, 0.0));
+  startup_phasestart_ = std::chrono::steady_clock::now();
+  startup_systemstart_ = startup_phasestart_;
+}
+
+//*******************************************************************|************************************************************//
+// record the time spent on the named system since the start of the phase or the previous system
+//*******************************************************************|************************************************************//
+void SpudBucket::end_system_(const std::string &system)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  startup_timings_.push_back(std::make_pair("  "+system, 
+                         std::chrono::duration<double>(now - startup_systemstart_).count()));
+  startup_systemstart_ = now;
+}
+
+//*******************************************************************|************************************************************//
+// finish timing the current phase
+//*******************************************************************|************************************************************//
+void SpudBucket::end_phase_()
+{
+  startup_timings_[startup_phase_].second = 
+     std::chrono::duration<double>(std::chrono::steady_clock::now() - startup_phasestart_).count();
+}
+
+//*******************************************************************|************************************************************//
+// report the startup timings, taking the maximum over all processes in a single reduction
+//*******************************************************************|************************************************************//
+void SpudBucket::log_startup_timings_()
+{
+  std::vector<double> timings(startup_timings_.size());
+  double total = 0.0;
+  for (std::size_t i = 0; i < startup_timings_.size(); i++)
+  {
+    timings[i] = startup_timings_[i].second;
+  }
+
+#ifdef HAS_MPI
+  if (dolfin::MPI::size(MPI_COMM_WORLD) > 1)
+  {
+    int mpierr = MPI_Allreduce(MPI_IN_PLACE, timings.data(), timings.size(), MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    mpi_err(mpierr);
+  }
+#endif
+
+  std::stringstream s;
+  s << "Startup timings (maximum over processes, in seconds):" << std::endl;
+  for (std::size_t i = 0; i < startup_timings_.size(); i++)
+  {
+    s << "  " << startup_timings_[i].first << ": " << timings[i] << std::endl;
+    if (startup_timings_[i].first.compare(0, 2, "  ") != 0)
+    {
+      total += timings[i];
+    }
+  }
+  s << "  total: " << total;
+  log(INFO, s.str());
+}
+
 //*******************************************************************|************************************************************//
 // register a (boost shared) pointer to a dolfin mesh in the bucket (and spudbucket) data maps with a spud optionpath
 //*******************************************************************|************************************************************//
@@ -383,6 +501,15 @@ void SpudBucket::fill_globalparameters_() const
     dolfin::parameters["ghost_mode"] = ghost_mode;
   }
 
+  buffer.str(""); buffer << "/global_parameters/assembly_threads";
+  if (Spud::have_option(buffer.str()))
+  {
+    int nthreads;
+    serr = Spud::get_option(buffer.str(), nthreads);
+    spud_err(buffer.str(), serr);
+    ThreadedAssembler::set_num_threads(nthreads);
+  }
+
 }
 
 //*******************************************************************|************************************************************//
@@ -449,6 +576,27 @@ void SpudBucket::fill_timestepping_()
     spud_err(buffer.str(), serr);
     timestep_.second.reset( new dolfin::Constant(timestep_value) );
 
+    buffer.str(""); buffer << "/timestepping/timestep/retry_on_failure";
+    if (Spud::have_option(buffer.str()))
+    {
+      timestep_retryfactor_.reset( new double );
+      buffer.str(""); buffer << "/timestepping/timestep/retry_on_failure/reduction_factor";
+      serr = Spud::get_option(buffer.str(), *timestep_retryfactor_);
+      spud_err(buffer.str(), serr);
+      if (*timestep_retryfactor_ <= 0.0 || *timestep_retryfactor_ >= 1.0)
+      {
+        tf_err("Timestep retry reduction factor must be between 0 and 1.", "reduction_factor: %g", *timestep_retryfactor_);
+      }
+
+      buffer.str(""); buffer << "/timestepping/timestep/retry_on_failure/maximum_retries";
+      serr = Spud::get_option(buffer.str(), timestep_maxretries_);
+      spud_err(buffer.str(), serr);
+
+      buffer.str(""); buffer << "/timestepping/timestep/retry_on_failure/minimum_timestep";
+      serr = Spud::get_option(buffer.str(), timestep_minretry_, 0.0);
+      spud_err(buffer.str(), serr);
+    }
+
     buffer.str(""); buffer << "/timestepping/steady_state";
     if (Spud::have_option(buffer.str()))
     {
@@ -486,6 +634,42 @@ void SpudBucket::fill_timestepping_()
       walltime_limit_.reset( new double );
       serr = Spud::get_option(buffer.str(), *walltime_limit_);
       spud_err(buffer.str(), serr);
+
+      buffer.str(""); buffer << "/timestepping/walltime_limit_prediction";
+      if (Spud::have_option(buffer.str()))
+      {
+        walltime_safetyfactor_.reset( new double );
+        buffer << "/safety_factor";
+        serr = Spud::get_option(buffer.str(), *walltime_safetyfactor_, 1.0);
+        spud_err(buffer.str(), serr);
+      }
+    }
+
+    buffer.str(""); buffer << "/timestepping/terminate_on_signal";
+    if (Spud::have_option(buffer.str()))
+    {
+      std::string signalname;
+      buffer << "/signal";
+      serr = Spud::get_option(buffer.str(), signalname);
+      spud_err(buffer.str(), serr);
+      if (signalname == "SIGTERM")
+      {
+        terminate_signal_ = SIGTERM;
+      }
+      else if (signalname == "SIGUSR1")
+      {
+        terminate_signal_ = SIGUSR1;
+      }
+      else if (signalname == "SIGUSR2")
+      {
+        terminate_signal_ = SIGUSR2;
+      }
+      else
+      {
+        tf_err("Unknown signal name.", "Signal name: %s", signalname.c_str());
+      }
+      TerminateEventHandler_ptr terminate_handler( new TerminateEventHandler );
+      (*SignalHandler::instance()).register_handler(terminate_signal_, terminate_handler);
     }
 
   }
@@ -513,41 +697,7 @@ void SpudBucket::fill_adaptivetimestepping_()
   if (Spud::have_option(buffer.str()))
   {
     
-    
-    buffer.str(""); buffer <<
-       "/timestepping/timestep/adaptive/constraint";               // constraints on which to adapt the timestep (required)
-    int nconstraints = Spud::option_count(buffer.str());
-    for (uint i = 0; i < nconstraints; i++)
-    {
-      buffer.str(""); buffer << 
-         "/timestepping/timestep/adaptive/constraint[" << i << "]";
-      
-      std::string sysname;
-      serr = Spud::get_option(buffer.str()+"/system/name", sysname);
-      spud_err(buffer.str()+"/system/name", serr);
-
-      std::string functionname;
-      FunctionBucket_ptr function;
-      if (Spud::have_option(buffer.str()+"/field/name"))
-      {
-        serr = Spud::get_option(buffer.str()+"/field/name", functionname);
-        spud_err(buffer.str()+"/field/name", serr);
-        function = (*fetch_system(sysname)).fetch_field(functionname);
-      }
-      else
-      {
-        serr = Spud::get_option(buffer.str()+"/coefficient/name", functionname);
-        spud_err(buffer.str()+"/coefficient/name", serr);
-        function = (*fetch_system(sysname)).fetch_coeff(functionname);
-      }
-
-      double maxvalue;
-      serr = Spud::get_option(buffer.str()+"/requested_maximum_value", maxvalue);
-      spud_err(buffer.str()+"/requested_maximum_value", serr);
-
-      timestep_constraints_.push_back(std::make_pair( function, maxvalue ));
-
-    }
+    fill_timestepconstraints_();                                     // constraints on which to adapt the timestep (required)
 
     buffer.str(""); buffer <<
        "/timestepping/timestep/adaptive/adapt_period_in_timesteps";// timestep adapt period in timesteps
@@ -582,6 +732,52 @@ void SpudBucket::fill_adaptivetimestepping_()
   
 }
 
+//*******************************************************************|************************************************************//
+// fill in the constraints on an adaptive timestep (separate from the other adaptive timestepping data so that they can be refilled
+// after the systems have been rebuilt)
+//*******************************************************************|************************************************************//
+void SpudBucket::fill_timestepconstraints_()
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud option error
+  
+  buffer.str(""); buffer <<
+     "/timestepping/timestep/adaptive/constraint";                   // constraints on which to adapt the timestep
+  int nconstraints = Spud::option_count(buffer.str());
+  for (uint i = 0; i < nconstraints; i++)
+  {
+    buffer.str(""); buffer << 
+       "/timestepping/timestep/adaptive/constraint[" << i << "]";
+    
+    std::string sysname;
+    serr = Spud::get_option(buffer.str()+"/system/name", sysname);
+    spud_err(buffer.str()+"/system/name", serr);
+
+    std::string functionname;
+    FunctionBucket_ptr function;
+    if (Spud::have_option(buffer.str()+"/field/name"))
+    {
+      serr = Spud::get_option(buffer.str()+"/field/name", functionname);
+      spud_err(buffer.str()+"/field/name", serr);
+      function = (*fetch_system(sysname)).fetch_field(functionname);
+    }
+    else
+    {
+      serr = Spud::get_option(buffer.str()+"/coefficient/name", functionname);
+      spud_err(buffer.str()+"/coefficient/name", serr);
+      function = (*fetch_system(sysname)).fetch_coeff(functionname);
+    }
+
+    double maxvalue;
+    serr = Spud::get_option(buffer.str()+"/requested_maximum_value", maxvalue);
+    spud_err(buffer.str()+"/requested_maximum_value", serr);
+
+    timestep_constraints_.push_back(std::make_pair( function, maxvalue ));
+
+  }
+
+}
+
 //*******************************************************************|************************************************************//
 // fill in any output data
 //*******************************************************************|************************************************************//
@@ -818,12 +1014,114 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     (*mesh).init();                                                  // initialize the mesh (maps between dimensions etc.)
 
   }
-  else if (source=="UnitInterval")                                   // source is an internally generated dolfin mesh
+  else                                                               // source is an internally generated dolfin mesh
+  {
+    mesh = generate_mesh_(optionpath);
+  }
+
+  (*mesh).rename(meshname, meshname);
+  register_mesh(mesh, meshname, optionpath);                         // put the new mesh in the bucket
+
+  FunctionSpace_ptr vis_fs =                                         // retrieve the visualization functionspace for this mesh
+                    ufc_fetch_visualization_functionspace(meshname,
+                                                          mesh);
+
+  register_visfunctionspace(vis_fs, mesh);                           // put the visualization functionspace in the bucket
+
+  buffer.str(""); buffer << optionpath << "/adaptivity";
+  if (Spud::have_option(buffer.str()))                               // keep the original mesh to regenerate adapted meshes from
+  {
+    basemeshes_[meshname] = mesh;
+    adaptcounts_[meshname] = 0;
+
+    if (!Spud::have_option("/timestepping"))                         // simulations without timestepping are solved again after
+    {                                                                // every adapt
+      int nadapts;
+      buffer << "/number_adapts";
+      serr = Spud::get_option(buffer.str(), nadapts, 1);
+      spud_err(buffer.str(), serr);
+      *number_timesteps_ = std::max(*number_timesteps_, nadapts+1);
+    }
+
+    if (Spud::have_option("/io/checkpointing"))                      // checkpoints only refer to the original mesh file so couldn't
+    {                                                                // be restarted from once the mesh has been adapted
+      tf_err("Mesh adaptivity cannot be combined with checkpointing.", "Mesh name: %s", meshname.c_str());
+    }
+  }
+
+  buffer.str(""); buffer << optionpath << "/source/load_balancing";
+  if (Spud::have_option(buffer.str()))                               // record the (vector and functional) assembly costs so that
+  {                                                                  // the mesh can be repartitioned if they become imbalanced
+    if (basemeshes_.count(meshname) > 0)
+    {
+      tf_err("Load balancing cannot be combined with mesh adaptivity.", "Mesh name: %s", meshname.c_str());
+    }
+    if (!Spud::have_option("/io/checkpointing"))
+    {
+      tf_err("Load balancing requires checkpointing.", "Mesh name: %s", meshname.c_str());
+    }
+
+    buffer << "/imbalance_threshold";
+    serr = Spud::get_option(buffer.str(), imbalancethresholds_[meshname]);
+    spud_err(buffer.str(), serr);
+
+    ThreadedAssembler::set_record_costs(*mesh);
+
+    const std::string partitioner = dolfin::parameters["mesh_partitioner"];
+    if (partitioner != "SCOTCH")
+    {
+      log(WARNING, "Mesh %s will be rebalanced but the %s partitioner ignores cell weights.", 
+                                             meshname.c_str(), partitioner.c_str());
+    }
+  }
+
+}
+
+//*******************************************************************|************************************************************//
+// return a new mesh generated from the options of the named (internally generated) mesh but with fewer cells
+//*******************************************************************|************************************************************//
+Mesh_ptr SpudBucket::coarsen_mesh(const std::string &name, const int &factor)
+{
+  std::string optionpath = fetch_mesh_optionpath(name);
+
+  std::string source;
+  std::string sourcepath = optionpath+"/source/name";
+  Spud::OptionError serr = Spud::get_option(sourcepath, source); 
+  spud_err(sourcepath, serr);
+  if (source=="File")
+  {
+    tf_err("Cannot coarsen a mesh read from a file.", "Mesh name: %s", name.c_str());
+  }
+
+  Mesh_ptr mesh = generate_mesh_(optionpath, factor);
+  std::stringstream buffer;
+  buffer.str(""); buffer << name << "_coarsened_" << factor;
+  (*mesh).rename(buffer.str(), buffer.str());
+  return mesh;
+}
+
+//*******************************************************************|************************************************************//
+// generate an internal dolfin mesh from the options tree (dividing the number of cells in each direction by coarsening)
+//*******************************************************************|************************************************************//
+Mesh_ptr SpudBucket::generate_mesh_(const std::string &optionpath, const int &coarsening)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  std::string source;                                                // get the source of the mesh
+  buffer.str(""); buffer << optionpath << "/source/name";
+  serr = Spud::get_option(buffer.str(), source); 
+  spud_err(buffer.str(), serr);
+
+  Mesh_ptr mesh;                                                     // initialize the pointer
+
+  if (source=="UnitInterval")                                        // source is an internally generated dolfin mesh
   {
     int cells;
     buffer.str(""); buffer << optionpath << "/source/number_cells";
     serr = Spud::get_option(buffer.str(), cells); 
     spud_err(buffer.str(), serr);
+    coarsen_number_cells_(cells, coarsening, optionpath);
     
     mesh.reset( new dolfin::UnitIntervalMesh(cells) );
 
@@ -858,6 +1156,7 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     buffer.str(""); buffer << optionpath << "/source/number_cells";
     serr = Spud::get_option(buffer.str(), cells); 
     spud_err(buffer.str(), serr);
+    coarsen_number_cells_(cells, coarsening, optionpath);
     
     mesh.reset( new dolfin::IntervalMesh(cells, leftx, rightx) );
 
@@ -882,6 +1181,7 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     buffer.str(""); buffer << optionpath << "/source/number_cells";
     serr = Spud::get_option(buffer.str(), cells); 
     spud_err(buffer.str(), serr);
+    coarsen_number_cells_(cells, coarsening, optionpath);
     
     std::string diagonal;
     buffer.str(""); buffer << optionpath << "/source/diagonal";
@@ -924,6 +1224,7 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     buffer.str(""); buffer << optionpath << "/source/number_cells";
     serr = Spud::get_option(buffer.str(), cells); 
     spud_err(buffer.str(), serr);
+    coarsen_number_cells_(cells, coarsening, optionpath);
     
     std::string diagonal;
     buffer.str(""); buffer << optionpath << "/source/diagonal";
@@ -959,6 +1260,7 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     buffer.str(""); buffer << optionpath << "/source/number_cells";
     serr = Spud::get_option(buffer.str(), cells); 
     spud_err(buffer.str(), serr);
+    coarsen_number_cells_(cells, coarsening, optionpath);
     
     mesh.reset( new dolfin::UnitCubeMesh(cells[0], 
                                      cells[1], 
@@ -1004,6 +1306,7 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     buffer.str(""); buffer << optionpath << "/source/number_cells";
     serr = Spud::get_option(buffer.str(), cells); 
     spud_err(buffer.str(), serr);
+    coarsen_number_cells_(cells, coarsening, optionpath);
     
     const dolfin::Point lowerbackleftpoint(3, lowerbackleft.data());
     const dolfin::Point upperfrontrightpoint(3, upperfrontright.data());
@@ -1038,15 +1341,33 @@ void SpudBucket::fill_meshes_(const std::string &optionpath)
     tf_err("Unknown mesh source.", "Don't understand mesh description.");
   }
 
-  (*mesh).rename(meshname, meshname);
-  register_mesh(mesh, meshname, optionpath);                         // put the new mesh in the bucket
-
-  FunctionSpace_ptr vis_fs =                                         // retrieve the visualization functionspace for this mesh
-                    ufc_fetch_visualization_functionspace(meshname,
-                                                          mesh);
+  return mesh;
+}
 
-  register_visfunctionspace(vis_fs, mesh);                           // put the visualization functionspace in the bucket
+//*******************************************************************|************************************************************//
+// divide the number of cells of an internally generated mesh by a coarsening factor
+//*******************************************************************|************************************************************//
+void SpudBucket::coarsen_number_cells_(int &cells, const int &coarsening, 
+                                       const std::string &optionpath) const
+{
+  if (cells%coarsening != 0)
+  {
+    tf_err("Cannot coarsen mesh.", "Number of cells (%d) not divisible by %d in %s.", 
+           cells, coarsening, optionpath.c_str());
+  }
+  cells /= coarsening;
+}
 
+//*******************************************************************|************************************************************//
+// divide the number of cells in each direction of an internally generated mesh by a coarsening factor
+//*******************************************************************|************************************************************//
+void SpudBucket::coarsen_number_cells_(std::vector<int> &cells, const int &coarsening, 
+                                       const std::string &optionpath) const
+{
+  for (std::vector<int>::iterator c_it = cells.begin(); c_it != cells.end(); c_it++)
+  {
+    coarsen_number_cells_(*c_it, coarsening, optionpath);
+  }
 }
 
 //*******************************************************************|************************************************************//
@@ -1152,11 +1473,28 @@ void SpudBucket::fill_detectors_()
 //*******************************************************************|************************************************************//
 void SpudBucket::fill_diagnostics_()
 {
-  std::stringstream buffer;                                          // optionpath buffer
+  open_diagnostics_();
+
+  for (SystemBucket_const_it s_it = systems_begin(); s_it != systems_end(); s_it++)
+  {
+    (*(*s_it).second).initialize_diagnostics();                      // initialize any diagnostic files in systems
+  }
+
+  fill_visualization_();                                             // collect the functions to be visualized
+  
+}
 
+//*******************************************************************|************************************************************//
+// open the diagnostic files belonging to the bucket (rather than to its systems) using the current output base name
+//*******************************************************************|************************************************************//
+void SpudBucket::open_diagnostics_()
+{
   statfile_.reset( new StatisticsFile(output_basename()+".stat", 
                            (*(*meshes_begin()).second).mpi_comm(),
-                           this) );
+                           this, 
+                           Spud::have_option("/io/include_memory_in_statistics"),
+                           !basemeshes_.empty(),                     // the number of dofs only changes if a mesh is adapted
+                           Spud::have_option("/timestepping/timestep/retry_on_failure")) );
   (*statfile_).write_header();
 
   int npdets = Spud::option_count("/io/detectors/point");            // number of point detectors
@@ -1192,10 +1530,14 @@ void SpudBucket::fill_diagnostics_()
     (*convfile_).write_header();
   }
 
-  for (SystemBucket_const_it s_it = systems_begin(); s_it != systems_end(); s_it++)
-  {
-    (*(*s_it).second).initialize_diagnostics();                      // initialize any diagnostic files in systems
-  }
+}
+
+//*******************************************************************|************************************************************//
+// collect the functions to be visualized on each mesh (reusing any files that are already open)
+//*******************************************************************|************************************************************//
+void SpudBucket::fill_visualization_()
+{
+  visfiles_.clear();
 
   if ((Spud::option_count("/system/field/diagnostics/include_in_visualization")+
        Spud::option_count("/system/field/diagnostics/include_residual_in_visualization")+
@@ -1221,14 +1563,18 @@ void SpudBucket::fill_diagnostics_()
 
       if (functions.size()>0)                                        // if there were any functions to include, let's save this info
       {
-        File_ptr pvd_file;
-        if (meshes_.size()>1)                                        // allocate the pvd file with an appropriate name
-        {
-          pvd_file.reset( new dolfin::File(output_basename()+"_"+(*m_it).first+".pvd", "compressed") );
-        }
-        else
+        File_ptr pvd_file = pvdfiles_[(*m_it).first];                // reuse the file if we've already opened it (before an adapt)
+        if (!pvd_file)
         {
-          pvd_file.reset( new dolfin::File(output_basename()+".pvd", "compressed") );
+          if (meshes_.size()>1)                                      // allocate the pvd file with an appropriate name
+          {
+            pvd_file.reset( new dolfin::File(output_basename()+"_"+(*m_it).first+".pvd", "compressed") );
+          }
+          else
+          {
+            pvd_file.reset( new dolfin::File(output_basename()+".pvd", "compressed") );
+          }
+          pvdfiles_[(*m_it).first] = pvd_file;
         }
 
 
@@ -1273,13 +1619,19 @@ void SpudBucket::fill_diagnostics_()
 
       if (functions.size()>0)                                        // if there were any functions to include, let's save this info
       {
-        File_ptr pvd_file = NULL;
+        File_ptr pvd_file = NULL;                                    // allocated when first needed
+        std::map< std::string, std::pair< File_ptr, std::vector< GenericFunction_ptr > > >::const_iterator 
+                                           c_it = convvisfiles_.find((*m_it).first);
+        if (c_it != convvisfiles_.end())                             // but reuse it if it was allocated before an adapt
+        {
+          pvd_file = (*c_it).second.first;
+        }
         convvisfiles_[(*m_it).first] = std::make_pair(pvd_file, functions);// save to the data structure
       }
 
     }
   }
-  
+
 }
 
 //*******************************************************************|************************************************************//
@@ -1325,4 +1677,879 @@ void SpudBucket::checkpoint_options_(const double_ptr time)
 
 }
 
+//*******************************************************************|************************************************************//
+// adapt any meshes that are due an adapt and, if any of them changed, rebuild all the systems on the new meshes
+//*******************************************************************|************************************************************//
+void SpudBucket::adapt_meshes_()
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  std::map< std::string, Mesh_ptr > newmeshes;                       // the adapted meshes (by name)
+  for (std::map< std::string, Mesh_ptr >::const_iterator b_it = basemeshes_.begin(); 
+                                                         b_it != basemeshes_.end(); b_it++)
+  {
+    const std::string meshname = (*b_it).first;
+    buffer.str(""); buffer << fetch_mesh_optionpath(meshname) << "/adaptivity";
+    const std::string optionpath = buffer.str();
+
+    int period = 1, nadapts = -1;                                    // every timestep, unlimited adapts by default
+    if (Spud::have_option("/timestepping"))
+    {
+      serr = Spud::get_option(optionpath+"/adapt_period_in_timesteps", period, 1);
+      spud_err(optionpath+"/adapt_period_in_timesteps", serr);
+    }
+    else
+    {
+      nadapts = 1;                                                   // but only once without timestepping
+    }
+    if (Spud::have_option(optionpath+"/number_adapts"))
+    {
+      serr = Spud::get_option(optionpath+"/number_adapts", nadapts);
+      spud_err(optionpath+"/number_adapts", serr);
+    }
+
+    if ((timestep_count()%period != 0) || 
+        ((nadapts >= 0) && (adaptcounts_[meshname] >= nadapts)))
+    {
+      continue;
+    }
+
+    log(INFO, "Adapting mesh %s", meshname.c_str());
+    const dolfin::CellFunction<double> indicator = error_indicator_(meshname);
+    newmeshes[meshname] = adapted_mesh_(meshname, indicator);
+    adaptcounts_[meshname]++;
+  }
+
+  bool changed = false;                                              // don't rebuild anything if the meshes are the same (this is
+                                                                     // consistent across processes as the refinement is collective)
+  for (std::map< std::string, Mesh_ptr >::const_iterator n_it = newmeshes.begin(); 
+                                                         n_it != newmeshes.end(); n_it++)
+  {
+    changed = changed || ((*n_it).second != fetch_mesh((*n_it).first));
+  }
+  if (!changed)
+  {
+    return;
+  }
+
+  rebuild_systems_(newmeshes, false);
+
+}
+
+//*******************************************************************|************************************************************//
+// return the error indicator in each cell of the named mesh
+//*******************************************************************|************************************************************//
+dolfin::CellFunction<double> SpudBucket::error_indicator_(const std::string &meshname)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  Mesh_ptr mesh = fetch_mesh(meshname);
 
+  buffer.str(""); buffer << fetch_mesh_optionpath(meshname) << "/adaptivity/error_indicator";
+  const std::string optionpath = buffer.str();
+
+  std::string type;
+  serr = Spud::get_option(optionpath+"/name", type);
+  spud_err(optionpath+"/name", serr);
+
+  std::string systemname;
+  serr = Spud::get_option(optionpath+"/system/name", systemname);
+  spud_err(optionpath+"/system/name", serr);
+  SystemBucket_ptr system = fetch_system(systemname);
+  if ((*system).mesh() != mesh)
+  {
+    tf_err("Error indicator system is not on the adapted mesh.", "Mesh name: %s, SystemBucket name: %s", 
+                                                    meshname.c_str(), systemname.c_str());
+  }
+
+  dolfin::CellFunction<double> indicator(mesh, 0.0);
+
+  if (type=="residual")                                              // the largest (owned) residual of the field in each cell
+  {
+    std::string fieldname;
+    serr = Spud::get_option(optionpath+"/field/name", fieldname);
+    spud_err(optionpath+"/field/name", serr);
+    FunctionBucket_ptr field = (*system).fetch_field(fieldname);
+    assert((*system).residualfunction());
+
+    std::vector<double> residual;                                    // only the values owned by this process
+    (*(*(*system).residualfunction()).vector()).get_local(residual);
+    std::shared_ptr<const dolfin::GenericDofMap> dofmap = (*(*field).functionspace()).dofmap();
+
+    for (dolfin::CellIterator cell(*mesh); !cell.end(); ++cell)
+    {
+      dolfin::ArrayView<const dolfin::la_index> cell_dofs = (*dofmap).cell_dofs((*cell).index());
+      double value = 0.0;
+      for (std::size_t i = 0; i < cell_dofs.size(); i++)
+      {
+        if ((std::size_t)cell_dofs[i] < residual.size())
+        {
+          value = std::max(value, std::abs(residual[cell_dofs[i]]));
+        }
+      }
+      indicator[*cell] = value;
+    }
+  }
+  else if (type=="functional")                                       // the magnitude of the functional in each cell
+  {
+    std::string functionalname;
+    serr = Spud::get_option(optionpath+"/functional/name", functionalname);
+    spud_err(optionpath+"/functional/name", serr);
+
+    const dolfin::CellFunction<double> values = 
+                     (*(*system).fetch_functional(functionalname)).cellfunction(true);
+    for (dolfin::CellIterator cell(*mesh); !cell.end(); ++cell)
+    {
+      indicator[*cell] = std::abs(values[*cell]);
+    }
+  }
+  else
+  {
+    tf_err("Unknown error indicator type.", "Type: %s", type.c_str());
+  }
+
+  return indicator;
+}
+
+//*******************************************************************|************************************************************//
+// return a new mesh regenerated from the original mesh with the given name, refining cells where the error indicator (on the
+// current mesh) is large by one level and coarsening cells where it is small by (at most) one level
+//*******************************************************************|************************************************************//
+Mesh_ptr SpudBucket::adapted_mesh_(const std::string &meshname, 
+                                   const dolfin::CellFunction<double> &indicator)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  buffer.str(""); buffer << fetch_mesh_optionpath(meshname) << "/adaptivity";
+  const std::string optionpath = buffer.str();
+
+  double fraction;
+  serr = Spud::get_option(optionpath+"/refinement_fraction", fraction);
+  spud_err(optionpath+"/refinement_fraction", serr);
+
+  int levels;
+  serr = Spud::get_option(optionpath+"/maximum_refinement_levels", levels);
+  spud_err(optionpath+"/maximum_refinement_levels", serr);
+
+  Mesh_ptr oldmesh = fetch_mesh(meshname);
+  std::shared_ptr<dolfin::BoundingBoxTree> tree = (*oldmesh).bounding_box_tree();
+
+  double maxindicator = 0.0;
+  for (std::size_t i = 0; i < indicator.size(); i++)
+  {
+    maxindicator = std::max(maxindicator, indicator[i]);
+  }
+  const double threshold = fraction*dolfin::MPI::max((*oldmesh).mpi_comm(), maxindicator);
+
+  const double ratio =                                               // volume ratio between levels of uniform refinement
+               std::pow(2.0, (double) (*oldmesh).topology().dim());
+
+  Mesh_ptr mesh = basemeshes_[meshname];
+  for (int l = 0; l < levels; l++)
+  {
+    dolfin::CellFunction<bool> markers(mesh, false);
+    std::size_t nmarked = 0;
+    for (dolfin::CellIterator cell(*mesh); !cell.end(); ++cell)
+    {
+      const unsigned int oldindex =                                  // the old cell this one lies in
+              (*tree).compute_closest_entity((*cell).midpoint()).first;
+      double target = dolfin::Cell(*oldmesh, oldindex).volume();     // the target volume is the old cell...
+      if (indicator[oldindex] > threshold)
+      {
+        target /= ratio;                                             // ... refined by a level
+      }
+      else
+      {
+        target *= ratio;                                             // ... or coarsened by a level
+      }
+      if ((*cell).volume() > 1.5*target)                             // allowing for cells that were only bisected
+      {
+        markers[*cell] = true;
+        nmarked++;
+      }
+    }
+
+    if (dolfin::MPI::sum((*mesh).mpi_comm(), nmarked)==0)
+    {
+      break;
+    }
+
+    Mesh_ptr refined(new dolfin::Mesh((*mesh).mpi_comm()));
+    dolfin::refine(*refined, *mesh, markers, false);                 // don't redistribute so the new mesh overlaps the old mesh
+    transfer_mesh_domains_(mesh, refined);                           // on each process
+    mesh = refined;
+  }
+
+  return mesh;
+}
+
+//*******************************************************************|************************************************************//
+// copy the cell and facet markers of a mesh to a mesh refined from it
+//*******************************************************************|************************************************************//
+void SpudBucket::transfer_mesh_domains_(const Mesh_ptr parent, Mesh_ptr child) const
+{
+  const std::size_t tdim = (*parent).topology().dim();
+  std::shared_ptr<dolfin::BoundingBoxTree> tree = (*parent).bounding_box_tree();
+
+  (*child).domains().init(tdim);
+
+  const std::map<std::size_t, std::size_t> &cellmarkers = (*parent).domains().markers(tdim);
+  if (!cellmarkers.empty())
+  {
+    for (dolfin::CellIterator cell(*child); !cell.end(); ++cell)     // child cells take the marker of the parent they lie in
+    {
+      const unsigned int parentindex = 
+              (*tree).compute_closest_entity((*cell).midpoint()).first;
+      std::map<std::size_t, std::size_t>::const_iterator m_it = cellmarkers.find(parentindex);
+      if (m_it != cellmarkers.end())
+      {
+        (*child).domains().set_marker(std::make_pair((*cell).index(), (*m_it).second), tdim);
+      }
+    }
+  }
+
+  const std::map<std::size_t, std::size_t> &facetmarkers = (*parent).domains().markers(tdim-1);
+  if (!facetmarkers.empty())
+  {
+    (*parent).init(tdim, tdim-1);
+    (*child).init(tdim-1);
+    for (dolfin::FacetIterator facet(*child); !facet.end(); ++facet) // child facets take the marker of the parent facet they lie
+    {                                                                // on (if any)
+      const dolfin::Point midpoint = (*facet).midpoint();
+      const dolfin::Cell parentcell(*parent, 
+              (*tree).compute_closest_entity(midpoint).first);
+      for (std::size_t i = 0; i < parentcell.num_entities(tdim-1); i++)
+      {
+        std::map<std::size_t, std::size_t>::const_iterator m_it = 
+                                  facetmarkers.find(parentcell.entities(tdim-1)[i]);
+        if (m_it == facetmarkers.end())
+        {
+          continue;
+        }
+        const dolfin::Facet parentfacet(*parent, (*m_it).first);
+        const double distance = 
+              std::abs(parentcell.normal(i).dot(midpoint - parentfacet.midpoint()));
+        if (distance < 1.e-8*parentcell.h())                         // on the plane of the facet (and in the cell) so on the facet
+        {
+          (*child).domains().set_marker(std::make_pair((*facet).index(), (*m_it).second), tdim-1);
+          break;
+        }
+      }
+    }
+  }
+
+}
+
+//*******************************************************************|************************************************************//
+// interpolate the fields of a system on an old mesh into the same system rebuilt on a new mesh
+//*******************************************************************|************************************************************//
+void SpudBucket::interpolate_system_(const SystemBucket_ptr oldsystem, SystemBucket_ptr system) const
+{
+  if ((*system).fields_size() == 0)
+  {
+    return;
+  }
+
+  std::vector< std::pair< Function_ptr, Function_ptr > > functions;
+  functions.push_back(std::make_pair((*oldsystem).function(), (*system).function()));
+  functions.push_back(std::make_pair((*oldsystem).oldfunction(), (*system).oldfunction()));
+  functions.push_back(std::make_pair((*oldsystem).iteratedfunction(), (*system).iteratedfunction()));
+
+  const bool samemesh = ((*oldsystem).mesh() == (*system).mesh());   // an unadapted mesh has the same dof layout as before
+
+  if (!samemesh)                                                     // the old functions are extrapolated to any new points that
+  {                                                                  // fall outside the old mesh so report how many do
+    const dolfin::Mesh &oldmesh = *(*oldsystem).mesh();
+    const dolfin::Mesh &mesh = *(*system).mesh();
+    std::shared_ptr<dolfin::BoundingBoxTree> tree = oldmesh.bounding_box_tree();
+    const double tolerance = 1.e-8*dolfin::MPI::max(oldmesh.mpi_comm(), oldmesh.hmax());
+    std::size_t noutside = 0;
+    double maxdistance = 0.0;
+    for (dolfin::VertexIterator v(mesh); !v.end(); ++v)
+    {
+      const dolfin::Point point = (*v).point();
+      if ((*tree).compute_first_entity_collision(point) < oldmesh.num_cells())
+      {
+        continue;
+      }
+      const double distance = (*tree).compute_closest_entity(point).second;
+      if (distance > tolerance)
+      {
+        noutside++;
+        maxdistance = std::max(maxdistance, distance);
+      }
+    }
+    noutside = dolfin::MPI::sum(mesh.mpi_comm(), noutside);
+    maxdistance = dolfin::MPI::max(mesh.mpi_comm(), maxdistance);
+    if (noutside > 0)
+    {
+      log(WARNING, "Extrapolating the fields of system %s to %d vertices up to %g outside the old mesh.", 
+                          (*system).name().c_str(), (int)noutside, maxdistance);
+    }
+  }
+
+  for (std::vector< std::pair< Function_ptr, Function_ptr > >::iterator f_it = functions.begin(); 
+                                                                       f_it != functions.end(); f_it++)
+  {
+    if (samemesh)
+    {
+      (*(*(*f_it).second).vector()) = (*(*(*f_it).first).vector());
+    }
+    else
+    {
+      (*(*f_it).first).set_allow_extrapolation(true);                // points outside the old mesh were reported above
+      (*(*f_it).second).interpolate(*(*f_it).first);
+    }
+  }
+}
+
+//*******************************************************************|************************************************************//
+// replace the named meshes with the new meshes and rebuild all the systems on them, interpolating the fields from the old systems
+// (or migrating them if the new meshes are only redistributions of the old meshes)
+//*******************************************************************|************************************************************//
+void SpudBucket::rebuild_systems_(const std::map< std::string, Mesh_ptr > &newmeshes, const bool &redistributed)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+
+  for (std::map< std::string, Mesh_ptr >::const_iterator n_it = newmeshes.begin(); 
+                                                         n_it != newmeshes.end(); n_it++)
+  {
+    Mesh_ptr mesh = (*n_it).second;
+    (*mesh).rename((*n_it).first, (*n_it).first);
+    replace_mesh_(mesh, (*n_it).first);                              // put the new mesh in the bucket
+    FunctionSpace_ptr vis_fs = ufc_fetch_visualization_functionspace((*n_it).first, mesh);
+    register_visfunctionspace(vis_fs, mesh);
+  }
+
+  for (SystemBucket_it sys_it = systems_begin();                     // keep the old systems so that we can interpolate from them and
+                       sys_it != systems_end(); sys_it++)            // the new solvers can adopt their files
+  {
+    adaptedsystems_[(*sys_it).first] = (*sys_it).second;
+  }
+  reset_systems_();
+
+  buffer.str(""); buffer << optionpath() << "/system";               // refill the systems in the same order as fill
+  int nsystems = Spud::option_count(buffer.str());
+  for (uint i = 0; i<nsystems; i++)
+  {
+    buffer.str(""); buffer << optionpath() << "/system[" << i << "]";
+    fill_systems_(buffer.str());
+  }
+
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).allocate_coeff_function();
+  }
+  
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).allocate_bcs();
+  }
+
+  fill_uflsymbols_();
+  fill_timestepconstraints_();
+
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*(*sys_it).second).initialize_forms();
+  }
+  fill_systemgraph_();
+
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_fields_and_coefficient_expressions();
+  }
+
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_coefficient_functions();
+  }
+
+  for (SystemBucket_it sys_it = systems_begin();                     // the fields are interpolated from the old systems rather
+                       sys_it != systems_end(); sys_it++)            // than being reset to their initial conditions
+  {
+    if (redistributed)
+    {
+      migrate_system_(adaptedsystems_[(*sys_it).first], (*sys_it).second);
+    }
+    else
+    {
+      interpolate_system_(adaptedsystems_[(*sys_it).first], (*sys_it).second);
+    }
+  }
+
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_solvers();
+  }
+
+  adaptedsystems_.clear();                                           // finished with the old systems
+
+  if (statfile_)                                                     // the diagnostic files keep writing to the same files but
+  {                                                                  // must collect the new functions
+    (*statfile_).refresh_bucket();
+  }
+  if (detfile_)
+  {
+    (*detfile_).refresh_bucket();
+  }
+  if (steadyfile_)
+  {
+    (*steadyfile_).refresh_bucket();
+  }
+  if (convfile_)
+  {
+    (*convfile_).refresh_bucket();
+  }
+  fill_visualization_();
+
+  for (SystemBucket_const_it sys_it = systems_begin(); 
+                             sys_it != systems_end(); sys_it++)
+  {
+    if ((*(*sys_it).second).fields_size() > 0)
+    {
+      log(INFO, "System %s now has %d degrees of freedom", (*sys_it).first.c_str(),
+                              (int) (*(*(*sys_it).second).functionspace()).dim());
+    }
+  }
+
+}
+
+//*******************************************************************|************************************************************//
+// repartition any meshes whose assembly costs have become imbalanced since the last checkpoint and, if any were repartitioned,
+// rebuild all the systems on them
+//*******************************************************************|************************************************************//
+void SpudBucket::rebalance_meshes_()
+{
+  if (imbalancethresholds_.empty() || (checkpoint_count() == rebalancecheckpoint_))
+  {
+    return;                                                          // only consider rebalancing after a new checkpoint
+  }
+  rebalancecheckpoint_ = checkpoint_count();
+
+  std::map< std::string, Mesh_ptr > newmeshes;                       // the repartitioned meshes (by name)
+  for (std::map< std::string, double >::const_iterator t_it = imbalancethresholds_.begin(); 
+                                                       t_it != imbalancethresholds_.end(); t_it++)
+  {
+    const std::string meshname = (*t_it).first;
+    Mesh_ptr mesh = fetch_mesh(meshname);
+    const MPI_Comm &mpi_comm = (*mesh).mpi_comm();
+
+    const std::map< std::size_t, double > regioncosts = ThreadedAssembler::region_costs(*mesh);
+    ThreadedAssembler::reset_costs(*mesh);                           // start measuring again for the next checkpoint
+
+    double localcost = 0.0;
+    for (std::map< std::size_t, double >::const_iterator c_it = regioncosts.begin(); 
+                                                         c_it != regioncosts.end(); c_it++)
+    {
+      localcost += (*c_it).second;
+    }
+    log(DBG, "Local assembly cost on mesh %s: %g", meshname.c_str(), localcost);
+
+    const double maxcost = dolfin::MPI::max(mpi_comm, localcost);
+    const double avgcost = dolfin::MPI::sum(mpi_comm, localcost)/dolfin::MPI::size(mpi_comm);
+    if (avgcost <= 0.0)                                              // nothing has been assembled on this mesh
+    {
+      continue;
+    }
+
+    const double imbalance = maxcost/avgcost;
+    log(INFO, "Mesh %s assembly cost imbalance: %g (threshold: %g)", meshname.c_str(), imbalance, (*t_it).second);
+    if (imbalance > (*t_it).second)
+    {
+      log(INFO, "Repartitioning mesh %s", meshname.c_str());
+      newmeshes[meshname] = rebalanced_mesh_(meshname, regioncosts);
+      ThreadedAssembler::set_record_costs(*mesh, false);             // only record costs on the mesh that replaces it
+      ThreadedAssembler::set_record_costs(*newmeshes[meshname]);
+    }
+  }
+
+  if (!newmeshes.empty())
+  {
+    rebuild_systems_(newmeshes, true);
+  }
+
+}
+
+//*******************************************************************|************************************************************//
+// return the named mesh read in again from its file and partitioned with each cell weighted by the cost per cell of its region
+// (calculated from the local assembly costs of each region on the current partition)
+//*******************************************************************|************************************************************//
+Mesh_ptr SpudBucket::rebalanced_mesh_(const std::string &meshname, 
+                                      const std::map< std::size_t, double > &regioncosts)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  const Mesh_ptr oldmesh = fetch_mesh(meshname);
+  const MPI_Comm &mpi_comm = (*oldmesh).mpi_comm();
+  const std::size_t dim = (*oldmesh).topology().dim();
+
+  std::string basename;                                              // get the base file name (without the .xml)
+  buffer.str(""); buffer << fetch_mesh_optionpath(meshname) << "/source/file";
+  serr = Spud::get_option(buffer.str(), basename); 
+  spud_err(buffer.str(), serr);
+  std::string filename = xml_filename(basename);
+
+  dolfin::Mesh tmp_mesh(MPI_COMM_SELF, filename);                    // the region id of every cell (by global index)
+  const std::map<std::size_t, std::size_t>& tmp_cell_markers = 
+              tmp_mesh.domains().markers(tmp_mesh.topology().dim());
+
+  std::set<std::size_t> regionids;                                   // the region ids (the same on every process)
+  regionids.insert(0);                                               // cells without an id are in region 0
+  for (std::map<std::size_t, std::size_t>::const_iterator m_it = tmp_cell_markers.begin(); 
+                                                          m_it != tmp_cell_markers.end(); m_it++)
+  {
+    regionids.insert((*m_it).second);
+  }
+
+  std::map<std::size_t, std::size_t> localcells;                     // the number of cells in each region on this process
+  const std::map<std::size_t, std::size_t>& cell_markers = (*oldmesh).domains().markers(dim);
+  for (dolfin::CellIterator cell(*oldmesh); !cell.end(); ++cell)
+  {
+    if ((*cell).is_ghost())
+    {
+      continue;
+    }
+    std::map<std::size_t, std::size_t>::const_iterator m_it = cell_markers.find((*cell).index());
+    localcells[(m_it == cell_markers.end()) ? 0 : (*m_it).second]++;
+  }
+
+  std::map<std::size_t, double> cellcosts;                           // the cost per cell of each region over all processes
+  double maxcellcost = 0.0;
+  for (std::set<std::size_t>::const_iterator r_it = regionids.begin(); r_it != regionids.end(); r_it++)
+  {
+    std::map<std::size_t, double>::const_iterator c_it = regioncosts.find(*r_it);
+    const double cost = dolfin::MPI::sum(mpi_comm, (c_it == regioncosts.end()) ? 0.0 : (*c_it).second);
+    const std::size_t ncells = dolfin::MPI::sum(mpi_comm, localcells[*r_it]);
+    cellcosts[*r_it] = (ncells > 0) ? cost/ncells : 0.0;
+    maxcellcost = std::max(maxcellcost, cellcosts[*r_it]);
+  }
+
+  std::map<std::size_t, std::size_t> weights;                        // integer weights between 1 and 100 for the partitioner
+  for (std::map<std::size_t, double>::const_iterator c_it = cellcosts.begin(); c_it != cellcosts.end(); c_it++)
+  {
+    weights[(*c_it).first] = 1 + (std::size_t) std::round(99.0*(*c_it).second/maxcellcost);
+    log(INFO, "Mesh %s region %d: cost per cell %g, weight %d", meshname.c_str(), 
+                    (int) (*c_it).first, (*c_it).second, (int) weights[(*c_it).first]);
+  }
+
+  Mesh_ptr mesh(new dolfin::Mesh());
+
+  dolfin::LocalMeshData local_mesh_data(filename, (*mesh).mpi_comm());
+  const std::vector<std::int64_t>& global_cell_indices = local_mesh_data.topology.global_cell_indices;
+  std::vector<std::size_t> cell_weights(global_cell_indices.size(), weights[0]);
+  for (std::size_t i = 0; i < global_cell_indices.size(); ++i)
+  {
+    std::map<std::size_t, std::size_t>::const_iterator m_it = tmp_cell_markers.find(global_cell_indices[i]);
+    if (m_it != tmp_cell_markers.end())
+    {
+      cell_weights[i] = weights[(*m_it).second];
+    }
+  }
+  local_mesh_data.topology.cell_weight = cell_weights;
+
+  const std::string ghost_mode = dolfin::parameters["ghost_mode"];
+  dolfin::MeshPartitioning::build_distributed_mesh(*mesh, local_mesh_data, ghost_mode);
+  (*mesh).init();                                                    // initialize the mesh (maps between dimensions etc.)
+
+  return mesh;
+}
+
+//*******************************************************************|************************************************************//
+// migrate the fields of a system into the same system rebuilt on a redistribution of the same mesh
+// the values of the functions on each cell are sent (by global cell index) to a process determined by a block distribution of the
+// cells, which then forwards them to the processes that hold that cell on the new mesh - this is exact for any element
+//*******************************************************************|************************************************************//
+void SpudBucket::migrate_system_(const SystemBucket_ptr oldsystem, SystemBucket_ptr system) const
+{
+  if ((*system).fields_size() == 0)
+  {
+    return;
+  }
+
+  if ((*oldsystem).mesh() == (*system).mesh())                       // not redistributed so the values can just be copied
+  {
+    interpolate_system_(oldsystem, system);
+    return;
+  }
+
+  std::vector< std::pair< Function_ptr, Function_ptr > > functions;
+  functions.push_back(std::make_pair((*oldsystem).function(), (*system).function()));
+  functions.push_back(std::make_pair((*oldsystem).oldfunction(), (*system).oldfunction()));
+  functions.push_back(std::make_pair((*oldsystem).iteratedfunction(), (*system).iteratedfunction()));
+  const std::size_t nfunctions = functions.size();
+
+  const dolfin::Mesh &oldmesh = *(*oldsystem).mesh();
+  const dolfin::Mesh &mesh = *(*system).mesh();
+  const MPI_Comm &mpi_comm = mesh.mpi_comm();
+  const std::size_t nprocs = dolfin::MPI::size(mpi_comm);
+  const std::size_t nglobalcells = mesh.size_global(mesh.topology().dim());
+
+  const dolfin::GenericDofMap &olddofmap = *(*(*oldsystem).functionspace()).dofmap();
+  const dolfin::GenericDofMap &dofmap = *(*(*system).functionspace()).dofmap();
+  const std::size_t ncelldofs = dofmap.max_element_dofs();           // the same in every cell as the mesh has one cell type
+  const std::size_t blocksize = nfunctions*ncelldofs;
+
+  std::vector< std::vector<double> > send_values(nprocs);            // send the old values on each owned cell (preceded by its
+  std::vector< std::vector<double> > receive_values;                 // global index) to the process that holds it in the block
+  std::vector<double> values(ncelldofs);                             // distribution
+  for (dolfin::CellIterator cell(oldmesh); !cell.end(); ++cell)
+  {
+    if ((*cell).is_ghost())
+    {
+      continue;
+    }
+    const std::size_t globalindex = (*cell).global_index();
+    std::vector<double> &send_values_p = send_values[dolfin::MPI::index_owner(mpi_comm, globalindex, nglobalcells)];
+    send_values_p.push_back(globalindex);
+    const dolfin::ArrayView<const dolfin::la_index> cell_dofs = olddofmap.cell_dofs((*cell).index());
+    for (std::size_t f = 0; f < nfunctions; f++)
+    {
+      (*(*functions[f].first).vector()).get_local(values.data(), cell_dofs.size(), cell_dofs.data());
+      send_values_p.insert(send_values_p.end(), values.begin(), values.end());
+    }
+  }
+  dolfin::MPI::all_to_all(mpi_comm, send_values, receive_values);
+
+  std::map<std::size_t, std::vector<double> > block_values;          // the values in the block distribution (by global index)
+  for (std::size_t p = 0; p < nprocs; ++p)
+  {
+    const std::vector<double> &receive_values_p = receive_values[p];
+    for (std::size_t i = 0; i < receive_values_p.size(); i += blocksize+1)
+    {
+      block_values[(std::size_t) receive_values_p[i]].assign(receive_values_p.begin()+i+1, 
+                                                             receive_values_p.begin()+i+1+blocksize);
+    }
+  }
+
+  std::vector< std::vector<std::size_t> > send_indices(nprocs);      // request the values of every local cell on the new mesh
+  std::vector< std::vector<std::size_t> > receive_indices;
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell)
+  {
+    const std::size_t globalindex = (*cell).global_index();
+    send_indices[dolfin::MPI::index_owner(mpi_comm, globalindex, nglobalcells)].push_back(globalindex);
+  }
+  dolfin::MPI::all_to_all(mpi_comm, send_indices, receive_indices);
+
+  for (std::size_t p = 0; p < nprocs; ++p)                           // and reply with them in the order they were requested
+  {
+    send_values[p].clear();
+    for (std::vector<std::size_t>::const_iterator i_it = receive_indices[p].begin(); 
+                                                  i_it != receive_indices[p].end(); i_it++)
+    {
+      const std::vector<double> &cell_values = block_values.at(*i_it);
+      send_values[p].insert(send_values[p].end(), cell_values.begin(), cell_values.end());
+    }
+  }
+  dolfin::MPI::all_to_all(mpi_comm, send_values, receive_values);
+
+  std::vector<std::size_t> positions(nprocs, 0);                     // set the values, visiting the cells in the same order as
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell)         // the requests
+  {
+    const std::size_t p = dolfin::MPI::index_owner(mpi_comm, (*cell).global_index(), nglobalcells);
+    const double *cell_values = &receive_values[p][positions[p]];
+    positions[p] += blocksize;
+    const dolfin::ArrayView<const dolfin::la_index> cell_dofs = dofmap.cell_dofs((*cell).index());
+    for (std::size_t f = 0; f < nfunctions; f++)
+    {
+      (*(*functions[f].second).vector()).set_local(cell_values + f*ncelldofs, cell_dofs.size(), cell_dofs.data());
+    }
+  }
+
+  for (std::size_t f = 0; f < nfunctions; f++)
+  {
+    (*(*functions[f].second).vector()).apply("insert");
+    dolfin::as_type<dolfin::PETScVector>(*(*functions[f].second).vector()).update_ghost_values();
+  }
+}
+
+//*******************************************************************|************************************************************//
+// fill in the names of the ensemble members (if there are any) and apply the parameters of the first member
+//*******************************************************************|************************************************************//
+void SpudBucket::fill_ensemble_()
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  buffer.str(""); buffer << "/global_parameters/ensemble/member";
+  int nmembers = Spud::option_count(buffer.str());
+  if (nmembers == 0)
+  {
+    return;
+  }
+
+  if (Spud::have_option("/io/checkpointing"))                        // a checkpoint could only restart a single member
+  {
+    tf_err("Ensembles cannot be checkpointed.", "Select either an ensemble or checkpointing.");
+  }
+  if (Spud::have_option("/timestepping/walltime_limit"))             // the walltime is shared by all the members
+  {
+    tf_err("Ensembles cannot have a walltime limit.", "Select either an ensemble or a walltime limit.");
+  }
+  if ((Spud::option_count("/geometry/mesh/adaptivity")+              // the meshes are shared by all the members
+       Spud::option_count("/geometry/mesh/source/load_balancing")) > 0)
+  {
+    tf_err("Ensembles cannot be combined with mesh adaptivity or load balancing.", 
+           "Select either an ensemble or mesh adaptivity and load balancing.");
+  }
+
+  for (uint i = 0; i < nmembers; i++)
+  {
+    std::string membername;
+    buffer.str(""); buffer << "/global_parameters/ensemble/member[" << i << "]/name";
+    serr = Spud::get_option(buffer.str(), membername);
+    spud_err(buffer.str(), serr);
+
+    if (std::find(ensemble_.begin(), ensemble_.end(), membername) != ensemble_.end())
+    {
+      tf_err("Ensemble member names must be unique.", "Member name: %s", membername.c_str());
+    }
+    ensemble_.push_back(membername);
+  }
+
+  apply_ensemble_member_(0);
+}
+
+//*******************************************************************|************************************************************//
+// reset the bucket to its initial state (reusing the meshes, functionspaces, forms and solvers) and apply the parameters of the
+// given ensemble member
+//*******************************************************************|************************************************************//
+void SpudBucket::start_ensemble_member_(const uint &member)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  *timestep_count_ = 0;                                              // back to the start
+  *iteration_count_ = 0;
+  *current_time_ = start_time();
+  *old_time_ = start_time();
+
+  buffer.str(""); buffer << "/timestepping";
+  if (Spud::have_option(buffer.str()))
+  {
+    double timestep_value;                                           // the timestep may have been adapted by the previous member
+    buffer.str(""); 
+    buffer << "/timestepping/timestep/coefficient::Timestep/type::Constant/rank::Scalar/value::WholeMesh/constant";
+    serr = Spud::get_option(buffer.str(), timestep_value);
+    spud_err(buffer.str(), serr);
+    *(timestep_.second) = timestep_value;
+  }
+
+  double_ptr dumptimes[] = { visualization_dumptime_, statistics_dumptime_, 
+                             steadystate_dumptime_, detectors_dumptime_, 
+                             timestepadapt_time_ };
+  for (uint i = 0; i < 5; i++)
+  {
+    if (dumptimes[i])
+    {
+      *dumptimes[i] = start_time();
+    }
+  }
+  *visualization_count_ = 0;
+
+  apply_ensemble_member_(member);                                    // change the parameters before evaluating anything that
+                                                                     // depends on them
+
+  for (SystemBucket_it sys_it = systems_begin();                     // reevaluate the coefficient functions and initial
+                       sys_it != systems_end(); sys_it++)            // conditions
+  {
+    (*std::dynamic_pointer_cast< SpudSystemBucket >((*sys_it).second)).initialize_coefficient_functions();
+  }
+  for (SystemBucket_it sys_it = systems_begin(); 
+                       sys_it != systems_end(); sys_it++)
+  {
+    (*(*sys_it).second).evaluate_initial_fields();
+    for (SolverBucket_it s_it = (*(*sys_it).second).solvers_begin();  // a jacobian from the previous member shouldn't be reused
+                         s_it != (*(*sys_it).second).solvers_end(); s_it++)
+    {
+      (*(*s_it).second).discard_jacobian();
+    }
+  }
+
+  DiagnosticsFile_ptr files[] = { statfile_, detfile_,               // close the diagnostic files of the previous member
+                                  steadyfile_, convfile_ };
+  for (uint i = 0; i < 4; i++)
+  {
+    if (files[i])
+    {
+      (*files[i]).close();
+    }
+  }
+  open_diagnostics_();                                               // and open new ones for this member
+  for (SystemBucket_it sys_it = systems_begin();                     // as well as new solver convergence files
+                       sys_it != systems_end(); sys_it++)
+  {
+    for (SolverBucket_it s_it = (*(*sys_it).second).solvers_begin(); 
+                         s_it != (*(*sys_it).second).solvers_end(); s_it++)
+    {
+      (*(*s_it).second).reopen_diagnostics();
+    }
+  }
+
+  pvdfiles_.clear();
+  fill_visualization_();
+}
+
+//*******************************************************************|************************************************************//
+// run the python and set the constants of the given ensemble member, naming the output of the bucket after the member
+//*******************************************************************|************************************************************//
+void SpudBucket::apply_ensemble_member_(const uint &member)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+
+  std::stringstream memberpath;
+  memberpath << "/global_parameters/ensemble/member[" << member << "]";
+
+  buffer.str(""); buffer << memberpath.str() << "/python";
+  if (Spud::have_option(buffer.str()))
+  {
+    std::string function;
+    serr = Spud::get_option(buffer.str(), function);
+    spud_err(buffer.str(), serr);
+    (*GlobalPythonInstance::instance()).run(function);
+  }
+
+  buffer.str(""); buffer << memberpath.str() << "/constant";
+  int nconstants = Spud::option_count(buffer.str());
+  for (uint i = 0; i < nconstants; i++)
+  {
+    std::string uflsymbol;
+    buffer.str(""); buffer << memberpath.str() << "/constant[" << i << "]/name";
+    serr = Spud::get_option(buffer.str(), uflsymbol);
+    spud_err(buffer.str(), serr);
+
+    double value;
+    buffer.str(""); buffer << memberpath.str() << "/constant[" << i << "]";
+    serr = Spud::get_option(buffer.str(), value);
+    spud_err(buffer.str(), serr);
+
+    Constant_ptr constant = std::dynamic_pointer_cast< dolfin::Constant >(fetch_uflsymbol(uflsymbol));
+    Constant_ptr oldconstant = std::dynamic_pointer_cast< dolfin::Constant >(fetch_uflsymbol(uflsymbol+"_n"));
+    if (!constant || !oldconstant || ((*constant).value_rank() != 0))
+    {
+      tf_err("Ensemble members can only set scalar constant coefficients.", 
+             "Member name: %s, ufl symbol: %s", ensemble_[member].c_str(), uflsymbol.c_str());
+    }
+    *constant = value;                                               // the iterated constant points at the current constant
+    *oldconstant = value;
+  }
+
+  std::string basename;
+  buffer.str(""); buffer << "/io/output_base_name";
+  serr = Spud::get_option(buffer.str(), basename); 
+  spud_err(buffer.str(), serr);
+  output_basename_ = basename+"_"+ensemble_[member];
+
+  log(INFO, "Applied parameters of ensemble member %s.", ensemble_[member].c_str());
+}
@@ -161,8 +161,18 @@ void SpudFunctionBucket::allocate_bcs()
     }
   }
 
-                                                                     // NOTE: this isn't strictly necessary here but we do it
-                                                                     // for consistency as these are basically bcs too
+}
+
+//*******************************************************************|************************************************************//
+// collect the reference point requests of this field so that the system can create them in a single batch
+//*******************************************************************|************************************************************//
+void SpudFunctionBucket::collect_reference_points(std::vector< std::vector<double> > &coords,
+                                                  std::vector< FunctionSpace_ptr > &functionspaces,
+                                                  std::vector< GenericFunction_ptr > &values,
+                                                  std::vector< std::string > &names)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+
   buffer.str(""); buffer << optionpath()                             // find out how many reference points bcs there are
                                 << "/type/rank/reference_point";
   int nrpoints = Spud::option_count(buffer.str());
@@ -172,7 +182,8 @@ void SpudFunctionBucket::allocate_bcs()
     {
       buffer.str(""); buffer << optionpath()
                     << "/type/rank/reference_point[" << i << "]";
-      fill_reference_point_(buffer.str());                           // and fill in details about the reference point
+      fill_reference_point_(buffer.str(), coords, functionspaces,    // and fill in details about the reference point
+                                                    values, names);
     }
   }
     
@@ -447,7 +458,7 @@ void SpudFunctionBucket::allocate_field_()
       changefunction_ = (*system_).changefunction();                 // the change in the function between timesteps
     }
 
-    residualfunction_ = (*system_).residualfunction();
+    residualfunction_ = (*system_).residualfunction();               // may be null if no output requires the residual
 
     if ((*system_).snesupdatefunction())
     {
@@ -472,8 +483,11 @@ void SpudFunctionBucket::allocate_field_()
                                               dolfin::NoDeleter() ); // and the change in the function between timesteps
     }
 
-    residualfunction_.reset( &(*(*system_).residualfunction())[index_],
-                                              dolfin::NoDeleter() );
+    if ((*system_).residualfunction())
+    {
+      residualfunction_.reset( &(*(*system_).residualfunction())[index_],
+                                              dolfin::NoDeleter() ); // and the residual (if any output requires it)
+    }
     if ((*system_).snesupdatefunction())
     {
       snesupdatefunction_.reset( &(*(*system_).snesupdatefunction())[index_], 
@@ -492,9 +506,12 @@ void SpudFunctionBucket::allocate_field_()
                                                          << name();  
   (*iteratedfunction_).rename(buffer.str(), buffer.str());
 
-  buffer.str(""); buffer << (*system_).name() << "::Residual"        // rename the residual function as SystemName::ResidualFieldName
-                                                         << name();  
-  (*residualfunction_).rename(buffer.str(), buffer.str());
+  if (residualfunction_)
+  {
+    buffer.str(""); buffer << (*system_).name() << "::Residual"      // rename the residual function as SystemName::ResidualFieldName
+                                                           << name();  
+    (*residualfunction_).rename(buffer.str(), buffer.str());
+  }
 
   if (include_in_steadystate())
   {
@@ -688,7 +705,11 @@ void SpudFunctionBucket::fill_bc_component_(const std::string &optionpath,
 //*******************************************************************|************************************************************//
 // fill the details of a reference point assuming the buckettools schema
 //*******************************************************************|************************************************************//
-void SpudFunctionBucket::fill_reference_point_(const std::string &optionpath)
+void SpudFunctionBucket::fill_reference_point_(const std::string &optionpath,
+                                               std::vector< std::vector<double> > &coords,
+                                               std::vector< FunctionSpace_ptr > &functionspaces,
+                                               std::vector< GenericFunction_ptr > &values,
+                                               std::vector< std::string > &names)
 {
   std::stringstream buffer;                                          // optionpath buffer
   Spud::OptionError serr;                                            // spud error code
@@ -731,17 +752,21 @@ void SpudFunctionBucket::fill_reference_point_(const std::string &optionpath)
       FunctionSpace_ptr subfunctionspace =                           // grab the subspace from the field functionspace
                                     (*functionspace())[*subcompid];  // happily dolfin caches this for us
        
-      ReferencePoint_ptr point(new ReferencePoint(coord, subfunctionspace, value));
       namebuffer.str(""); namebuffer << pointname << "::" 
                                  << *subcompid;                      // assemble a name incorporating the subcompid
-      register_referencepoint(point, namebuffer.str());              // register the point in the function bucket
+      coords.push_back(coord);                                       // request the point (the system creates and registers it)
+      functionspaces.push_back(subfunctionspace);
+      values.push_back(value);
+      names.push_back(namebuffer.str());
        
     }
   }
   else                                                               // no components (scalar or using all components)
   {                                                                  // this case is included because you can't index a scalar fs
-    ReferencePoint_ptr point(new ReferencePoint(coord, functionspace(), value));
-    register_referencepoint(point, pointname);                       // register the point in the function bucket
+    coords.push_back(coord);                                         // request the point (the system creates and registers it)
+    functionspaces.push_back(functionspace());
+    values.push_back(value);
+    names.push_back(pointname);
   }
 }
 
@@ -1260,6 +1285,17 @@ Expression_ptr SpudFunctionBucket::allocate_expression_(
       *time_dependent = (*std::dynamic_pointer_cast< PythonExpression >(expression)).time_dependent();
     }
 
+    buffer.str(""); buffer << pybuffer.str() << "/translate_to_cpp";
+    if (Spud::have_option(buffer.str()))                             // has this python been translated to cpp?
+    {
+      Expression_ptr cppexpression = translated_expression_(optionpath, 
+                                          expressionname, expression, time);
+      if (cppexpression)                                             // only use the translation if it exists and agrees with
+      {                                                              // the python, otherwise fall back on the interpreter
+        expression = cppexpression;
+      }
+    }
+
   }
   else if (Spud::have_option(funcbuffer.str()))                      // not much we can do for this case here
   {                                                                  // except check it's a scalar and declare a constant
@@ -1447,6 +1483,86 @@ Expression_ptr SpudFunctionBucket::allocate_expression_(
   
 }
 
+//*******************************************************************|************************************************************//
+// return the cpp translation of a python expression (from cpp_from_options) provided it exists and agrees with the python
+// expression at a sample of the mesh vertices, otherwise return a null pointer
+//*******************************************************************|************************************************************//
+Expression_ptr SpudFunctionBucket::translated_expression_(
+                                       const std::string &optionpath,
+                                       const std::string &expressionname,
+                                       const Expression_ptr pyexpression,
+                                       const double_ptr time)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud option error
+  Expression_ptr expression;                                         // declare the pointer that will be returned
+
+  std::string typestring;
+  buffer.str(""); buffer << optionpath << "/type";                   // work out what type this expression is
+  serr = Spud::get_option(buffer.str(), typestring); 
+  spud_err(buffer.str(), serr);
+
+  if (!cpp_has_expression((*system()).name(), name(), 
+                                      typestring, expressionname))   // the python used constructs that couldn't be translated
+  {
+    log(WARNING, "Python %s %s for %s::%s could not be translated to cpp.  Using the python interpreter.", 
+                  typestring.c_str(), expressionname.c_str(), (*system()).name().c_str(), name().c_str());
+    return expression;
+  }
+
+  expression = cpp_fetch_expression((*system()).name(), name(), 
+                                     typestring, expressionname, 
+                                     size(), shape_, 
+                                     (*system()).bucket(), 
+                                     system(), time);
+  cpp_init_expression(expression, (*system()).name(), name(), 
+                                   typestring, expressionname);
+
+  const dolfin::Mesh &mesh = *(*system()).mesh();
+  const std::size_t gdim = mesh.geometry().dim();
+  const std::size_t nsamples = 100;                                  // maximum number of vertices to check on each process
+  const std::size_t stride = std::max(mesh.num_vertices()/nsamples, (std::size_t)1);
+
+  dolfin::Array<double> x(gdim);
+  dolfin::Array<double> pyvalues((*pyexpression).value_size());
+  dolfin::Array<double> cppvalues((*expression).value_size());
+  ufc::cell cell;                                                    // translated expressions don't use the cell
+
+  int mismatch = (pyvalues.size()!=cppvalues.size());
+  for (std::size_t v = 0; v < mesh.num_vertices() && !mismatch; v += stride)
+  {
+    const dolfin::Vertex vertex(mesh, v);
+    for (std::size_t i = 0; i < gdim; i++)
+    {
+      x[i] = vertex.x(i);
+    }
+    (*pyexpression).eval(pyvalues, x);
+    (*expression).eval(cppvalues, x, cell);
+    for (std::size_t i = 0; i < pyvalues.size(); i++)
+    {
+      if (!(std::abs(cppvalues[i] - pyvalues[i]) <=                  // written so that nans count as a mismatch
+                            1.e-10*std::max(1.0, std::abs(pyvalues[i]))))
+      {
+        mismatch = 1;
+      }
+    }
+  }
+
+  if (dolfin::MPI::max(mesh.mpi_comm(), mismatch) > 0)               // make sure all processes make the same choice
+  {
+    log(WARNING, "Cpp translation of python %s %s for %s::%s disagrees with the python.  Using the python interpreter.", 
+                  typestring.c_str(), expressionname.c_str(), (*system()).name().c_str(), name().c_str());
+    expression.reset();
+  }
+  else
+  {
+    log(INFO, "Using the cpp translation of python %s %s for %s::%s.", 
+                  typestring.c_str(), expressionname.c_str(), (*system()).name().c_str(), name().c_str());
+  }
+
+  return expression;
+}
+
 //*******************************************************************|************************************************************//
 // take a reference to a function from an optionpath assuming the buckettools schema
 //*******************************************************************|************************************************************//
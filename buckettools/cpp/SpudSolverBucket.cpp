@@ -24,6 +24,8 @@
 #include "SpudSolverBucket.h"
 #include <dolfin.h>
 #include <string>
+#include <unordered_map>
+#include <algorithm>
 #include <spud>
 #include "SystemSolversWrapper.h"
 #include "SpudSystemBucket.h"
@@ -82,6 +84,9 @@ void SpudSolverBucket::initialize()
   std::stringstream prefix;                                          // prefix buffer
   prefix.str(""); prefix << (*system_).name() << "_" << name() << "_";
 
+  SolverBucket_ptr adapted =                                         // the solver we replace if we're rebuilding after a mesh adapt
+        (*(*system()).bucket()).adapted_solver((*system()).name(), name());
+
   if (type()=="SNES")                                                // if this is a snes solver.  FIXME: switch to enum check
   {
 
@@ -97,6 +102,21 @@ void SpudSolverBucket::initialize()
                                     FormFunction, (void *) &ctx_); 
     petsc_err(perr);
 
+    if (matrixfree_)                                                 // if the jacobian is applied matrix free then
+    {                                                                // its action is approximated by finite differencing the
+      Mat mfmatrix;                                                  // residual (equivalent to -snes_mf_operator)
+      perr = MatCreateSNESMF(snes_, &mfmatrix); petsc_err(perr);
+      perr = MatSetOptionsPrefix(mfmatrix, prefix.str().c_str());    // so the differencing parameters can be set from the command line
+      petsc_err(perr);
+      perr = MatSetFromOptions(mfmatrix); petsc_err(perr);
+      matrix_.reset(new dolfin::PETScMatrix(mfmatrix));              // dolfin takes its own reference to the matrix
+      #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR > 1
+      perr = MatDestroy(&mfmatrix); petsc_err(perr);
+      #else
+      perr = MatDestroy(mfmatrix); petsc_err(perr);
+      #endif
+    }
+
     if (bilinearpc_)                                                 // if we have a pc form
     {
       assert(matrixpc_);
@@ -338,9 +358,18 @@ void SpudSolverBucket::initialize()
         buffer.str(""); buffer << (*(*system()).bucket()).output_basename() << "_" 
                                << (*system()).name() << "_" 
                                << name() << "_snes.conv";
-        convfile_.reset( new ConvergenceFile(buffer.str(),
-                                      (*(*system_).mesh()).mpi_comm(),// allocate the file but don't write the header yet as the
-                                      &(*(*system()).bucket()), (*system()).name(), name()) ); // bucket isn't complete
+        if (adapted && (*adapted).convergence_file())                // rebuilding after a mesh adapt so keep appending to the
+        {                                                            // existing file
+          convfile_ = (*adapted).convergence_file();
+          (*convfile_).refresh_bucket();                             // but collect the fields of the new system
+        }
+        else
+        {
+          convfile_.reset( new ConvergenceFile(buffer.str(),
+                                        (*(*system_).mesh()).mpi_comm(),// allocate the file but don't write the header yet as the
+                                        &(*(*system()).bucket()), (*system()).name(), name(),    // bucket isn't complete
+                                        Spud::have_option(optionpath()+"/type/monitors/convergence_file/norms_only")) );
+        }
       }
       perr = SNESMonitorSet(snes_, SNESCustomMonitor,                // set a custom snes monitor
                                             &snesmctx_, PETSC_NULL); 
@@ -379,9 +408,18 @@ void SpudSolverBucket::initialize()
       buffer.str(""); buffer << (*(*system()).bucket()).output_basename() << "_" 
                              << (*system()).name() << "_" 
                              << name() << "_picard.conv";
-      convfile_.reset( new ConvergenceFile(buffer.str(), 
-                                    (*(*system_).mesh()).mpi_comm(), // allocate the file but don't write the header yet as the
-                                    &(*(*system()).bucket()), (*system()).name(), name()) );   // bucket isn't complete
+      if (adapted && (*adapted).convergence_file())                  // rebuilding after a mesh adapt so keep appending to the
+      {                                                              // existing file
+        convfile_ = (*adapted).convergence_file();
+        (*convfile_).refresh_bucket();                               // but collect the fields of the new system
+      }
+      else
+      {
+        convfile_.reset( new ConvergenceFile(buffer.str(), 
+                                      (*(*system_).mesh()).mpi_comm(),// allocate the file but don't write the header yet as the
+                                      &(*(*system()).bucket()), (*system()).name(), name(),      // bucket isn't complete
+                                      Spud::have_option(optionpath()+"/type/monitors/convergence_file/norms_only")) );
+      }
     }
 
     if (bilinearpc_)
@@ -594,6 +632,42 @@ void SpudSolverBucket::fill_base_()
                                 "/type/ignore_all_solver_failures";
   ignore_failures_ = Spud::have_option(buffer.str());
 
+  buffer.str(""); buffer << optionpath() << "/type/matrix_free";      // apply the jacobian matrix free (only applies to snes solver
+  matrixfree_ = Spud::have_option(buffer.str());                     // types)
+
+  jacobianreuse_ = JACOBIAN_REUSE_NEVER;                             // jacobian reuse policy (only applies to snes solver types)
+  jacobianlag_ = 1;
+  jacobianthreshold_ = 0.0;
+  jacobianassembled_ = false;
+  jacobianreused_ = false;
+  jacobiantimestep_ = 0;
+  jacobianfnorm_ = 0.0;
+  buffer.str(""); buffer << optionpath() << "/type/jacobian_reuse/lag_iterations";
+  if (Spud::have_option(buffer.str()))
+  {
+    jacobianreuse_ = JACOBIAN_REUSE_ITERATIONS;
+    serr = Spud::get_option(buffer.str(), jacobianlag_);
+    spud_err(buffer.str(), serr);
+  }
+  buffer.str(""); buffer << optionpath() << "/type/jacobian_reuse/lag_timesteps";
+  if (Spud::have_option(buffer.str()))
+  {
+    jacobianreuse_ = JACOBIAN_REUSE_TIMESTEPS;
+    serr = Spud::get_option(buffer.str(), jacobianlag_);
+    spud_err(buffer.str(), serr);
+  }
+  buffer.str(""); buffer << optionpath() << "/type/jacobian_reuse/adaptive/reduction_threshold";
+  if (Spud::have_option(buffer.str()))
+  {
+    jacobianreuse_ = JACOBIAN_REUSE_ADAPTIVE;
+    serr = Spud::get_option(buffer.str(), jacobianthreshold_);
+    spud_err(buffer.str(), serr);
+  }
+  if (jacobianlag_ < 1)
+  {
+    tf_err("Jacobian lag must be at least one.", "Solver: %s::%s", (*system()).name().c_str(), name_.c_str());
+  }
+
   iteration_count_.reset( new int );
   *iteration_count_ = 0;
 
@@ -674,6 +748,11 @@ void SpudSolverBucket::fill_forms_()
       buffer.str(""); buffer << optionpath() << "/type::SNES/form::JacobianPC/ident_zeros";
       ident_zeros_pc_ = Spud::have_option(buffer.str());
     }                                                                // otherwise bilinearpc_ is null (indicates self pcing)
+    else if (matrixfree_)                                            // unless the jacobian is being applied matrix free, in which
+    {                                                                // case the assembled jacobian becomes the pc matrix
+      bilinearpc_ = bilinear_;
+      ident_zeros_pc_ = ident_zeros_;
+    }
     residual_ = linear_;                                             // the linear form is the residual for SNES
 
   }
@@ -705,6 +784,7 @@ void SpudSolverBucket::fill_forms_()
     {
       register_solverform((*f_it).second, (*f_it).first);
       solverident_zeros_[(*f_it).first] = Spud::have_option(fetch_form_optionpath((*f_it).first)+"/ident_zeros");
+      solvervirtual_submatrices_[(*f_it).first] = Spud::have_option(fetch_form_optionpath((*f_it).first)+"/virtual_submatrix");
     }
   }
 
@@ -831,11 +911,14 @@ void SpudSolverBucket::initialize_tensors_()
   work_.reset( new dolfin::PETScVector(*std::dynamic_pointer_cast<dolfin::PETScVector>((*(*system_).function()).vector())) ); 
   (*work_).zero();
 
-  dolfin::SystemAssembler sysassembler(bilinear_, linear_, 
-                                    (*system_).bcs());
-  sysassembler.keep_diagonal = true;
-  matrix_.reset(new dolfin::PETScMatrix);                            // allocate the matrix
-  sysassembler.assemble(*matrix_);
+  if (!matrixfree_)                                                  // matrix free jacobians are allocated once the snes exists
+  {
+    dolfin::SystemAssembler sysassembler(bilinear_, linear_, 
+                                      (*system_).bcs());
+    sysassembler.keep_diagonal = true;
+    matrix_.reset(new dolfin::PETScMatrix);                          // allocate the matrix
+    sysassembler.assemble(*matrix_);
+  }
 
   if(bilinearpc_)                                                    // do we have a pc form?
   {
@@ -860,8 +943,11 @@ void SpudSolverBucket::initialize_tensors_()
 
   dolfin::Assembler assembler;
    
-  rhs_.reset(new dolfin::PETScVector);                               // allocate the rhs
-  assembler.assemble(*rhs_, *linear_);
+  if (type()=="Picard")                                              // only picard solvers assemble a separate rhs (snes assembles
+  {                                                                  // its residual directly into the petsc function vector)
+    rhs_.reset(new dolfin::PETScVector);                             // allocate the rhs
+    assembler.assemble(*rhs_, *linear_);
+  }
 
   res_.reset(new dolfin::PETScVector);                               // allocate the residual
   assembler.assemble(*res_, *residual_);
@@ -1023,9 +1109,20 @@ void SpudSolverBucket::fill_ksp_(const std::string &optionpath, KSP &ksp,
         buffer.str(""); buffer << (*(*system()).bucket()).output_basename() << "_" 
                                << (*system()).name() << "_" 
                                << name() << "_ksp.conv";
-        kspconvfile_.reset( new KSPConvergenceFile(buffer.str(), 
-                                      (*(*system_).mesh()).mpi_comm(), // allocate the file but don't write the header yet as the
-                                      &(*(*system()).bucket()), (*system()).name(), name()) );   // bucket isn't complete
+        SolverBucket_ptr adapted = 
+              (*(*system()).bucket()).adapted_solver((*system()).name(), name());
+        if (adapted && (*adapted).ksp_convergence_file())            // rebuilding after a mesh adapt so keep appending to the
+        {                                                            // existing file
+          kspconvfile_ = (*adapted).ksp_convergence_file();
+          (*kspconvfile_).refresh_bucket();                          // but collect the fields of the new system
+        }
+        else
+        {
+          kspconvfile_.reset( new KSPConvergenceFile(buffer.str(), 
+                                        (*(*system_).mesh()).mpi_comm(), // allocate the file but don't write the header yet as the
+                                        &(*(*system()).bucket()), (*system()).name(), name(),    // bucket isn't complete
+                                        Spud::have_option(optionpath+"/iterative_method/monitors/convergence_file/norms_only")) );
+        }
       }
       perr = KSPMonitorSet(ksp, KSPCustomMonitor, 
                                              &kspmctx_, PETSC_NULL); 
@@ -1115,6 +1212,11 @@ void SpudSolverBucket::fill_pc_(const std::string &optionpath, PC &pc,
                                                   parent_indices);   // fill the fieldsplit data (will end up back here again
                                                                      // eventually)
   }
+  else if (preconditioner=="mg")                                     // if the pc is geometric multigrid
+  {
+    buffer.str(""); buffer << optionpath << "/preconditioner";
+    fill_pc_mg_(buffer.str(), pc, parent_offset, parent_indices);    // build the mesh hierarchy and interpolation operators
+  }
   else if (preconditioner=="lu")                                     // if the pc is direct
   {
     std::string factorization_package;                               // we get to choose a factorization package
@@ -1194,13 +1296,253 @@ void SpudSolverBucket::fill_pc_(const std::string &optionpath, PC &pc,
     #endif
   }
 
-  if ((preconditioner=="ml")||(preconditioner=="gamg"))
+  if ((preconditioner=="ml")||(preconditioner=="gamg")||
+                                          (preconditioner=="mg"))
   {
     perr = PCSetUp(pc); petsc_err(perr);                               // need to call this to prevent seg fault on kspview
   }                                                                  // BUT it has to happen after the near null space is set
 
 }
 
+//*******************************************************************|************************************************************//
+// fill a pc object from the options tree assuming its a geometric multigrid pc
+//*******************************************************************|************************************************************//
+void SpudSolverBucket::fill_pc_mg_(const std::string &optionpath, 
+                                   PC &pc, 
+                                   const std::size_t &parent_offset,
+                                   const std::vector<std::size_t>* parent_indices)
+{
+  std::stringstream buffer;                                          // optionpath buffer
+  Spud::OptionError serr;                                            // spud error code
+  PetscErrorCode perr;                                               // petsc error code
+
+  const MPI_Comm comm = (*(*system_).mesh()).mpi_comm();
+
+  if ((*system_).periodicmap())
+  {
+    tf_err("Geometric multigrid preconditioner not available for periodic systems.", 
+           "System name: %s", (*system_).name().c_str());
+  }
+
+  std::string hierarchy;
+  buffer.str(""); buffer << optionpath << "/mesh_hierarchy/name";
+  serr = Spud::get_option(buffer.str(), hierarchy);
+  spud_err(buffer.str(), serr);
+
+  int number_levels;
+  buffer.str(""); buffer << optionpath << "/mesh_hierarchy/number_levels";
+  serr = Spud::get_option(buffer.str(), number_levels);
+  spud_err(buffer.str(), serr);
+  if (number_levels < 2)
+  {
+    tf_err("Geometric multigrid preconditioner needs at least 2 levels.", 
+           "number_levels: %d", number_levels);
+  }
+  const uint nlevels = number_levels;                                // now known to be positive
+
+  std::vector< Mesh_ptr > meshes;                                    // the coarse meshes (coarsest first) - the finest level is
+                                                                     // always the system mesh
+  if (hierarchy=="refine")
+  {
+    std::string meshname;
+    buffer.str(""); buffer << optionpath << "/mesh_hierarchy/coarse_mesh/name";
+    serr = Spud::get_option(buffer.str(), meshname);
+    spud_err(buffer.str(), serr);
+
+    Mesh_ptr mesh = (*(*system_).bucket()).fetch_mesh(meshname);
+    meshes.push_back(mesh);
+    for (uint l = 1; l < nlevels-1; l++)
+    {
+      mesh.reset( new dolfin::Mesh(dolfin::refine(*mesh)) );         // uniformly refine the previous level
+      meshes.push_back(mesh);
+    }
+  }
+  else if (hierarchy=="coarsen")
+  {
+    SpudBucket* bucket = dynamic_cast<SpudBucket*>((*system_).bucket());
+    assert(bucket);
+    for (uint l = nlevels-1; l > 0; l--)
+    {
+      meshes.push_back((*bucket).coarsen_mesh((*(*system_).mesh()).name(), 1 << l));
+    }
+  }
+  else
+  {
+    tf_err("Unknown mesh hierarchy for geometric multigrid preconditioner.", 
+           "Mesh hierarchy: %s", hierarchy.c_str());
+  }
+
+  FunctionSpace_ptr sysspace = (*system_).functionspace();
+  const std::pair<std::size_t, std::size_t> sysrange = 
+                                      (*(*sysspace).dofmap()).ownership_range();
+  const std::size_t blocksize = parent_indices ? (*parent_indices).size() : 
+                                      (sysrange.second - sysrange.first);
+  const std::size_t blockoffset = parent_indices ? parent_offset : sysrange.first;
+
+  FunctionBucket_ptr field;                                          // find the field that makes up this block
+  FunctionSpace_ptr finespace;                                       // and its (collapsed) functionspace on the system mesh
+  std::vector<PetscInt> finerows;                                    // the rows of the block corresponding to the owned dofs of
+                                                                     // the collapsed functionspace
+  for (FunctionBucket_const_it f_it = (*system_).fields_begin(); 
+                               f_it != (*system_).fields_end(); 
+                                                        f_it++)
+  {
+    FunctionSpace_ptr space;
+    std::unordered_map<std::size_t, std::size_t> collapsed_dofs;
+    if ((*system_).fields_size()==1)
+    {
+      space = sysspace;
+    }
+    else
+    {
+      space = (*(*(*f_it).second).functionspace()).collapse(collapsed_dofs);
+    }
+
+    const std::pair<std::size_t, std::size_t> range = 
+                                      (*(*space).dofmap()).ownership_range();
+    const std::size_t nowned = range.second - range.first;
+    std::vector<PetscInt> rows(nowned);
+    std::size_t nfound = 0;
+    for (std::size_t i = 0; i < nowned; i++)
+    {
+      const std::size_t dof = sysrange.first + 
+                    (((*system_).fields_size()==1) ? i : collapsed_dofs[i]);
+      if (parent_indices)
+      {
+        std::vector<std::size_t>::const_iterator pos = 
+                            std::lower_bound((*parent_indices).begin(), 
+                                             (*parent_indices).end(), dof);
+        if ((pos != (*parent_indices).end()) && (*pos == dof))
+        {
+          rows[i] = parent_offset + (pos - (*parent_indices).begin());
+          nfound++;
+        }
+      }
+      else
+      {
+        rows[i] = dof;
+        nfound++;
+      }
+    }
+
+    const int whole = ((nfound == nowned) && (nowned == blocksize)) ? 1 : 0;
+    if (dolfin::MPI::min(comm, whole)==1)
+    {
+      field = (*f_it).second;
+      finespace = space;
+      finerows = rows;
+      break;
+    }
+  }
+
+  if (!field)
+  {
+    tf_err("Geometric multigrid preconditioner must be applied to exactly one whole field.", 
+           "System name: %s, optionpath: %s", 
+           (*system_).name().c_str(), optionpath.c_str());
+  }
+
+  std::vector< FunctionSpace_ptr > spaces;                           // the (collapsed) field functionspaces on each level
+  for (std::vector< Mesh_ptr >::const_iterator m_it = meshes.begin(); 
+                                               m_it != meshes.end(); 
+                                               m_it++)
+  {
+    FunctionSpace_ptr space = ufc_fetch_functionspace((*system_).name(), *m_it, 
+                                                      PythonPeriodicMap_ptr(), 
+                                                      MeshFunction_size_t_ptr(),
+                                                      std::vector<std::size_t>(), 
+                                                      std::vector<std::size_t>());
+    if ((*system_).fields_size() > 1)
+    {
+      space = (*(*space)[(*field).index()]).collapse();
+    }
+    spaces.push_back(space);
+  }
+  spaces.push_back(finespace);
+
+  perr = PCMGSetLevels(pc, nlevels, PETSC_NULL); petsc_err(perr);
+  #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 8
+  perr = PCMGSetGalerkin(pc, PETSC_TRUE); petsc_err(perr);           // form the coarse operators by galerkin projection
+  #else
+  perr = PCMGSetGalerkin(pc, PC_MG_GALERKIN_BOTH); petsc_err(perr);  // form the coarse operators by galerkin projection
+  #endif
+
+  buffer.str(""); buffer << optionpath << "/w_cycle";
+  if (Spud::have_option(buffer.str()))
+  {
+    perr = PCMGSetCycleType(pc, PC_MG_CYCLE_W); petsc_err(perr);
+  }
+
+  for (uint l = 1; l < nlevels; l++)                                 // interpolation from level l-1 to level l
+  {
+    std::shared_ptr<dolfin::PETScMatrix> transfer = 
+          dolfin::PETScDMCollection::create_transfer_matrix(*spaces[l-1], *spaces[l]);
+
+    if (l < nlevels-1)
+    {
+      perr = PCMGSetInterpolation(pc, l, (*transfer).mat()); petsc_err(perr);
+      continue;
+    }
+
+    Mat T = (*transfer).mat();                                       // on the finest level the rows of the interpolation have to
+    PetscInt rstart, rend, cstart, cend;                             // be renumbered from the collapsed functionspace to the rows
+    perr = MatGetOwnershipRange(T, &rstart, &rend); petsc_err(perr); // of this block
+    perr = MatGetOwnershipRangeColumn(T, &cstart, &cend); petsc_err(perr);
+    assert((std::size_t)(rend-rstart) == finerows.size());
+
+    std::vector<PetscInt> dnnz(blocksize, 0), onnz(blocksize, 0);
+    PetscInt ncols;
+    const PetscInt *cols;
+    const PetscScalar *vals;
+    for (PetscInt r = rstart; r < rend; r++)
+    {
+      perr = MatGetRow(T, r, &ncols, &cols, PETSC_NULL); petsc_err(perr);
+      for (PetscInt c = 0; c < ncols; c++)
+      {
+        if ((cols[c] >= cstart) && (cols[c] < cend))
+        {
+          dnnz[finerows[r-rstart]-blockoffset]++;
+        }
+        else
+        {
+          onnz[finerows[r-rstart]-blockoffset]++;
+        }
+      }
+      perr = MatRestoreRow(T, r, &ncols, &cols, PETSC_NULL); petsc_err(perr);
+    }
+
+    Mat P;
+    perr = MatCreate(comm, &P); petsc_err(perr);
+    perr = MatSetSizes(P, blocksize, cend-cstart, 
+                       PETSC_DETERMINE, PETSC_DETERMINE); petsc_err(perr);
+    perr = MatSetType(P, MATAIJ); petsc_err(perr);
+    perr = MatSeqAIJSetPreallocation(P, 0, dnnz.data()); petsc_err(perr);
+    perr = MatMPIAIJSetPreallocation(P, 0, dnnz.data(), 
+                                        0, onnz.data()); petsc_err(perr);
+
+    for (PetscInt r = rstart; r < rend; r++)
+    {
+      perr = MatGetRow(T, r, &ncols, &cols, &vals); petsc_err(perr);
+      perr = MatSetValues(P, 1, &finerows[r-rstart], ncols, cols, vals, 
+                                              INSERT_VALUES); petsc_err(perr);
+      perr = MatRestoreRow(T, r, &ncols, &cols, &vals); petsc_err(perr);
+    }
+    perr = MatAssemblyBegin(P, MAT_FINAL_ASSEMBLY); petsc_err(perr);
+    perr = MatAssemblyEnd(P, MAT_FINAL_ASSEMBLY); petsc_err(perr);
+
+    perr = PCMGSetInterpolation(pc, l, P); petsc_err(perr);          // the pc takes its own reference
+    perr = MatDestroy(&P); petsc_err(perr);
+  }
+
+  if (dolfin::MPI::rank(comm)==0)
+  {
+    log(INFO, "Geometric multigrid on field %s of system %s: %d levels (%s), coarsest level has %d dofs.", 
+              (*field).name().c_str(), (*system_).name().c_str(), (int) nlevels, 
+              hierarchy.c_str(), (int) (*spaces[0]).dim());
+  }
+
+}
+
 //*******************************************************************|************************************************************//
 // fill a pc object from the options tree assuming its a fieldsplit pc
 //*******************************************************************|************************************************************//
@@ -1439,7 +1781,18 @@ void SpudSolverBucket::fill_pc_fieldsplit_(const std::string &optionpath,
       solverindexsets_[prefix+"SchurPC"] = is;
 
       Mat submatrix;
-      perr = MatGetSubMatrix((*solvermatrices_[prefix+"SchurPC"]).mat(), is, is, MAT_INITIAL_MATRIX, &submatrix);
+      if (solvervirtual_submatrices_[prefix+"SchurPC"])
+      {                                                              // create a view of the block that references the solver matrix
+        #if PETSC_VERSION_MAJOR == 3 && PETSC_VERSION_MINOR < 8      // directly, avoiding a copy each time it's reassembled
+        perr = MatCreateSubMatrix((*solvermatrices_[prefix+"SchurPC"]).mat(), is, is, &submatrix);
+        #else
+        perr = MatCreateSubMatrixVirtual((*solvermatrices_[prefix+"SchurPC"]).mat(), is, is, &submatrix);
+        #endif
+      }
+      else
+      {                                                              // otherwise copy the block out of the solver matrix
+        perr = MatGetSubMatrix((*solvermatrices_[prefix+"SchurPC"]).mat(), is, is, MAT_INITIAL_MATRIX, &submatrix);
+      }
       petsc_err(perr);
 
       solversubmatrices_[prefix+"SchurPC"] = submatrix;
@@ -101,13 +101,27 @@ void SpudSystemBucket::allocate_coeff_function()
 //*******************************************************************|************************************************************//
 void SpudSystemBucket::allocate_bcs()
 {
+  std::vector< std::vector<double> > coords;                         // reference point requests from all fields so that they can
+  std::vector< FunctionSpace_ptr > functionspaces;                   // be located together (one pass and one collective)
+  std::vector< GenericFunction_ptr > values;
+  std::vector< std::string > names;
+  std::vector< FunctionBucket_ptr > pointfields;                     // the field each requested point belongs to
 
   for (FunctionBucket_it f_it = fields_begin(); f_it != fields_end();
                                                               f_it++)
   {
-    (*(std::dynamic_pointer_cast< SpudFunctionBucket >((*f_it).second))).allocate_bcs();
+    SpudFunctionBucket_ptr field = std::dynamic_pointer_cast< SpudFunctionBucket >((*f_it).second);
+    (*field).allocate_bcs();
+    (*field).collect_reference_points(coords, functionspaces, values, names);
+    pointfields.resize(coords.size(), (*f_it).second);
   } 
 
+  std::vector< ReferencePoint_ptr > points = ReferencePoint::create(coords, functionspaces, values);
+  for (uint i = 0; i < points.size(); i++)
+  {
+    (*pointfields[i]).register_referencepoint(points[i], names[i]);  // register the point in its function bucket
+  }
+
   fill_bcs_();                                                       // fill in data about the bcs relative to the system (includes
                                                                      // periodic)
 
@@ -245,6 +259,72 @@ void SpudSystemBucket::fill_base_()
 
   change_calculated_.reset( new bool(false) );                       // assume the change hasn't been calculated yet
 
+  buffer.str(""); buffer << optionpath() << "/multirate/solve_period_in_timesteps";
+  if (Spud::have_option(buffer.str()))                               // only solve this system every few timesteps?
+  {
+    serr = Spud::get_option(buffer.str(), solveperiod_); 
+    spud_err(buffer.str(), serr);
+    if (solveperiod_ < 1)
+    {
+      tf_err("Solve period must be at least one timestep.", "SystemBucket name: %s", name_.c_str());
+    }
+  }
+
+  buffer.str(""); buffer << optionpath() << "/multirate/subcycles";
+  if (Spud::have_option(buffer.str()))                               // take several substeps per timestep?
+  {
+    serr = Spud::get_option(buffer.str(), subcycles_); 
+    spud_err(buffer.str(), serr);
+    if (subcycles_ < 1)
+    {
+      tf_err("Number of subcycles must be at least one.", "SystemBucket name: %s", name_.c_str());
+    }
+  }
+
+}
+
+//*******************************************************************|************************************************************//
+// return true if any diagnostic output or monitor of this system (or of all systems) requires the residual function
+//*******************************************************************|************************************************************//
+const bool SpudSystemBucket::residual_required_() const
+{
+  if ((Spud::option_count(optionpath()+"/field/diagnostics/include_in_statistics")+
+       Spud::option_count(optionpath()+"/field/diagnostics/include_residual_in_visualization"))>0)
+  {
+    return true;
+  }
+
+  if (Spud::have_option("/nonlinear_systems/monitors/visualization") ||
+      Spud::have_option("/nonlinear_systems/monitors/convergence_file"))
+  {
+    return true;
+  }
+
+  int nmeshes = Spud::option_count("/geometry/mesh");
+  for (uint i = 0; i < nmeshes; i++)                                 // mesh adaptivity driven by the residual of a field in this
+  {                                                                  // system
+    std::stringstream buffer;
+    buffer.str(""); buffer << "/geometry/mesh[" << i << "]/adaptivity/error_indicator::residual/system::" << name();
+    if (Spud::have_option(buffer.str()))
+    {
+      return true;
+    }
+  }
+
+  int nsolvers = Spud::option_count(optionpath()+"/nonlinear_solver");
+  for (uint i = 0; i < nsolvers; i++)                                // snes, picard and (possibly nested) ksp monitors
+  {
+    std::stringstream buffer;
+    buffer.str(""); buffer << optionpath() << "/nonlinear_solver[" << i << "]";
+    if (spud_have_descendant(buffer.str(), "monitors/visualization") ||  // norms only convergence files don't need the residual
+        (spud_count_descendants(buffer.str(), "monitors/convergence_file") > 
+         spud_count_descendants(buffer.str(), "monitors/convergence_file/norms_only")))
+    {
+      return true;
+    }
+  }
+
+  return false;
 }
 
 //*******************************************************************|************************************************************//
@@ -280,17 +360,26 @@ void SpudSystemBucket::fill_systemfunction_()
   buffer.str(""); buffer << name() << "::IteratedFunction";
   (*iteratedfunction_).rename( buffer.str(), buffer.str() );
 
-  changefunction_.reset( new dolfin::Function(functionspace_) );     // declare the change in the function between timesteps
-  buffer.str(""); buffer << name() << "::TimestepChange";
-  (*changefunction_).rename( buffer.str(), buffer.str() );
+  if (Spud::option_count(optionpath()+"/field/diagnostics/include_in_steady_state")>0)
+  {                                                                  // only needed if a field is checked for steady state
+    changefunction_.reset( new dolfin::Function(functionspace_) );   // declare the change in the function between timesteps
+    buffer.str(""); buffer << name() << "::TimestepChange";
+    (*changefunction_).rename( buffer.str(), buffer.str() );
+  }
 
-  residualfunction_.reset( new dolfin::Function(functionspace_) );   // declare the residual of the system as a function
-  buffer.str(""); buffer << name() << "::Residual";
-  (*residualfunction_).rename( buffer.str(), buffer.str() );
+  if (residual_required_())                                          // only needed if some diagnostic or monitor outputs it
+  {
+    log(INFO, "Allocating a copy of the residual of system %s for output.", name().c_str());
+    residualfunction_.reset( new dolfin::Function(functionspace_) ); // declare the residual of the system as a function
+    buffer.str(""); buffer << name() << "::Residual";
+    (*residualfunction_).rename( buffer.str(), buffer.str() );
+  }
 
   if ((Spud::option_count(optionpath()+"/nonlinear_solver/type::SNES/monitors/visualization")+
-       Spud::option_count(optionpath()+"/nonlinear_solver/type::SNES/monitors/convergence_file"))>0)
-  {
+       Spud::option_count(optionpath()+"/nonlinear_solver/type::SNES/monitors/convergence_file")-
+       Spud::option_count(optionpath()+"/nonlinear_solver/type::SNES/monitors/convergence_file/norms_only"))>0)
+  {                                                                  // norms only convergence files don't need the update copied
+    log(INFO, "Allocating a copy of the snes update of system %s for output.", name().c_str());
     snesupdatefunction_.reset( new dolfin::Function(functionspace_) );
     buffer.str(""); buffer << name() << "::SNESUpdateFunction";
     (*snesupdatefunction_).rename( buffer.str(), buffer.str() );
@@ -430,6 +519,11 @@ void SpudSystemBucket::fill_periodicbcs_()
 
   }
 
+  if (periodicmap() && facetdomains())                               // map all the slave coordinates up front (or fetch them from
+  {                                                                  // the cache) rather than once per call from dolfin
+    (*periodicmap_).prepare(*mesh(), *facetdomains(), masterids(), slaveids());
+  }
+
   buffer.str("");  buffer << "/io/debugging/periodic_boundaries";  // output debugging info?
   if (Spud::have_option(buffer.str()) && periodicmap())
   {
@@ -461,12 +555,14 @@ void SpudSystemBucket::fill_bcs_()
           b_it != (*(*f_it).second).dirichletbcs_end(); b_it++)
     {
       bcs_.push_back((*b_it).second);                   // add the bcs to a std vector
+      bcpoints_.push_back(ReferencePoint_ptr());
     }
     for (ReferencePoint_const_it                                    // loop over all the points
           p_it = (*(*f_it).second).referencepoints_begin(); 
           p_it != (*(*f_it).second).referencepoints_end(); p_it++)
     {
       bcs_.push_back((*p_it).second);                    // add the point to a std vector
+      bcpoints_.push_back((*p_it).second);                           // and remember it so vectors can be set directly
     }
   }
 
@@ -25,6 +25,7 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <sys/resource.h>
 #include <dolfin.h>
 
 using namespace buckettools;
@@ -34,7 +35,12 @@ using namespace buckettools;
 //*******************************************************************|************************************************************//
 StatisticsFile::StatisticsFile(const std::string &name, 
                                const MPI_Comm &comm, 
-                               const Bucket *bucket) : DiagnosticsFile(name, comm, bucket)
+                               const Bucket *bucket,
+                               const bool &memory,
+                               const bool &dofs,
+                               const bool &retries) : DiagnosticsFile(name, comm, bucket),
+                                                      memory_(memory), dofs_(dofs), 
+                                                      retries_(retries)
 {
                                                                      // do nothing... all handled by DiagnosticsFile constructor
 }
@@ -55,6 +61,14 @@ void StatisticsFile::write_header()
   header_open_();
   header_constants_();                                               // write constant tags
   header_timestep_();                                                // write tags for the timesteps
+  if (memory_)
+  {
+    tag_("PeakResidentMemory", "value");                             // the peak resident memory (summed over processes)
+  }
+  if (retries_)
+  {
+    tag_("TimestepRetries", "value");                                // the number of times the last timestep was retried
+  }
   header_bucket_();                                                  // write tags for the actual bucket variables - fields etc.
   header_close_();
 }
@@ -66,18 +80,55 @@ void StatisticsFile::write_data()
 {
   
   data_timestep_();                                                 // write the timestepping information
+  if (memory_)
+  {
+    data_memory_();                                                 // write the memory usage
+  }
+  if (retries_)
+  {
+    data_((*bucket_).timestep_retries());                           // write the number of retries of this timestep
+  }
   data_bucket_();                                                   // write the bucket data
   
   data_endlineflush_();
   
 }
 
+//*******************************************************************|************************************************************//
+// recollect the functions and functionals after the bucket systems have been rebuilt (without rewriting the header)
+//*******************************************************************|************************************************************//
+void StatisticsFile::refresh_bucket()
+{
+  const uint ncolumns = ncolumns_;                                   // header_bucket_ counts the columns again so reset them after
+  functions_.clear();
+  functionals_.clear();
+
+  quiet_ = true;
+  header_bucket_();
+  quiet_ = false;
+
+  ncolumns_ = ncolumns;
+}
+
 //*******************************************************************|************************************************************//
 // write a header for the model systems, fields and coefficients in the given bucket
 //*******************************************************************|************************************************************//
 void StatisticsFile::header_bucket_()
 {
 
+  if (dofs_)
+  {
+    for (SystemBucket_it sys_it = (*bucket_).systems_begin();        // loop over the systems writing their number of degrees of
+                         sys_it != (*bucket_).systems_end();         // freedom (which changes if the mesh is adapted)
+                         sys_it++)
+    {
+      if ((*(*sys_it).second).fields_size() > 0)
+      {
+        tag_("NumberDofs", "value", (*(*sys_it).second).name());
+      }
+    }
+  }
+
   for (SystemBucket_it sys_it = (*bucket_).systems_begin();          // loop over the systems
                        sys_it != (*bucket_).systems_end(); 
                        sys_it++)
@@ -178,6 +229,19 @@ void StatisticsFile::header_functional_(FunctionalBucket_ptr f_ptr)
 void StatisticsFile::data_bucket_()
 {
   
+  if (dofs_)
+  {
+    for (SystemBucket_const_it sys_it = (*bucket_).systems_begin();  // loop over the systems
+                               sys_it != (*bucket_).systems_end(); 
+                               sys_it++)
+    {
+      if ((*(*sys_it).second).fields_size() > 0)
+      {
+        data_((int) (*(*(*sys_it).second).functionspace()).dim());
+      }
+    }
+  }
+
   for (std::vector< FunctionBucket_ptr >::iterator f_it = functions_.begin(); f_it != functions_.end(); f_it++)
   {
     data_func_(*f_it);
@@ -190,6 +254,21 @@ void StatisticsFile::data_bucket_()
 
 }
 
+//*******************************************************************|************************************************************//
+// write the peak resident memory (in kilobytes) of this simulation, summed over all processes
+//*******************************************************************|************************************************************//
+void StatisticsFile::data_memory_()
+{
+  struct rusage usage;
+  double maxrss = 0.0;
+  if (getrusage(RUSAGE_SELF, &usage)==0)
+  {
+    maxrss = static_cast<double>(usage.ru_maxrss);
+  }
+  maxrss = dolfin::MPI::sum(mpicomm_, maxrss);                       // collective so must be called on all processes
+  data_(maxrss);
+}
+
 //*******************************************************************|************************************************************//
 // write data for a function
 //*******************************************************************|************************************************************//
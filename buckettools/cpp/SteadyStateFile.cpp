@@ -72,6 +72,22 @@ void SteadyStateFile::write_data()
   
 }
 
+//*******************************************************************|************************************************************//
+// recollect the functions and functionals after the bucket systems have been rebuilt (without rewriting the header)
+//*******************************************************************|************************************************************//
+void SteadyStateFile::refresh_bucket()
+{
+  const uint ncolumns = ncolumns_;                                   // header_bucket_ counts the columns again so reset them after
+  functions_.clear();
+  functionals_.clear();
+
+  quiet_ = true;
+  header_bucket_();
+  quiet_ = false;
+
+  ncolumns_ = ncolumns;
+}
+
 //*******************************************************************|************************************************************//
 // write a header for the model systems, fields and coefficients in the given bucket
 //*******************************************************************|************************************************************//
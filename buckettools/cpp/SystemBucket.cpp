@@ -34,7 +34,7 @@ using namespace buckettools;
 //*******************************************************************|************************************************************//
 // default constructor
 //*******************************************************************|************************************************************//
-SystemBucket::SystemBucket()
+SystemBucket::SystemBucket() : solveperiod_(1), lastsolvetime_(0.0), subcycles_(1), subcycletimestep_(-1)
 {
                                                                      // do nothing
 }
@@ -42,7 +42,8 @@ SystemBucket::SystemBucket()
 //*******************************************************************|************************************************************//
 // specific constructor
 //*******************************************************************|************************************************************//
-SystemBucket::SystemBucket(Bucket* bucket) : bucket_(bucket)
+SystemBucket::SystemBucket(Bucket* bucket) : bucket_(bucket), solveperiod_(1), lastsolvetime_(0.0),
+                                             subcycles_(1), subcycletimestep_(-1)
 {
                                                                      // do nothing
 }
@@ -88,6 +89,11 @@ bool SystemBucket::solve(const std::vector<int> &locations, const bool force)
   for (SolverBucket_const_it s_it = solvers_begin(); 
                              s_it != solvers_end(); s_it++)
   {
+    if ((*bucket()).solve_failed())                                  // a solver has failed so this attempt at the timestep will be
+    {                                                                // rolled back
+      break;
+    }
+
     bool solve = true;
     if (!locations.empty())
     {
@@ -101,7 +107,10 @@ bool SystemBucket::solve(const std::vector<int> &locations, const bool force)
 
       postprocess_values();
 
-      (*(*residualfunction_).vector()) = (*std::dynamic_pointer_cast< dolfin::GenericVector >((*(*s_it).second).residual_vector()));
+      if (residualfunction_)                                         // only allocated if some output requires it
+      {
+        (*(*residualfunction_).vector()) = (*std::dynamic_pointer_cast< dolfin::GenericVector >((*(*s_it).second).residual_vector()));
+      }
       // update_nonlinear...
 
       solved = true;
@@ -111,6 +120,105 @@ bool SystemBucket::solve(const std::vector<int> &locations, const bool force)
   return solved;
 }
 
+//*******************************************************************|************************************************************//
+// return a boolean indicating if this system is solved in the timeloop during the given timestep
+//*******************************************************************|************************************************************//
+const bool SystemBucket::solve_in_timestep(const int &timestep_count) const
+{
+  return ((timestep_count-1)%solveperiod_)==0;                       // solve in the first timestep and every solveperiod_ after that
+}
+
+//*******************************************************************|************************************************************//
+// store the old system function the first time we subcycle in a timestep and restore it on subsequent nonlinear systems iterations
+// (the substeps overwrite it)
+//*******************************************************************|************************************************************//
+void SystemBucket::start_subcycling(const int &timestep_count)
+{
+  if (!function_)
+  {
+    return;
+  }
+
+  if (!subcycleoldfunction_)
+  {
+    subcycleoldfunction_.reset( new dolfin::Function(*oldfunction_) );
+    subcycletimestep_ = timestep_count;
+  }
+  else if (subcycletimestep_ != timestep_count)
+  {
+    (*(*subcycleoldfunction_).vector()) = (*(*oldfunction_).vector());
+    subcycletimestep_ = timestep_count;
+  }
+  else
+  {
+    (*(*oldfunction_).vector()) = (*(*subcycleoldfunction_).vector());
+  }
+}
+
+//*******************************************************************|************************************************************//
+// restore the old system function to its value at the start of the timestep after the substeps (which overwrite it) so that other
+// systems, the steady state check and any output see the old value of the whole timestep
+//*******************************************************************|************************************************************//
+void SystemBucket::finish_subcycling()
+{
+  if (!function_)
+  {
+    return;
+  }
+
+  assert(subcycleoldfunction_);
+  (*(*oldfunction_).vector()) = (*(*subcycleoldfunction_).vector());
+}
+
+//*******************************************************************|************************************************************//
+// keep a copy of the time levels of the system function in memory so that a failed timestep can be rolled back
+//*******************************************************************|************************************************************//
+void SystemBucket::snapshot()
+{
+  if (!function_)
+  {
+    return;
+  }
+
+  if (!snapshotfunction_ ||                                           // reallocate if the mesh has been adapted or redistributed
+      ((*snapshotfunction_).function_space() != (*function_).function_space()))
+  {
+    snapshotfunction_.reset( new dolfin::Function(*function_) );
+    snapshotoldfunction_.reset( new dolfin::Function(*oldfunction_) );
+    snapshotiteratedfunction_.reset( new dolfin::Function(*iteratedfunction_) );
+  }
+  else
+  {
+    (*(*snapshotfunction_).vector()) = (*(*function_).vector());
+    (*(*snapshotoldfunction_).vector()) = (*(*oldfunction_).vector());
+    (*(*snapshotiteratedfunction_).vector()) = (*(*iteratedfunction_).vector());
+  }
+}
+
+//*******************************************************************|************************************************************//
+// restore the time levels of the system function from the snapshot taken at the start of the timestep
+//*******************************************************************|************************************************************//
+void SystemBucket::rollback()
+{
+  if (!function_)
+  {
+    return;
+  }
+
+  assert(snapshotfunction_);
+  (*(*function_).vector()) = (*(*snapshotfunction_).vector());       // fields share a vector with the system function so this
+  (*(*oldfunction_).vector()) = (*(*snapshotoldfunction_).vector()); // restores them too
+  (*(*iteratedfunction_).vector()) = (*(*snapshotiteratedfunction_).vector());
+
+  for (SolverBucket_it s_it = solvers_begin();                       // a jacobian from the failed attempt shouldn't be reused
+                       s_it != solvers_end(); s_it++)
+  {
+    (*(*s_it).second).discard_jacobian();
+  }
+
+  resetcalculated();
+}
+
 //*******************************************************************|************************************************************//
 // update the timelevels of the system function
 //*******************************************************************|************************************************************//
@@ -120,6 +228,11 @@ void SystemBucket::update()
   {
     (*(*oldfunction_).vector()) = (*(*function_).vector());          // update the oldfunction to the new function value
   }
+
+  if (solve_in_timestep((*bucket()).timestep_count()))               // remember when this system was last solved (the old value
+  {                                                                  // of a multirate system is from then)
+    lastsolvetime_ = (*bucket()).current_time();
+  }
   
                                                                      // fields share a vector with the system function so no need to
                                                                      // update them...
@@ -307,7 +420,10 @@ double SystemBucket::residual_norm(const std::vector<int> &locations)
     {
       norm = (*(*s_it).second).residual_norm();
 
-      (*(*residualfunction_).vector()) = (*std::dynamic_pointer_cast< dolfin::GenericVector >((*(*s_it).second).residual_vector()));
+      if (residualfunction_)
+      {
+        (*(*residualfunction_).vector()) = (*std::dynamic_pointer_cast< dolfin::GenericVector >((*(*s_it).second).residual_vector()));
+      }
     }
   }
 
@@ -782,6 +898,44 @@ std::vector< std::shared_ptr<const dolfin::DirichletBC> >::const_iterator System
   return bcs_.end();
 }
 
+//*******************************************************************|************************************************************//
+// apply the system bcs to the vector b, setting reference points directly rather than through a pointwise search
+//*******************************************************************|************************************************************//
+void SystemBucket::apply_bcs(dolfin::GenericVector &b) const
+{
+  assert(bcpoints_.size()==bcs_.size());
+  for (uint i = 0; i < bcs_.size(); i++)
+  {
+    if (bcpoints_[i])
+    {
+      (*bcpoints_[i]).apply_point(b);
+    }
+    else
+    {
+      (*bcs_[i]).apply(b);
+    }
+  }
+}
+
+//*******************************************************************|************************************************************//
+// apply the system bcs to the residual vector b given the iterate x, setting reference points directly
+//*******************************************************************|************************************************************//
+void SystemBucket::apply_bcs(dolfin::GenericVector &b, const dolfin::GenericVector &x) const
+{
+  assert(bcpoints_.size()==bcs_.size());
+  for (uint i = 0; i < bcs_.size(); i++)
+  {
+    if (bcpoints_[i])
+    {
+      (*bcpoints_[i]).apply_point(b, x);
+    }
+    else
+    {
+      (*bcs_[i]).apply(b, x);
+    }
+  }
+}
+
 //*******************************************************************|************************************************************//
 // loop over the fields outputting pvd diagnostics for all the fields in this system
 //*******************************************************************|************************************************************//
@@ -941,6 +1095,42 @@ const std::string SystemBucket::solvers_str(const int &indent) const
   return s.str();
 }
 
+//*******************************************************************|************************************************************//
+// return a string describing the (global) memory footprint of the vectors and matrices of the system
+//*******************************************************************|************************************************************//
+const std::string SystemBucket::memory_str(const int &indent) const
+{
+  std::stringstream s;
+  std::string indentation (indent*2, ' ');
+
+  std::vector< Function_ptr > functions;
+  functions.push_back(function_);
+  functions.push_back(oldfunction_);
+  functions.push_back(iteratedfunction_);
+  functions.push_back(changefunction_);
+  functions.push_back(residualfunction_);
+  functions.push_back(snesupdatefunction_);
+
+  std::size_t nvectors = 0;
+  double vectormemory = 0.0;
+  for (std::vector< Function_ptr >::const_iterator f_it = functions.begin(); f_it != functions.end(); f_it++)
+  {
+    if (*f_it)                                                       // only count functions that have been allocated
+    {
+      nvectors++;
+      vectormemory += (double)(*(**f_it).vector()).size()*sizeof(double);
+    }
+  }
+
+  s << indentation << "SystemBucket " << name() << ": " << nvectors << " function vectors, "
+                   << vectormemory/1048576.0 << " MB" << std::endl;
+  for ( SolverBucket_const_it s_it = solvers_begin(); s_it != solvers_end(); s_it++ )
+  {
+    s << (*(*s_it).second).memory_str(indent+1);
+  }
+  return s.str();
+}
+
 //*******************************************************************|************************************************************//
 // return a string describing the functionals in the system
 //*******************************************************************|************************************************************//
@@ -1056,13 +1246,9 @@ void SystemBucket::apply_ic_()
 //*******************************************************************|************************************************************//
 void SystemBucket::apply_bcs_()
 {
-  for (std::vector< std::shared_ptr<const dolfin::DirichletBC> >::const_iterator     // loop over all the bcs
-       b_it = bcs_begin(); b_it != bcs_end(); b_it++)
-  {
-    (**b_it).apply((*(*oldfunction_).vector()));
-    (**b_it).apply((*(*iteratedfunction_).vector()));
-    (**b_it).apply((*(*function_).vector()));
-  }
+  apply_bcs((*(*oldfunction_).vector()));
+  apply_bcs((*(*iteratedfunction_).vector()));
+  apply_bcs((*(*function_).vector()));
 }
 
 
@@ -78,6 +78,21 @@ void SystemsConvergenceFile::write_data(const double &norm)
   
 }
 
+//*******************************************************************|************************************************************//
+// recollect the systems and fields after the bucket systems have been rebuilt (without rewriting the header)
+//*******************************************************************|************************************************************//
+void SystemsConvergenceFile::refresh_bucket()
+{
+  const uint ncolumns = ncolumns_;                                   // header_bucket_ counts the columns again so reset them after
+  fields_.clear();
+
+  quiet_ = true;
+  header_bucket_();
+  quiet_ = false;
+
+  ncolumns_ = ncolumns;
+}
+
 //*******************************************************************|************************************************************//
 // write lines of the xml header for values relating to iterations
 //*******************************************************************|************************************************************//
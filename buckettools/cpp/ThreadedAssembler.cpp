@@ -0,0 +1,615 @@
+// Copyright (C) 2013 Columbia University in the City of New York and others.
+//
+// Please see the AUTHORS file in the main source directory for a full list
+// of contributors.
+//
+// This file is part of TerraFERMA.
+//
+// TerraFERMA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TerraFERMA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TerraFERMA. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "ThreadedAssembler.h"
+#include "Logger.h"
+#include <dolfin.h>
+#include <map>
+#ifdef HAS_OPENMP
+#include <omp.h>
+#endif
+
+using namespace buckettools;
+
+int ThreadedAssembler::num_threads_ = 1;                             // default to serial assembly
+std::set< std::size_t > ThreadedAssembler::record_meshes_;           // default to not recording costs on any mesh
+std::map< std::size_t, std::map< std::size_t, double > > ThreadedAssembler::costs_;
+
+//*******************************************************************|************************************************************//
+// default constructor
+//*******************************************************************|************************************************************//
+ThreadedAssembler::ThreadedAssembler() : dolfin::AssemblerBase()
+{
+                                                                     // do nothing
+}
+
+//*******************************************************************|************************************************************//
+// default destructor
+//*******************************************************************|************************************************************//
+ThreadedAssembler::~ThreadedAssembler()
+{
+                                                                     // do nothing
+}
+
+//*******************************************************************|************************************************************//
+// assemble the form a into the tensor A, threading the cell integrals if possible
+//*******************************************************************|************************************************************//
+void ThreadedAssembler::assemble(dolfin::GenericTensor &A, const dolfin::Form &a,
+                                 dolfin::CellFunction<double> *values,
+                                 dolfin::FacetFunction<double> *facetvalues)
+{
+  if (!threadable_(a, values, facetvalues))
+  {
+    dolfin::Assembler assembler;                                     // fall back on the serial dolfin assembler
+    assembler.add_values = add_values;
+    assembler.finalize_tensor = finalize_tensor;
+    assembler.keep_diagonal = keep_diagonal;
+    assembler.assemble(A, a, values, facetvalues);
+    return;
+  }
+
+  a.check();
+
+  dolfin::UFC ufc(a);
+  init_global_tensor(A, a);
+
+  assemble_cells_(A, a, ufc, values);                                // the threaded part
+
+  dolfin::Assembler assembler;                                       // everything else goes through the dolfin assembler
+  assembler.assemble_exterior_facets(A, a, ufc, a.exterior_facet_domains(), NULL);
+  assembler.assemble_interior_facets(A, a, ufc, a.interior_facet_domains(), a.cell_domains(), NULL);
+  assembler.assemble_vertices(A, a, ufc, a.vertex_domains());
+
+  if (finalize_tensor)
+  {
+    A.apply("add");
+  }
+}
+
+//*******************************************************************|************************************************************//
+// assemble the cell integrals of several functionals on the same mesh in a single threaded loop over the cells
+// as in assemble_cells_ the coefficients are restricted in serial and only the tabulation is threaded, the values returned are
+// the local contributions and still need to be reduced across processes
+//*******************************************************************|************************************************************//
+void ThreadedAssembler::assemble_functional_cells(std::vector<double> &values,
+                                                  const std::vector< const dolfin::Form* > &forms,
+                                                  std::vector< std::shared_ptr<dolfin::UFC> > &ufcs,
+                                                  const std::vector< dolfin::CellFunction<double>* > &cellvalues)
+{
+  const std::size_t nforms = forms.size();
+  assert(ufcs.size() == nforms);
+  assert(cellvalues.size() == nforms);
+
+  values.assign(nforms, 0.0);
+  if (nforms == 0)
+  {
+    return;
+  }
+
+  const dolfin::Mesh &mesh = *(*forms[0]).mesh();
+
+  std::vector< std::vector<std::size_t> > coeffsizes(nforms);        // sizes of the restricted coefficients of each functional
+  for (std::size_t j = 0; j < nforms; j++)
+  {
+    assert((*forms[j]).rank() == 0);
+    coeffsizes[j].resize((*forms[j]).coefficients().size());
+    for (std::size_t i = 0; i < coeffsizes[j].size(); i++)
+    {
+      coeffsizes[j][i] = (*ufcs[j]).coefficient_elements[i].space_dimension();
+    }
+  }
+
+  const std::vector< std::vector<std::size_t> > &colors = colored_cells_(mesh);
+
+  const bool record = record_costs(mesh);                            // time each cell and accumulate the cost by region
+  std::map< std::size_t, double > *costs = NULL;
+  const std::vector<std::size_t> *regions = NULL;
+  if (record)
+  {
+    costs = &costs_[mesh.id()];
+    regions = &cell_regions_(mesh);
+  }
+
+  std::vector<const ufc::cell_integral*> integrals;                  // per (cell, functional) data gathered in serial for each
+  std::vector<std::size_t> itemforms, itemcells, woffsets, coordoffsets;// colour
+  std::vector<double> w, coordinate_dofs, itemvalues, itemtimes;
+  std::vector<int> orientations;
+
+  ufc::cell ufc_cell;
+  std::vector<double> cell_coordinate_dofs;
+
+  for (std::vector< std::vector<std::size_t> >::const_iterator color_it = colors.begin(); 
+                                                                color_it != colors.end(); color_it++)
+  {
+    integrals.clear();
+    itemforms.clear();
+    itemcells.clear();
+    woffsets.clear();
+    coordoffsets.clear();
+    w.clear();
+    coordinate_dofs.clear();
+    itemtimes.clear();
+    orientations.clear();
+
+    for (std::vector<std::size_t>::const_iterator c_it = (*color_it).begin(); c_it != (*color_it).end(); c_it++)
+    {
+      dolfin::Cell cell(mesh, *c_it);
+      if (cell.is_ghost())
+      {
+        continue;
+      }
+
+      bool initialized = false;
+      for (std::size_t j = 0; j < nforms; j++)
+      {
+        const double starttime = record ? dolfin::time() : 0.0;
+
+        dolfin::UFC &ufc = *ufcs[j];
+        const ufc::cell_integral *integral = ufc.default_cell_integral.get();
+        std::shared_ptr<const dolfin::MeshFunction<std::size_t> > domains = (*forms[j]).cell_domains();
+        if (domains && !(*domains).empty())
+        {
+          integral = ufc.get_cell_integral((*domains)[*c_it]);
+        }
+        if (!integral)
+        {
+          continue;
+        }
+
+        if (!initialized)                                            // only fetch the cell geometry once for all functionals
+        {
+          cell.get_coordinate_dofs(cell_coordinate_dofs);
+          cell.get_cell_data(ufc_cell);
+          coordinate_dofs.insert(coordinate_dofs.end(), cell_coordinate_dofs.begin(), cell_coordinate_dofs.end());
+          initialized = true;
+        }
+
+        ufc.update(cell, cell_coordinate_dofs, ufc_cell, (*integral).enabled_coefficients());
+        woffsets.push_back(w.size());
+        for (std::size_t i = 0; i < coeffsizes[j].size(); i++)
+        {
+          w.insert(w.end(), ufc.w()[i], ufc.w()[i] + coeffsizes[j][i]);
+        }
+        coordoffsets.push_back(coordinate_dofs.size() - cell_coordinate_dofs.size());
+        orientations.push_back(ufc_cell.orientation);
+        integrals.push_back(integral);
+        itemforms.push_back(j);
+        itemcells.push_back(*c_it);
+        if (record)
+        {
+          itemtimes.push_back(dolfin::time() - starttime);           // restricting the coefficients is included in the cost
+        }
+      }
+    }
+
+    const std::size_t nitems = itemforms.size();
+    itemvalues.assign(nitems, 0.0);
+
+#ifdef HAS_OPENMP
+    #pragma omp parallel num_threads(num_threads_)
+#endif
+    {
+      std::vector<const double*> we;                                 // thread local coefficient pointers
+
+#ifdef HAS_OPENMP
+      #pragma omp for schedule(static)
+#endif
+      for (std::size_t k = 0; k < nitems; k++)
+      {
+        const double starttime = record ? dolfin::time() : 0.0;
+
+        const std::size_t j = itemforms[k];
+        we.resize(coeffsizes[j].size());
+        std::size_t offset = woffsets[k];
+        for (std::size_t i = 0; i < coeffsizes[j].size(); i++)
+        {
+          we[i] = &w[offset];
+          offset += coeffsizes[j][i];
+        }
+
+        double Ae = 0.0;
+        (*integrals[k]).tabulate_tensor(&Ae, we.data(), &coordinate_dofs[coordoffsets[k]], orientations[k]);
+        itemvalues[k] = Ae;
+
+        if (record)
+        {
+          itemtimes[k] += dolfin::time() - starttime;                // each item is only visited by one thread
+        }
+      }
+    }
+
+    for (std::size_t k = 0; k < nitems; k++)                         // sum up in serial so the result doesn't depend on the
+    {                                                                // number of threads
+      values[itemforms[k]] += itemvalues[k];
+      if (cellvalues[itemforms[k]])
+      {
+        (*cellvalues[itemforms[k]])[itemcells[k]] += itemvalues[k];
+      }
+      if (record)
+      {
+        (*costs)[(*regions)[itemcells[k]]] += itemtimes[k];
+      }
+    }
+  }
+}
+
+//*******************************************************************|************************************************************//
+// set the number of threads used in vector and functional assembly
+//*******************************************************************|************************************************************//
+void ThreadedAssembler::set_num_threads(const int &nthreads)
+{
+  num_threads_ = std::max(nthreads, 1);
+#ifndef HAS_OPENMP
+  if (num_threads_ > 1)
+  {
+    log(WARNING, "Requested %d assembly threads but OpenMP is not available.  Assembling in serial.", num_threads_);
+    num_threads_ = 1;
+  }
+#endif
+  if (num_threads_ > 1)
+  {
+    log(INFO, "Assembling vectors and functionals with %d threads (matrices are assembled in serial).", num_threads_);
+  }
+}
+
+//*******************************************************************|************************************************************//
+// return the number of threads used in assembly
+//*******************************************************************|************************************************************//
+const int ThreadedAssembler::num_threads()
+{
+  return num_threads_;
+}
+
+//*******************************************************************|************************************************************//
+// record (or stop recording) the time spent assembling the cells in each region of the mesh
+//*******************************************************************|************************************************************//
+void ThreadedAssembler::set_record_costs(const dolfin::Mesh &mesh, const bool &record)
+{
+  if (record)
+  {
+    record_meshes_.insert(mesh.id());
+  }
+  else
+  {
+    record_meshes_.erase(mesh.id());
+    costs_.erase(mesh.id());
+  }
+}
+
+//*******************************************************************|************************************************************//
+// return true if the time spent assembling cells is being recorded on the mesh
+//*******************************************************************|************************************************************//
+const bool ThreadedAssembler::record_costs(const dolfin::Mesh &mesh)
+{
+  return record_meshes_.count(mesh.id()) > 0;
+}
+
+//*******************************************************************|************************************************************//
+// return true if cell loops on the mesh go through the threaded loop (either to use threads or to record costs)
+//*******************************************************************|************************************************************//
+const bool ThreadedAssembler::threaded(const dolfin::Mesh &mesh)
+{
+  return (num_threads_ > 1 || record_costs(mesh));
+}
+
+//*******************************************************************|************************************************************//
+// return the time spent assembling the local cells of each region of the mesh since the costs on it were last reset
+//*******************************************************************|************************************************************//
+const std::map< std::size_t, double > ThreadedAssembler::region_costs(const dolfin::Mesh &mesh)
+{
+  std::map< std::size_t, std::map< std::size_t, double > >::const_iterator c_it = costs_.find(mesh.id());
+  if (c_it == costs_.end())
+  {
+    return std::map< std::size_t, double >();
+  }
+  return (*c_it).second;
+}
+
+//*******************************************************************|************************************************************//
+// reset the recorded costs on the mesh
+//*******************************************************************|************************************************************//
+void ThreadedAssembler::reset_costs(const dolfin::Mesh &mesh)
+{
+  costs_.erase(mesh.id());
+}
+
+//*******************************************************************|************************************************************//
+// can this assembly be threaded?
+//*******************************************************************|************************************************************//
+const bool ThreadedAssembler::threadable_(const dolfin::Form &a,
+                                          const dolfin::CellFunction<double> *values,
+                                          const dolfin::FacetFunction<double> *facetvalues) const
+{
+  if (!threaded(*a.mesh()))                                          // costs are only recorded in the threaded loop (even with a
+  {                                                                  // single thread)
+    return false;
+  }
+
+  if (a.rank() > 1)                                                  // matrices are assembled in serial (the solvers use the
+  {                                                                  // symmetric SystemAssembler for them anyway)
+    return false;
+  }
+
+  if (facetvalues || (values && a.rank() != 0))                      // only cell values can be returned from the threaded loop
+  {
+    return false;
+  }
+
+  if (!a.ufc_form()->has_cell_integrals())                           // nothing to thread
+  {
+    return false;
+  }
+
+  if (a.ufc_form()->max_cell_subdomain_id() > 0 && !a.cell_domains())// subdomains only defined on the mesh are left to dolfin
+  {
+    return false;
+  }
+
+  return true;
+}
+
+//*******************************************************************|************************************************************//
+// assemble the cell integrals of a form using threads
+// coefficients are restricted to each cell in serial (python expressions and ghosted petsc vectors are not thread safe) and
+// only the tabulation and insertion of the element tensors is threaded, one colour at a time
+//*******************************************************************|************************************************************//
+void ThreadedAssembler::assemble_cells_(dolfin::GenericTensor &A, const dolfin::Form &a, dolfin::UFC &ufc,
+                                        dolfin::CellFunction<double> *values)
+{
+  const dolfin::Mesh &mesh = *a.mesh();
+  const std::size_t rank = a.rank();
+  const std::size_t ncoeffs = a.coefficients().size();
+  const std::size_t tensorsize = ufc.A.size();
+
+  std::shared_ptr<const dolfin::MeshFunction<std::size_t> > domains = a.cell_domains();
+  const bool use_domains = domains && !(*domains).empty();
+
+  std::vector<std::size_t> coeffsizes(ncoeffs);                      // sizes of the restricted coefficients
+  std::size_t wsize = 0;
+  for (std::size_t i = 0; i < ncoeffs; i++)
+  {
+    coeffsizes[i] = ufc.coefficient_elements[i].space_dimension();
+    wsize += coeffsizes[i];
+  }
+
+  std::shared_ptr<const dolfin::GenericDofMap> dofmap;
+  if (rank == 1)
+  {
+    dofmap = (*a.function_space(0)).dofmap();
+  }
+
+  const std::vector< std::vector<std::size_t> > &colors = colored_cells_(mesh);
+
+  const bool record = record_costs(mesh);                            // time each cell and accumulate the cost by region
+  std::vector<double> celltimes;
+  std::map< std::size_t, double > *costs = NULL;
+  const std::vector<std::size_t> *regions = NULL;
+  if (record)
+  {
+    costs = &costs_[mesh.id()];
+    regions = &cell_regions_(mesh);
+  }
+
+  std::vector<double> localvalues;                                   // local (ghosted) accumulation buffer for vectors
+  double localvalue = 0.0;                                           // accumulation for functionals
+
+  std::vector<const ufc::cell_integral*> integrals;                  // per cell data gathered in serial for each colour
+  std::vector<std::size_t> cells;
+  std::vector<double> w, coordinate_dofs;
+  std::vector<int> orientations;
+
+  ufc::cell ufc_cell;
+  std::vector<double> cell_coordinate_dofs;
+  const ufc::cell_integral *integral = ufc.default_cell_integral.get();
+
+  for (std::vector< std::vector<std::size_t> >::const_iterator color_it = colors.begin(); 
+                                                                color_it != colors.end(); color_it++)
+  {
+    integrals.clear();
+    cells.clear();
+    w.clear();
+    coordinate_dofs.clear();
+    orientations.clear();
+    celltimes.clear();
+
+    for (std::vector<std::size_t>::const_iterator c_it = (*color_it).begin(); c_it != (*color_it).end(); c_it++)
+    {
+      const double starttime = record ? dolfin::time() : 0.0;
+
+      dolfin::Cell cell(mesh, *c_it);
+      if (cell.is_ghost())
+      {
+        continue;
+      }
+
+      if (use_domains)
+      {
+        integral = ufc.get_cell_integral((*domains)[*c_it]);
+      }
+      if (!integral)
+      {
+        continue;
+      }
+
+      cell.get_coordinate_dofs(cell_coordinate_dofs);
+      cell.get_cell_data(ufc_cell);
+      ufc.update(cell, cell_coordinate_dofs, ufc_cell, (*integral).enabled_coefficients());
+
+      for (std::size_t i = 0; i < ncoeffs; i++)
+      {
+        w.insert(w.end(), ufc.w()[i], ufc.w()[i] + coeffsizes[i]);
+      }
+      coordinate_dofs.insert(coordinate_dofs.end(), cell_coordinate_dofs.begin(), cell_coordinate_dofs.end());
+      orientations.push_back(ufc_cell.orientation);
+      integrals.push_back(integral);
+      cells.push_back(*c_it);
+      if (record)
+      {
+        celltimes.push_back(dolfin::time() - starttime);             // restricting the coefficients is included in the cost
+      }
+
+      if (rank == 1)
+      {
+        const dolfin::ArrayView<const dolfin::la_index> cell_dofs = (*dofmap).cell_dofs(*c_it);
+        for (std::size_t i = 0; i < cell_dofs.size(); i++)
+        {
+          if ((std::size_t)cell_dofs[i] >= localvalues.size())
+          {
+            localvalues.resize(cell_dofs[i]+1, 0.0);
+          }
+        }
+      }
+    }
+
+    const std::size_t ncells = cells.size();
+    const std::size_t ncoorddofs = ncells > 0 ? coordinate_dofs.size()/ncells : 0;
+    double colorvalue = 0.0;
+
+#ifdef HAS_OPENMP
+    #pragma omp parallel num_threads(num_threads_)
+#endif
+    {
+      std::vector<double> Ae(tensorsize);                            // thread local element tensor
+      std::vector<const double*> we(ncoeffs);
+
+#ifdef HAS_OPENMP
+      #pragma omp for schedule(static) reduction(+:colorvalue)
+#endif
+      for (std::size_t c = 0; c < ncells; c++)
+      {
+        const double starttime = record ? dolfin::time() : 0.0;
+
+        std::size_t offset = c*wsize;
+        for (std::size_t i = 0; i < ncoeffs; i++)
+        {
+          we[i] = &w[offset];
+          offset += coeffsizes[i];
+        }
+
+        std::fill(Ae.begin(), Ae.end(), 0.0);
+        (*integrals[c]).tabulate_tensor(Ae.data(), we.data(), &coordinate_dofs[c*ncoorddofs], orientations[c]);
+
+        if (rank == 0)
+        {
+          colorvalue += Ae[0];
+          if (values)
+          {
+            (*values)[cells[c]] = Ae[0];
+          }
+        }
+        else
+        {
+          const dolfin::ArrayView<const dolfin::la_index> cell_dofs = (*dofmap).cell_dofs(cells[c]);
+          for (std::size_t i = 0; i < cell_dofs.size(); i++)
+          {                                                          // the colouring means the cells in this loop don't share
+#ifdef HAS_OPENMP                                                    // dofs, except for global (real) dofs, so the atomic is
+            #pragma omp atomic                                       // uncontended in almost all cases
+#endif
+            localvalues[cell_dofs[i]] += Ae[i];
+          }
+        }
+
+        if (record)
+        {
+          celltimes[c] += dolfin::time() - starttime;                // each cell is only visited by one thread
+        }
+      }
+    }
+
+    localvalue += colorvalue;
+
+    if (record)
+    {
+      for (std::size_t c = 0; c < ncells; c++)
+      {
+        (*costs)[(*regions)[cells[c]]] += celltimes[c];
+      }
+    }
+  }
+
+  std::vector<dolfin::ArrayView<const dolfin::la_index> > dofs(rank);
+  if (rank == 0)
+  {
+    A.add_local(&localvalue, dofs);
+  }
+  else
+  {
+    std::vector<dolfin::la_index> indices(localvalues.size());
+    for (std::size_t i = 0; i < indices.size(); i++)
+    {
+      indices[i] = i;
+    }
+    dofs[0].set(indices.size(), indices.data());
+    A.add_local(localvalues.data(), dofs);
+  }
+}
+
+//*******************************************************************|************************************************************//
+// return the cells of the mesh grouped by colour (cached per mesh so the colouring is only computed once)
+//*******************************************************************|************************************************************//
+const std::vector< std::vector<std::size_t> >& ThreadedAssembler::colored_cells_(const dolfin::Mesh &mesh)
+{
+  static std::map< std::size_t, std::pair< std::size_t, std::vector< std::vector<std::size_t> > > > colored_cells;
+
+  std::pair< std::size_t, std::vector< std::vector<std::size_t> > > &entry = colored_cells[mesh.id()];
+  if (entry.second.empty() || entry.first != mesh.num_cells())
+  {
+    const std::vector<std::size_t> &colors = mesh.color("vertex");
+    std::size_t ncolors = 0;
+    for (std::vector<std::size_t>::const_iterator c_it = colors.begin(); c_it != colors.end(); c_it++)
+    {
+      ncolors = std::max(ncolors, *c_it + 1);
+    }
+
+    entry.first = mesh.num_cells();
+    entry.second.clear();
+    entry.second.resize(ncolors);
+    for (std::size_t c = 0; c < colors.size(); c++)
+    {
+      entry.second[colors[c]].push_back(c);
+    }
+
+    log(DBG, "Coloured mesh %d into %d colours for threaded assembly.", (int)mesh.id(), (int)ncolors);
+  }
+
+  return entry.second;
+}
+
+//*******************************************************************|************************************************************//
+// return the region id of each cell of the mesh (cached per mesh, cells without a region id are given the id 0)
+//*******************************************************************|************************************************************//
+const std::vector<std::size_t>& ThreadedAssembler::cell_regions_(const dolfin::Mesh &mesh)
+{
+  static std::map< std::size_t, std::vector<std::size_t> > cell_regions;
+
+  std::vector<std::size_t> &regions = cell_regions[mesh.id()];
+  if (regions.size() != mesh.num_cells())
+  {
+    regions.assign(mesh.num_cells(), 0);
+    const std::map<std::size_t, std::size_t> &markers = mesh.domains().markers(mesh.topology().dim());
+    for (std::map<std::size_t, std::size_t>::const_iterator m_it = markers.begin(); m_it != markers.end(); m_it++)
+    {
+      regions[(*m_it).first] = (*m_it).second;
+    }
+  }
+
+  return regions;
+}
@@ -62,6 +62,9 @@ void buckettools::usage(char *cmd)
       <<"\tAvailable options: CRITICAL (50), ERROR (40), WARNING (30), INFO (20), PROGRESS (16), TRACE (13), DEBUG (10), DBG (10) or any integer." << std::endl
       <<" -p, --petsc-info" << std::endl << "\tVerbose PETSc output." << std::endl
       <<" -l, --log" << std::endl << "\tCreate log (redirects stdout) and error (redirects stderr) files for each process." << std::endl
+      <<"\tIncludes output written directly to stdout by PETSc, DOLFIN and SPuD." << std::endl
+      <<" -L <ranks>, --log-file <ranks>" << std::endl << "\tWrite TerraFERMA log and error messages to files without redirecting stdout or stderr." << std::endl
+      <<"\tAvailable options: root (only process 0 writes a log, other processes only report warnings and errors) or all." << std::endl
       <<" -V, --version" << std::endl << "\tPrints version information then exits." << std::endl
       <<" -h, --help" << std::endl << "\tHelp! Prints this message then exits.";
   log(ERROR, s.str());
@@ -194,6 +197,7 @@ void buckettools::parse_arguments(int argc, char** argv)
   struct option long_options[] = {                                   // a structure linking long option names with their short equivalents
     {"help",           no_argument,       0, 'h'},
     {"log",            no_argument,       0, 'l'},
+    {"log-file",       required_argument, 0, 'L'},
     {"petsc-info",     no_argument,       0, 'p'},
     {"verbose",        required_argument, 0, 'v'},
     {"dolfin-verbose", required_argument, 0, 'd'},
@@ -214,7 +218,7 @@ void buckettools::parse_arguments(int argc, char** argv)
 
   dolfin::init(petscargc, petscargv);
 
-  while ((c = getopt_long(argc, argv, "hlpv:d:V", long_options, &option_index))!=-1)
+  while ((c = getopt_long(argc, argv, "hlL:pv:d:V", long_options, &option_index))!=-1)
   {
     switch (c)
     {
@@ -226,6 +230,10 @@ void buckettools::parse_arguments(int argc, char** argv)
         command_line_options["log"] = "";
         break;
 
+      case 'L':
+        command_line_options["log-file"] = optarg;
+        break;
+
       case 'p':
         command_line_options["petsc-info"] = "";
         break;
@@ -280,6 +288,21 @@ void buckettools::parse_arguments(int argc, char** argv)
     }
   }
 
+  if(command_line_options.count("log-file"))                         // write the logger output to files
+  {
+    if(command_line_options.count("log"))
+    {
+      tf_err("Cannot redirect stdio and write log files at the same time.", "Select only one of -l and -L.");
+    }
+
+    const std::string ranks = command_line_options["log-file"];
+    if (ranks != "root" && ranks != "all")
+    {
+      tf_err("Unknown log file ranks.", "Expected root or all, got: %s", ranks.c_str());
+    }
+    (*Logger::instance()).set_log_files("terraferma", ranks == "all");
+  }
+
   if(command_line_options.count("help"))                             // help
   {
     usage(argv[0]);
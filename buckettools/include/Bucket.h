@@ -94,6 +94,12 @@ namespace buckettools
 
     double residual_norm();                                          // return the l2 norm of the residual of the systems
 
+    bool retry_failure();                                            // register a solver failure, returning true if the timestep will
+                                                                     // be rolled back and retried (so the solver need not handle it)
+
+    const bool solve_failed() const                                  // return true if a solver has failed in this attempt at the
+    { return solvefailed_; }                                         // timestep (which will be rolled back)
+
     //***************************************************************|***********************************************************//
     // Filling data
     //***************************************************************|***********************************************************//
@@ -139,6 +145,9 @@ namespace buckettools
 
     const int iteration_count() const;                               // return the number of nonlinear iterations taken
 
+    const int timestep_retries() const                               // return the number of times the current timestep was retried
+    { return timestep_retries_; }
+
     const std::string output_basename() const                        // return the output base name
     { return output_basename_; }
 
@@ -201,6 +210,10 @@ namespace buckettools
 
     SystemBucket_const_it systems_end() const;                       // return a constant iterator to the end of the systems
 
+    const SolverBucket_ptr adapted_solver(                           // return the solver that the named solver replaces while the
+                             const std::string &systemname,          // systems are being rebuilt after a mesh adapt (null
+                             const std::string &solvername) const;   // otherwise)
+
     //***************************************************************|***********************************************************//
     // UFL symbol data access
     //***************************************************************|***********************************************************//
@@ -268,6 +281,13 @@ namespace buckettools
 
     const std::string systems_str(const int &indent=0) const;        // return an indented string describing the systems in the bucket
 
+    const std::string memory_str() const;                            // return a string describing the memory footprint of the
+                                                                     // vectors and matrices in the bucket
+
+    const std::string systemgraph_str(const int &indent=0) const;    // return an indented string describing the system dependencies
+
+    void write_systemgraph(const std::string &filename) const;       // write the system dependency graph to a graphviz dot file
+
     virtual const std::string coefficientspaces_str(const int        // return an indented string describing the coefficient functionspaces
                                                     &indent=0) const;// contained in the bucket
 
@@ -292,6 +312,16 @@ namespace buckettools
                             current_time_, finish_time_, 
                             walltime_limit_;                         // the current and finish times of the simulation
 
+    double_ptr walltime_safetyfactor_;                               // safety factor on the predicted walltime of the next timestep
+                                                                     // and final checkpoint (only associated if predicting)
+
+    double timestep_walltime_, checkpoint_walltime_;                 // moving averages of the walltime taken by a timestep and by a
+                                                                     // checkpoint (negative until measured)
+
+    double previous_walltime_;                                       // the walltime at the previous completion check
+
+    int terminate_signal_;                                           // a signal that terminates the timeloop gracefully (0 if none)
+
     int_ptr timestep_count_, number_timesteps_;                      // the number of timesteps and number of nonlinear iterations taken
 
     std::pair< std::string, Constant_ptr > timestep_;                // the timestep, represented as a dolfin constant so it can be used in
@@ -302,6 +332,18 @@ namespace buckettools
     std::vector< std::pair< FunctionBucket_ptr, double > >           // constraints on the timestep in < FunctionBucket_ptr, max value > pairs
                                               timestep_constraints_;
 
+    double_ptr timestep_retryfactor_;                                // factor by which the timestep is reduced before retrying a failed
+                                                                     // timestep (only associated if retrying failed timesteps)
+
+    int timestep_maxretries_;                                        // the maximum number of retries of a timestep
+
+    double timestep_minretry_;                                       // the timestep below which failed timesteps are not retried
+
+    int timestep_retries_;                                           // the number of retries of the current timestep
+
+    bool retryable_, solvefailed_;                                   // can solver failures currently be retried and has one failed in
+                                                                     // the current attempt at the timestep
+
     int_ptr iteration_count_;                                        // the number of iterations requested and the number of nonlinear 
                                                                      // iterations taken
     int minits_, maxits_;                                            // nonlinear system iteration counts
@@ -343,6 +385,16 @@ namespace buckettools
 
     ordered_map<const std::string, GenericDetectors_ptr> detectors_;        // a map from detector set name to (boost shared) pointers to detectors
 
+    std::map< std::string, SystemBucket_ptr > adaptedsystems_;       // the systems being replaced after a mesh adapt (only
+                                                                     // populated while the new systems are being filled)
+
+    //***************************************************************|***********************************************************//
+    // Ensemble data
+    //***************************************************************|***********************************************************//
+
+    std::vector< std::string > ensemble_;                            // the names of the ensemble members (empty unless running an
+                                                                     // ensemble)
+
     //***************************************************************|***********************************************************//
     // Diagnostics data
     //***************************************************************|***********************************************************//
@@ -371,6 +423,22 @@ namespace buckettools
 
     void fill_uflsymbols_();                                         // fill the ufl symbol data structures
 
+    void fill_systemgraph_();                                        // derive the system dependency graph from the attached
+                                                                     // form coefficients
+
+    const std::set< std::string > system_dependencies_(              // return the names of the systems that the named system
+                            const std::string &name) const;          // depends on (through the coefficients of its solver forms)
+
+    const int system_level_(const std::string &name) const;          // return the level of the named system in the dependency graph
+                                                                     // (a system doesn't depend on earlier systems on its own level
+                                                                     // but may still use lagged values of later systems)
+
+    void replace_mesh_(Mesh_ptr mesh, const std::string &name);      // replace the named mesh (and forget its visualization
+                                                                     // functionspace)
+
+    void reset_systems_();                                           // empty the systems and everything derived from them so they
+                                                                     // can be filled again
+
   //*****************************************************************|***********************************************************//
   // Private functions
   //*****************************************************************|***********************************************************//
@@ -398,10 +466,18 @@ namespace buckettools
     std::map< std::string, FunctionSpace_ptr > coefficientspaces_;   // a map from the base ufl symbol to a coefficient
                                                                      // functionspace
 
+    std::map< std::string, std::set< std::string > > 
+                                              systemdependencies_;   // a map from system names to the systems they depend on
+
+    std::map< std::string, int > systemlevels_;                      // a map from system names to their level in the dependency graph
+
     //***************************************************************|***********************************************************//
     // Functions used to run the model
     //***************************************************************|***********************************************************//
 
+    void run_member_();                                              // run the model from its initial state (once per ensemble
+                                                                     // member)
+
     bool steadystate_();                                             // check if a steady state has been attained
 
     bool perform_action_(double_ptr action_period, 
@@ -415,8 +491,19 @@ namespace buckettools
     void solve_in_timeloop_();                                       // solve the solvers in this system (in order during the
                                                                      // timeloop of a simulation)
 
+    void subcycle_(SystemBucket_ptr system);                         // solve the in_timeloop solvers of a system over a number of
+                                                                     // substeps of the current timestep
+
+    void multirate_solve_(SystemBucket_ptr system);                  // solve the in_timeloop solvers of a system that is only solved
+                                                                     // every few timesteps over the time since its last solve
+
     bool complete_iterating_(const double &aerror0);                 // indicate if nonlinear systems iterations are complete or not
 
+    bool rollback_timestep_();                                       // if a solver failed roll back to the start of the timestep and
+                                                                     // reduce the timestep, returning true if it should be retried
+
+    bool walltime_complete_();                                       // indicate if the walltime limit has been (or would be) reached
+
     //***************************************************************|***********************************************************//
     // Output functions (continued)
     //***************************************************************|***********************************************************//
@@ -425,6 +512,25 @@ namespace buckettools
 
     virtual void checkpoint_options_(const double_ptr time);         // checkpoint the options system for the bucket
 
+    //***************************************************************|***********************************************************//
+    // Mesh adaptivity functions
+    //***************************************************************|***********************************************************//
+
+    virtual void adapt_meshes_();                                    // adapt the meshes (and rebuild the systems on them)
+
+    //***************************************************************|***********************************************************//
+    // Load balancing functions
+    //***************************************************************|***********************************************************//
+
+    virtual void rebalance_meshes_();                                // repartition the meshes (and rebuild the systems on them)
+
+    //***************************************************************|***********************************************************//
+    // Ensemble functions
+    //***************************************************************|***********************************************************//
+
+    virtual void start_ensemble_member_(const uint &member);         // reset the bucket to its initial state and apply the
+                                                                     // parameters of the given ensemble member
+
   };
 
   typedef std::shared_ptr< Bucket > Bucket_ptr;                    // define a boost shared ptr type for the class
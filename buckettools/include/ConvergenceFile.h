@@ -65,7 +65,8 @@ namespace buckettools
                     const MPI_Comm &comm, 
                     const Bucket *bucket,
                     const std::string &systemname, 
-                    const std::string &solvername);                  // specific constructor
+                    const std::string &solvername,
+                    const bool &normsonly=false);                    // specific constructor
  
     ~ConvergenceFile();                                              // default destructor
     
@@ -80,6 +81,20 @@ namespace buckettools
     //***************************************************************|***********************************************************//
 
     void write_data();                                               // write data to file for a simulation
+
+    void write_norms(const double &solnorm,                          // write the system norms to file (norms only files)
+                     const double &resnorm, 
+                     const double &updatenorm=0.0);
+
+    const bool norms_only() const                                    // return true if this file only contains system norms
+    { return normsonly_; }
+
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    void refresh_bucket();                                           // recollect the fields after the bucket systems have been
+                                                                     // rebuilt
     
   //*****************************************************************|***********************************************************//
   // Private functions
@@ -95,6 +110,8 @@ namespace buckettools
 
     std::string solvername_;                                         // solver name
 
+    bool normsonly_;                                                 // only write the system norms
+
     std::vector< FunctionBucket_ptr > fields_;
 
     //***************************************************************|***********************************************************//
@@ -112,6 +129,9 @@ namespace buckettools
     void header_func_(const FunctionBucket_ptr f_ptr,                // write the header for a set of functions
                       const SolverBucket_ptr sol_ptr);
 
+    void header_norms_(const SystemBucket_ptr sys_ptr,               // write the header for the system norms
+                       const SolverBucket_ptr sol_ptr);
+
     //***************************************************************|***********************************************************//
     // Data writing functions (continued)
     //***************************************************************|***********************************************************//
@@ -78,6 +78,13 @@ namespace buckettools
     //***************************************************************|***********************************************************//
 
     void write_data();
+
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    void refresh_bucket();                                           // recollect the detectors and functions after the
+                                                                     // bucket systems have been rebuilt
     
   //*****************************************************************|***********************************************************//
   // Private functions
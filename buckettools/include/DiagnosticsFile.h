@@ -65,6 +65,13 @@ namespace buckettools
 
     void close();                                                    // close the file
     
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    virtual void refresh_bucket();                                   // recollect any pointers into the bucket (after its systems
+                                                                     // have been rebuilt) without rewriting the header
+
   //*****************************************************************|***********************************************************//
   // Protected functions
   //*****************************************************************|***********************************************************//
@@ -85,6 +92,8 @@ namespace buckettools
 
     uint ncolumns_;                                                  // total number of columns
 
+    bool quiet_;                                                     // don't write header tags (when recollecting pointers)
+
     //***************************************************************|***********************************************************//
     // Header writing functions
     //***************************************************************|***********************************************************//
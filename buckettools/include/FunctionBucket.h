@@ -159,6 +159,9 @@ namespace buckettools
                                                                      // so it will be necessary to make a deep copy to access
                                                                      // the vector
 
+    const Form_ptr constantfunctional() const                        // return a constant (std shared) pointer to the functional
+    { return constantfunctional_; }                                  // used to set a constant coefficient (may be null)
+
     const GenericFunction_ptr oldfunction() const                    // return a constant (std shared) pointer to the old
     { return oldfunction_; }                                         // function (previous timestep's values)
                                                                      // NOTE: if this is a field of a mixed
@@ -141,6 +141,15 @@ namespace buckettools
 
     dolfin::FacetFunction<double> *facetfunction_;                   // facet function for output
 
+    //***************************************************************|***********************************************************//
+    // Calculation
+    //***************************************************************|***********************************************************//
+
+    void calculate_system_functionals_(const bool &steadystateonly=false);// calculate all outstanding functionals of the system (or
+                                                                     // just those included in the steady state) at once
+
+    void reset_outputfunctions_();                                   // allocate and zero the output cell and facet functions
+
   };
 
   typedef std::shared_ptr< FunctionalBucket > FunctionalBucket_ptr;    // define a (boost shared) pointer to the function bucket class type
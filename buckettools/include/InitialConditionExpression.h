@@ -35,6 +35,8 @@ namespace buckettools
   // This class provides a method of looping over field initial conditions (as individual expressions)
   // and setting a mixed function space to those initial conditions.
   // It is a derived dolfin expression and overloads much functionality in that base class
+  // The component map is flattened on construction into vectors of expressions and value offsets so that each evaluation writes
+  // the components straight into the full value array.
   //*****************************************************************|************************************************************//
   class InitialConditionExpression : public dolfin::Expression
   {
@@ -81,6 +83,20 @@ namespace buckettools
 
     std::map< std::size_t, Expression_ptr > expressions_;                   // map from component to initial condition expression for a function
   
+    //***************************************************************|***********************************************************//
+    // Dispatch data
+    //***************************************************************|***********************************************************//
+
+    void init_();                                                    // build the flat dispatch vectors from the expression map
+
+    std::vector< const dolfin::Expression* > components_;            // the component expressions in order
+
+    std::vector< std::size_t > offsets_;                             // the offset of each component into the full value array
+
+    std::vector< std::size_t > sizes_;                               // the value size of each component
+
+    bool zero_;                                                      // do the components leave any values unset (to be zeroed)?
+
   };
 
 }
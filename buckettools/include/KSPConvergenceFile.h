@@ -66,7 +66,8 @@ namespace buckettools
                        const MPI_Comm &comm, 
                        const Bucket *bucket,
                        const std::string &systemname, 
-                       const std::string &solvername);               // specific constructor
+                       const std::string &solvername,
+                       const bool &normsonly=false);                 // specific constructor
  
     ~KSPConvergenceFile();                                           // default destructor
     
@@ -81,6 +82,18 @@ namespace buckettools
     //***************************************************************|***********************************************************//
 
     void write_data(const int &kspit);                               // write data to file for a simulation
+
+    void write_norms(const int &kspit, const double &resnorm);       // write the ksp residual norm to file (norms only files)
+
+    const bool norms_only() const                                    // return true if this file only contains the residual norm
+    { return normsonly_; }
+
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    void refresh_bucket();                                           // recollect the fields after the bucket systems have been
+                                                                     // rebuilt
     
   //*****************************************************************|***********************************************************//
   // Private functions
@@ -96,6 +109,8 @@ namespace buckettools
 
     std::string solvername_;                                         // solver name
 
+    bool normsonly_;                                                 // only write the ksp residual norm
+
     std::vector< FunctionBucket_ptr > fields_;
 
     //***************************************************************|***********************************************************//
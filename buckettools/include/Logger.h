@@ -23,6 +23,13 @@
 #define __LOGGER_H
 
 #include <ostream>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace buckettools
 {
@@ -57,27 +64,37 @@ namespace buckettools
 
     void set_log_level(int &loglevel);
 
+    void set_log_files(const std::string &basename,                  // write the log and errors to files (on rank 0 or all ranks)
+                       const bool &allranks);
+
+    const bool enabled(const int &loglevel) const                    // will a message at this loglevel be written?
+    { return (loglevel >= loglevel_) && (loglevel >= WARNING || logactive_); }
+
+    void flush();                                                    // flush any buffered messages
+
+    void stop_flusher();                                             // stop the thread that periodically flushes buffered messages
+
     void failure(const std::string &filename, 
                  const int &line,
                  const std::string &errstr,
-                 const std::string &reason) const;
+                 const std::string &reason);
 
     void error(const std::string &filename, 
                const int &line,
                const std::string &errstr,
-               const std::string &reason) const;
+               const std::string &reason);
 
     void warning(const std::string &filename, 
                  const int &line,
                  const std::string &errstr,
-                 const std::string &reason) const;
+                 const std::string &reason);
 
     std::string description(const std::string &filename, 
                             const int &line, 
                             const std::string &errstr, 
                             const std::string &reason) const;
 
-    void write(int loglevel, std::string msg) const;
+    void write(const int &loglevel, const std::string &msg);
 
 
   //*****************************************************************|***********************************************************//
@@ -94,6 +111,17 @@ namespace buckettools
 
     Logger(const Logger& logger);
 
+    //***************************************************************|***********************************************************//
+    // Buffering
+    //***************************************************************|***********************************************************//
+
+    const bool buffered_() const                                     // are messages buffered? (only when writing to our own log
+    { return logfile_ && (logstream_ == logfile_.get()); }           // file, stdout is shared with petsc and dolfin output)
+
+    void flush_();                                                   // flush without locking the mutex
+
+    void flusher_();                                                 // periodically flush buffered messages (run on a thread)
+
     //***************************************************************|***********************************************************//
     // Base data
     //***************************************************************|***********************************************************//
@@ -102,11 +130,33 @@ namespace buckettools
 
     std::ostream *logstream_, *errstream_;                            // log and error streams
 
+    std::shared_ptr< std::ofstream > logfile_, errfile_;             // log and error files (if requested)
+
     int loglevel_;
 
+    bool logactive_;                                                 // false if this rank only writes warnings and errors
+
+    std::string logbuffer_;                                          // buffered (sub warning) messages
+
+    double flushinterval_;                                           // maximum time (in seconds) messages stay buffered
+
+    std::chrono::steady_clock::time_point lastflush_;                // time of the last flush
+
+    std::mutex mutex_;                                               // protects the streams and buffer from the flusher thread
+
+    std::thread flusher_thread_;                                     // thread flushing the buffer every flushinterval_ seconds
+
+    std::condition_variable flusher_wakeup_;                         // used to stop the flusher thread
+
+    bool stopflusher_;                                               // true if the flusher thread should stop
+
   };
 
-  void log(int loglevel, std::string msg, ...);
+  void log(int loglevel, const char* msg, ...);
+
+  void log(int loglevel, const std::string &msg);
+
+  void flush_log();
 
   void set_log_level(int &loglevel);
 
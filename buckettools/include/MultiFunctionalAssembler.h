@@ -0,0 +1,80 @@
+// Copyright (C) 2013 Columbia University in the City of New York and others.
+//
+// Please see the AUTHORS file in the main source directory for a full list
+// of contributors.
+//
+// This file is part of TerraFERMA.
+//
+// TerraFERMA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TerraFERMA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TerraFERMA. If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef __MULTIFUNCTIONALASSEMBLER_H
+#define __MULTIFUNCTIONALASSEMBLER_H
+
+#include "BoostTypes.h"
+#include <dolfin.h>
+
+namespace buckettools
+{
+  
+  //*****************************************************************|************************************************************//
+  // MultiFunctionalAssembler class:
+  //
+  // MultiFunctionalAssembler assembles a set of functionals defined on the same mesh in a single pass over the cells and exterior
+  // facets, reducing all of their values across processes with one collective.  Functionals that cannot be fused (e.g. those with
+  // interior facet or vertex integrals) are assembled individually using dolfin::Assembler.
+  //*****************************************************************|************************************************************//
+  class MultiFunctionalAssembler : public dolfin::AssemblerBase
+  {
+  //*****************************************************************|***********************************************************//
+  // Publicly available functions
+  //*****************************************************************|***********************************************************//
+
+  public:                                                            // accessible to everyone
+
+    //***************************************************************|***********************************************************//
+    // Constructors and destructors
+    //***************************************************************|***********************************************************//
+
+    MultiFunctionalAssembler();                                      // default constructor
+    
+    ~MultiFunctionalAssembler();                                     // default destructor
+
+    //***************************************************************|***********************************************************//
+    // Assembly
+    //***************************************************************|***********************************************************//
+
+    void assemble(std::vector<double> &values,                       // assemble the functionals in forms into values (optionally
+                  const std::vector< Form_ptr > &forms,              // returning the cell and facet values of each functional if
+                  const std::vector< dolfin::CellFunction<double>* > &cellvalues,// the corresponding entries are not NULL)
+                  const std::vector< dolfin::FacetFunction<double>* > &facetvalues);
+
+  //*****************************************************************|***********************************************************//
+  // Private functions
+  //*****************************************************************|***********************************************************//
+
+  private:                                                           // only accessible to this class
+    
+    //***************************************************************|***********************************************************//
+    // Private member functions
+    //***************************************************************|***********************************************************//
+
+    const bool fusable_(const dolfin::Form &a,                       // can this functional be included in the fused assembly?
+                        const dolfin::Mesh &mesh) const;
+
+  };
+
+}
+#endif
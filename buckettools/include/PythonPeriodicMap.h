@@ -34,7 +34,8 @@ namespace buckettools
   // PythonPeriodicMap class:
   //
   // The PythonPeriodicMap class describes a derived dolfin SubDomain class that overloads
-  // the map function using python
+  // the map function using python.  The candidate slave coordinates of a mesh can be mapped in advance with a single (vectorized
+  // where possible) python call and the resulting pairing is cached, both in memory and on disk.
   //*****************************************************************|************************************************************//
   class PythonPeriodicMap : public dolfin::SubDomain
   {
@@ -59,6 +60,15 @@ namespace buckettools
     
     void map(const dolfin::Array<double>& x, dolfin::Array<double>& y) const;        // map slave position x to master position y
     
+    //***************************************************************|***********************************************************//
+    // Batched mapping
+    //***************************************************************|***********************************************************//
+
+    void prepare(const dolfin::Mesh &mesh,                           // map all the candidate slave coordinates on the mesh in one
+                 const dolfin::MeshFunction<std::size_t> &facetdomains,// go (or read them from the on-disk cache)
+                 const std::vector<std::size_t> &masterids,
+                 const std::vector<std::size_t> &slaveids);
+
 
   //*****************************************************************|***********************************************************//
   // Private functions
@@ -72,6 +82,25 @@ namespace buckettools
     
     const PythonInstance pyinst_;                                    // a python instance (wrapping useful python information)
 
+    std::shared_ptr<PythonInstance> batchpyinst_;                    // a python instance mapping a list of coordinates at once
+
+    std::map< std::vector<double>, std::vector<double> > pairs_;     // cache of slave to master coordinates
+
+    //***************************************************************|***********************************************************//
+    // Batched mapping helpers
+    //***************************************************************|***********************************************************//
+
+    void map_batch_(const std::vector< std::vector<double> > &xs,     // map a list of coordinates with a single python call
+                    std::vector< std::vector<double> > &ys);
+
+    const std::string cache_filename_(const dolfin::Mesh &mesh,      // the name of the on-disk pairing cache (empty if disabled)
+                                 const std::vector<std::size_t> &masterids,
+                                 const std::vector<std::size_t> &slaveids) const;
+
+    const bool read_cache_(const std::string &filename);             // read the pairing from disk, returning true on success
+
+    void write_cache_(const std::string &filename) const;            // write the pairing to disk
+
   };
 
   typedef std::shared_ptr< PythonPeriodicMap > PythonPeriodicMap_ptr;// define a (boost shared) pointer type for the python
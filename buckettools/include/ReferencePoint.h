@@ -31,7 +31,8 @@ namespace buckettools
   //*****************************************************************|************************************************************//
   // ReferencePoint class:
   //
-  // ReferencePoint implements a method for setting reference points on functions.
+  // ReferencePoint implements a method for setting reference points on functions.  The dof is located once at creation (in
+  // batches) so that applying the point to a vector is a direct write to the owned entry.
   //*****************************************************************|************************************************************//
   class ReferencePoint : public dolfin::DirichletBC
   {
@@ -45,24 +46,60 @@ namespace buckettools
     // Constructors and destructors
     //***************************************************************|***********************************************************//
 
-    ReferencePoint(const std::vector<double> &coord, 
-                   const FunctionSpace_ptr functionspace,
-                   const GenericFunction_ptr value);
-    
     ~ReferencePoint();                                              // default destructor
 
+    static std::vector< std::shared_ptr< ReferencePoint > >          // create a batch of reference points (potentially on
+                   create(const std::vector< std::vector<double> >   // different functionspaces of the same mesh) using a single
+                                                          &coords,   // point location pass and a single collective
+                   const std::vector< FunctionSpace_ptr > &functionspaces,
+                   const std::vector< GenericFunction_ptr > &values);
+
+    //***************************************************************|***********************************************************//
+    // Application
+    //***************************************************************|***********************************************************//
+
+    void apply_point(dolfin::GenericVector &b) const;                // set the reference value directly in vector b
+
+    void apply_point(dolfin::GenericVector &b,                       // set the reference residual (x - value) directly in vector b
+                     const dolfin::GenericVector &x) const;
+
   //*****************************************************************|***********************************************************//
   // Private functions
   //*****************************************************************|***********************************************************//
 
   private:
     
+    //***************************************************************|***********************************************************//
+    // Constructors
+    //***************************************************************|***********************************************************//
+
+    ReferencePoint(const std::vector<double> &point,                 // constructor from an already located dof point
+                   const std::size_t &dof,
+                   const FunctionSpace_ptr functionspace,
+                   const GenericFunction_ptr value);
+    
     //***************************************************************|***********************************************************//
     // Initialization
     //***************************************************************|***********************************************************//
 
-    static SubDomain_ptr subdomain_(const std::vector<double> &coord,
-                                    const FunctionSpace_ptr functionspace);
+    static void locate_(const std::vector< std::vector<double> >     // locate the nearest dof points to a batch of coordinates
+                                                          &coords,
+                        const std::vector< FunctionSpace_ptr > &functionspaces,
+                        std::vector< std::vector<double> > &points,
+                        std::vector< std::size_t > &dofs);
+
+    void initialize_(const std::size_t &dof);                        // check the dof is found and record its owned local index
+
+    double value_() const;                                           // evaluate the reference value at the point
+
+    //***************************************************************|***********************************************************//
+    // Base data
+    //***************************************************************|***********************************************************//
+
+    std::vector<double> point_;                                      // the coordinates of the reference dof
+
+    dolfin::la_index localdof_;                                      // the local index of the reference dof if it is owned by this
+                                                                     // process (-1 otherwise)
 
   };
 
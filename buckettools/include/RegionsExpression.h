@@ -33,7 +33,8 @@ namespace buckettools
   // RegionsExpression class:
   //
   // This class provides a method of overloading a dolfin Expression eval function by looping over cell ids and returning the results
-  // of individual expressions in each of those regions.
+  // of individual expressions in each of those regions.  The region map is flattened into a vector indexed by region id on
+  // construction so that each evaluation is a direct lookup.
   //*****************************************************************|************************************************************//
   class RegionsExpression : public dolfin::Expression
   {
@@ -90,6 +91,12 @@ namespace buckettools
 
   private:                                                           // only available to this class
     
+    //***************************************************************|***********************************************************//
+    // Initialization
+    //***************************************************************|***********************************************************//
+
+    void init_();                                                    // build the flat dispatch vector from the expression map
+
     //***************************************************************|***********************************************************//
     // Pointers data
     //***************************************************************|***********************************************************//
@@ -98,6 +105,9 @@ namespace buckettools
   
     MeshFunction_size_t_ptr cell_ids_;                                 // a (boost shared) pointer to a (uint) mesh function holding the cell ids
 
+    std::vector< const dolfin::Expression* > dispatch_;              // expressions indexed directly by region id (null where a
+                                                                     // region has no expression)
+
   };
 
 }
@@ -39,6 +39,9 @@ namespace buckettools
   
   enum solve_location { SOLVE_START, SOLVE_TIMELOOP, SOLVE_DIAGNOSTICS, SOLVE_NEVER };
 
+  enum jacobian_reuse { JACOBIAN_REUSE_NEVER, JACOBIAN_REUSE_ITERATIONS, 
+                        JACOBIAN_REUSE_TIMESTEPS, JACOBIAN_REUSE_ADAPTIVE };
+
   //*****************************************************************|************************************************************//
   // SolverBucket class:
   //
@@ -74,6 +77,8 @@ namespace buckettools
 
     void resetcalculated();                                          // update this solver at the end of a timestep
 
+    void discard_jacobian();                                         // force the jacobian to be reassembled at the next iteration
+
     //***************************************************************|***********************************************************//
     // Filling data
     //***************************************************************|***********************************************************//
@@ -82,6 +87,9 @@ namespace buckettools
 
     void initialize_diagnostics() const;                             // initialize any diagnostic output in the solver
 
+    void reopen_diagnostics();                                       // close any diagnostic output in the solver and start new
+                                                                     // files named after the current output base name
+
     void create_nullspace();                                         // take any stored nullspace vectors and convert them into a
                                                                      // PETSc null space object
 
@@ -110,6 +118,9 @@ namespace buckettools
     const bool ident_zeros_pc() const                                // return true if the bilinear pc form needs to be idented
     { return ident_zeros_pc_; }
 
+    const bool matrix_free() const                                   // return true if the jacobian is applied matrix free
+    { return matrixfree_; }
+
     const Form_ptr linear_form() const                               // return a (boost shared) pointer to the linear form
     { return linear_; }
 
@@ -137,6 +148,16 @@ namespace buckettools
     const bool monitor_norms() const                                 // return true if norms should be monitored in nonlinear iterations
     { return monitornorms_; }
 
+    const bool reuse_jacobian(const int &iteration,                  // decide if the jacobian (and associated matrices) from a
+                              const double &fnorm);                  // previous iteration can be reused at this iteration, given the
+                                                                     // current residual norm (updates the reuse history)
+
+    const int jacobian_reuse() const                                 // return the jacobian reuse policy (snes only)
+    { return jacobianreuse_; }
+
+    const bool jacobian_reused() const                               // return true if the jacobian was reused in the last
+    { return jacobianreused_; }                                      // iteration (snes only)
+
     MatNullSpace nullspace()
     { return sp_; }
 
@@ -183,6 +204,8 @@ namespace buckettools
 
     bool solverident_zeros(const std::string &name);                 // ident zero the named solver matrix
 
+    bool solvervirtual_submatrix(const std::string &name);           // is the named solver submatrix a virtual view of the solver matrix
+
     IS fetch_solverindexset(const std::string &name);                // fetch the named ident zeros
 
     Mat fetch_solversubmatrix(const std::string &name);              // fetch the named solver submatrix
@@ -197,6 +220,9 @@ namespace buckettools
     virtual const std::string forms_str(const int &indent=0) const;  // return an indented string describing the forms in this
                                                                      // solver
 
+    const std::string memory_str(const int &indent=0) const;         // return an indented string describing the memory footprint
+                                                                     // of the vectors and matrices in this solver
+
     void checkpoint();                                               // checkpoint the solverbucket
 
   //*****************************************************************|***********************************************************//
@@ -237,8 +263,26 @@ namespace buckettools
 
     bool ident_zeros_, ident_zeros_pc_;                              // replace zero rows with the identity (matrix and pc)
 
+    bool matrixfree_;                                                // apply the jacobian matrix free (only assemble the pc matrix)
+
+    int jacobianreuse_;                                              // the jacobian reuse policy (snes only)
+
+    int jacobianlag_;                                                // the number of iterations or timesteps to reuse the jacobian for
+
+    double jacobianthreshold_;                                       // the residual reduction ratio above which the jacobian is
+                                                                     // reassembled (adaptive reuse)
+
+    bool jacobianassembled_, jacobianreused_;                        // has the jacobian been assembled yet and was it reused
+                                                                     // in the last iteration
+
+    int jacobiantimestep_;                                           // the timestep the jacobian was last assembled in
+
+    double jacobianfnorm_;                                           // the residual norm at the last jacobian evaluation
+
     std::map< std::string, bool > solverident_zeros_;                // replace zero rows with the identity (solver matrices)
 
+    std::map< std::string, bool > solvervirtual_submatrices_;        // solver submatrices are virtual views rather than copies
+
     bool ignore_failures_;                                           // ignore solver failures
 
     std::string name_;                                               // solver name
@@ -43,6 +43,12 @@ namespace buckettools
 
   #define spud_err_accept(optionpath, error, accept) do {spud_error(optionpath, serr, __FILE__, __LINE__, accept);} while(0)
 
+  const bool spud_have_descendant(const std::string &optionpath,    // does the relative optionpath name exist anywhere beneath
+                                  const std::string &name);          // optionpath?
+
+  const int spud_count_descendants(const std::string &optionpath,   // how many times does the relative optionpath name exist
+                                   const std::string &name);         // anywhere beneath optionpath?
+
 }
 
 #endif
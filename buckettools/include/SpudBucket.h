@@ -25,6 +25,7 @@
 #include "Bucket.h"
 #include "BoostTypes.h"
 #include <dolfin.h>
+#include <chrono>
 
 namespace buckettools
 {
@@ -90,6 +91,9 @@ namespace buckettools
 
     string_const_it mesh_optionpaths_end() const;                    // return a constant iterator to the end of the mesh
                                                                      // optionpaths
+
+    Mesh_ptr coarsen_mesh(const std::string &name,                   // return a new (unregistered) copy of the named internally
+                          const int &factor);                        // generated mesh with its cells coarsened by factor
  
     //***************************************************************|***********************************************************//
     // Detector data access
@@ -140,6 +144,39 @@ namespace buckettools
 
     ordered_map< const std::string, std::string > detector_optionpaths_;      // a map from detector names to spud detector optionpaths
 
+    std::map< std::string, File_ptr > pvdfiles_;                     // a map from mesh names to visualization files (kept so they
+                                                                     // can be reused after a mesh adapt)
+
+    //***************************************************************|***********************************************************//
+    // Mesh adaptivity data
+    //***************************************************************|***********************************************************//
+
+    std::map< std::string, Mesh_ptr > basemeshes_;                   // a map from the names of adapted meshes to their original
+                                                                     // meshes (that the adapted meshes are regenerated from)
+
+    std::map< std::string, int > adaptcounts_;                       // the number of times each mesh has been adapted
+
+    //***************************************************************|***********************************************************//
+    // Load balancing data
+    //***************************************************************|***********************************************************//
+
+    std::map< std::string, double > imbalancethresholds_;            // a map from the names of meshes that may be rebalanced to
+                                                                     // the cost imbalance at which they will be repartitioned
+
+    int rebalancecheckpoint_;                                        // the checkpoint count when rebalancing was last considered
+
+    //***************************************************************|***********************************************************//
+    // Startup timing data
+    //***************************************************************|***********************************************************//
+
+    std::vector< std::pair< std::string, double > > startup_timings_; // local wall times of the phases of fill (and of each system
+                                                                     // within them), in order
+
+    std::size_t startup_phase_;                                      // index of the current phase in startup_timings_
+
+    std::chrono::steady_clock::time_point startup_phasestart_,       // start of the current phase and of the current system
+                                          startup_systemstart_;
+
     //***************************************************************|***********************************************************//
     // Filling data (continued)
     //***************************************************************|***********************************************************//
@@ -150,9 +187,21 @@ namespace buckettools
  
     void fill_adaptivetimestepping_();                               // fill the timestepping data
  
+    void fill_timestepconstraints_();                                // fill the constraints on an adaptive timestep
+ 
     void fill_output_();                                             // fill the output data
  
     void fill_meshes_(const std::string &optionpath);                // fill in the mesh data structures
+
+    Mesh_ptr generate_mesh_(const std::string &optionpath,           // generate an internal dolfin mesh (with coarsened cells)
+                            const int &coarsening=1);
+
+    void coarsen_number_cells_(int &cells, const int &coarsening,    // divide the number of cells by the coarsening factor
+                               const std::string &optionpath) const;
+
+    void coarsen_number_cells_(std::vector<int> &cells,              // divide the number of cells in each direction by the
+                               const int &coarsening,                // coarsening factor
+                               const std::string &optionpath) const;
     
     void fill_systems_(const std::string &optionpath);               // fill in information about the systems
 
@@ -161,6 +210,25 @@ namespace buckettools
     void fill_detectors_();                                          // fill the detectors
  
     void fill_diagnostics_();                                        // fill the detectors
+
+    void open_diagnostics_();                                        // open the bucket level diagnostic files
+
+    void fill_visualization_();                                      // fill the functions to be visualized on each mesh
+
+    void fill_ensemble_();                                           // fill the ensemble members (and apply the parameters of the
+                                                                     // first)
+
+    //***************************************************************|***********************************************************//
+    // Startup timing functions
+    //***************************************************************|***********************************************************//
+
+    void start_phase_(const std::string &phase);                     // start timing a phase of fill
+
+    void end_system_(const std::string &system);                     // record the time spent on a system in the current phase
+
+    void end_phase_();                                               // finish timing the current phase
+
+    void log_startup_timings_();                                     // report the startup timings (max over processes)
  
     //***************************************************************|***********************************************************//
     // Output functions
@@ -168,6 +236,52 @@ namespace buckettools
 
     void checkpoint_options_(const double_ptr time);                 // checkpoint the options system for the bucket
 
+    //***************************************************************|***********************************************************//
+    // Mesh adaptivity functions
+    //***************************************************************|***********************************************************//
+
+    void adapt_meshes_();                                            // adapt the meshes that are due an adapt and rebuild the
+                                                                     // systems on them
+
+    dolfin::CellFunction<double> error_indicator_(                   // return the error indicator in each cell of the named mesh
+                                  const std::string &meshname);
+
+    Mesh_ptr adapted_mesh_(const std::string &meshname,              // return a mesh regenerated from the original named mesh
+                const dolfin::CellFunction<double> &indicator);      // refined according to the error indicator
+
+    void transfer_mesh_domains_(const Mesh_ptr parent,               // copy the cell and facet markers of a parent mesh to a
+                                Mesh_ptr child) const;               // mesh refined from it
+
+    void interpolate_system_(const SystemBucket_ptr oldsystem,       // interpolate the fields of a system into the same system
+                             SystemBucket_ptr system) const;         // rebuilt on an adapted mesh
+
+    void rebuild_systems_(                                           // replace the named meshes and rebuild all the systems on
+         const std::map< std::string, Mesh_ptr > &newmeshes,         // them (migrating rather than interpolating the fields if
+         const bool &redistributed);                                 // the meshes have only been redistributed)
+
+    //***************************************************************|***********************************************************//
+    // Load balancing functions
+    //***************************************************************|***********************************************************//
+
+    void rebalance_meshes_();                                        // repartition any meshes whose assembly costs are imbalanced
+                                                                     // and rebuild the systems on them
+
+    Mesh_ptr rebalanced_mesh_(const std::string &meshname,           // return the named mesh read in again and partitioned using
+              const std::map< std::size_t, double > &regioncosts);   // the local assembly costs of each region
+
+    void migrate_system_(const SystemBucket_ptr oldsystem,           // migrate the fields of a system into the same system rebuilt
+                         SystemBucket_ptr system) const;             // on a redistributed mesh
+
+    //***************************************************************|***********************************************************//
+    // Ensemble functions
+    //***************************************************************|***********************************************************//
+
+    void start_ensemble_member_(const uint &member);                 // reset the bucket to its initial state and apply the
+                                                                     // parameters of the given ensemble member
+
+    void apply_ensemble_member_(const uint &member);                 // apply the parameters and output name of the given ensemble
+                                                                     // member
+
   };
 
   typedef std::shared_ptr< SpudBucket > SpudBucket_ptr;              // define a boost shared pointer type for this class
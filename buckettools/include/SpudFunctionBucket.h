@@ -73,6 +73,12 @@ namespace buckettools
 
     void allocate_bcs();                                             // allocate the bcs assuming it's a field
 
+    void collect_reference_points(                                   // collect the reference point requests of this field so the
+                std::vector< std::vector<double> > &coords,          // system can create them all in a single batch
+                std::vector< FunctionSpace_ptr > &functionspaces,
+                std::vector< GenericFunction_ptr > &values,
+                std::vector< std::string > &names);
+
     void initialize_field();                                         // initialize the expressions associated with a field
 
     void initialize_coeff_expression();                              // initialize the expressions associated with a field
@@ -128,7 +134,11 @@ namespace buckettools
                             const std::string &bcname,
                             const std::vector<int> &bcids);
 
-    void fill_reference_point_(const std::string &optionpath);       // fill in the point for this function
+    void fill_reference_point_(const std::string &optionpath,        // fill in the point request(s) for this function
+                std::vector< std::vector<double> > &coords,
+                std::vector< FunctionSpace_ptr > &functionspaces,
+                std::vector< GenericFunction_ptr > &values,
+                std::vector< std::string > &names);
 
     void fill_zero_point_(const std::string &optionpath);            // fill in the point for this function
 
@@ -161,6 +171,12 @@ namespace buckettools
                                       const double_ptr time,
                                       bool *time_dependent);         // allocate an expression based on an optionpath
 
+    Expression_ptr translated_expression_(
+                                      const std::string &optionpath,
+                                      const std::string &expressionname,
+                                      const Expression_ptr pyexpression,
+                                      const double_ptr time);        // return a checked cpp translation of a python expression
+
     GenericFunction_ptr take_function_reference_(
                                       const std::string &optionpath,
                                       const std::string &expressionname,
@@ -145,6 +145,10 @@ namespace buckettools
                              const std::size_t &parent_offset, 
                              const std::vector<std::size_t>* parent_indices);
 
+    void fill_pc_mg_(const std::string &optionpath, PC &pc,          // fill the information about a geometric multigrid pc
+                     const std::size_t &parent_offset, 
+                     const std::vector<std::size_t>* parent_indices);
+
     void fill_nullspace_(const std::string &optionpath, 
                          MatNullSpace &SP,
                          const std::size_t &parent_offset, 
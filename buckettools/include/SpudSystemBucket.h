@@ -106,6 +106,8 @@ namespace buckettools
 
     void fill_systemfunction_();                                     // fill in the system function information
 
+    const bool residual_required_() const;                           // does any output need the residual function?
+
     void fill_fields_();                                             // fill in the data about the system fields (subfunctions)
 
     void fill_bcs_();                                                // fill in the data about the system bcs
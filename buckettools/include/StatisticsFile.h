@@ -62,7 +62,10 @@ namespace buckettools
     
     StatisticsFile(const std::string &name, 
                    const MPI_Comm &comm, 
-                   const Bucket *bucket);   // specific constructor
+                   const Bucket *bucket,
+                   const bool &memory=false,                         // optionally include the peak memory, the number of dofs of
+                   const bool &dofs=false,                           // each system and the number of timestep retries
+                   const bool &retries=false);                       // specific constructor
  
     ~StatisticsFile();                                               // default destructor
     
@@ -77,6 +80,13 @@ namespace buckettools
     //***************************************************************|***********************************************************//
 
     void write_data();                                               // write data to file for a simulation
+
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    void refresh_bucket();                                           // recollect the functions and functionals after the
+                                                                     // bucket systems have been rebuilt
     
   //*****************************************************************|***********************************************************//
   // Private functions
@@ -92,6 +102,9 @@ namespace buckettools
 
     std::vector< FunctionalBucket_ptr > functionals_;
 
+    bool memory_, dofs_, retries_;                                   // include the peak memory, number of dofs and timestep
+                                                                     // retries (only when the corresponding feature is enabled)
+
     //***************************************************************|***********************************************************//
     // Header writing functions (continued)
     //***************************************************************|***********************************************************//
@@ -107,6 +120,8 @@ namespace buckettools
     // Data writing functions (continued)
     //***************************************************************|***********************************************************//
 
+    void data_memory_();                                             // write the peak memory usage
+
     void data_bucket_();                                             // write the data for a steady state simulation
 
     void data_func_(FunctionBucket_ptr f_ptr);                       // write the data for a set of functions
@@ -75,6 +75,13 @@ namespace buckettools
     //***************************************************************|***********************************************************//
 
     void write_data();                                               // write data to file for a simulation
+
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    void refresh_bucket();                                           // recollect the functions and functionals after the
+                                                                     // bucket systems have been rebuilt
     
   //*****************************************************************|***********************************************************//
   // Private functions
@@ -100,6 +100,28 @@ namespace buckettools
     const bool solved(const std::vector<int> &locations=
                                           std::vector<int>()) const; // return a boolean indicating if this system has been solved
 
+    const bool solve_in_timestep(const int &timestep_count) const;   // return a boolean indicating if this system is solved in the
+                                                                     // timeloop during the given timestep (multirate)
+
+    const int solve_period() const                                   // return the number of timesteps between solves of this system
+    { return solveperiod_; }
+
+    const double last_solve_time() const                             // return the time this system was last solved at in the
+    { return lastsolvetime_; }                                       // timeloop (multirate)
+
+    const int subcycles() const                                      // return the number of substeps this system takes per timestep
+    { return subcycles_; }
+
+    void start_subcycling(const int &timestep_count);                // reset the old system function to its value at the start of the
+                                                                     // timestep before a sequence of substeps
+
+    void finish_subcycling();                                        // reset the old system function to its value at the start of the
+                                                                     // timestep after a sequence of substeps
+
+    void snapshot();                                                 // keep a copy of the system function time levels in memory
+
+    void rollback();                                                 // restore the system function time levels from the snapshot
+
     //***************************************************************|***********************************************************//
     // Filling data
     //***************************************************************|***********************************************************//
@@ -277,6 +299,11 @@ namespace buckettools
 
     const std::vector< std::shared_ptr<const dolfin::DirichletBC> > bcs() const     // return a constant vector of system bcs
     { return bcs_; }
+
+    void apply_bcs(dolfin::GenericVector &b) const;                  // apply the system bcs to a vector
+
+    void apply_bcs(dolfin::GenericVector &b,                         // apply the system bcs to a residual vector
+                   const dolfin::GenericVector &x) const;
     
     //***************************************************************|***********************************************************//
     // Output functions
@@ -311,6 +338,9 @@ namespace buckettools
     virtual const std::string functionals_str(const int &indent=0) const;// return an indented string describing the functionals 
                                                                      // of the system
 
+    const std::string memory_str(const int &indent=0) const;         // return an indented string describing the memory footprint
+                                                                     // of the vectors and matrices of the system
+
     void checkpoint(const double_ptr time);                          // checkpoint the system
 
   //*****************************************************************|***********************************************************//
@@ -358,6 +388,21 @@ namespace buckettools
 
     bool_ptr change_calculated_;                                     // indicate if the change has been recalculated recently
 
+    int solveperiod_;                                                // solve this system in the timeloop every solveperiod_ timesteps
+
+    double lastsolvetime_;                                           // the time at the end of the last timestep this system was
+                                                                     // solved in
+
+    int subcycles_;                                                  // the number of substeps this system takes per timestep
+
+    int subcycletimestep_;                                           // the timestep that subcycleoldfunction_ was stored in
+
+    Function_ptr subcycleoldfunction_;                               // a copy of the old system function at the start of a timestep
+                                                                     // (only allocated if subcycling)
+
+    Function_ptr snapshotfunction_, snapshotoldfunction_,            // copies of the system function time levels at the start of a
+                 snapshotiteratedfunction_;                          // timestep (only allocated if retrying failed timesteps)
+
     Function_ptr residualfunction_;                                  // (boost shared) pointer to the residual of the system
 
     Function_ptr snesupdatefunction_;                                // (boost shared) pointer to the snes update of the system
@@ -378,6 +423,9 @@ namespace buckettools
 
     std::vector< std::shared_ptr<const dolfin::DirichletBC> > bcs_;                  // a vector of (boost shared) poitners to the dirichlet bcs
 
+    std::vector< ReferencePoint_ptr > bcpoints_;                     // the reference point corresponding to each entry of bcs_
+                                                                     // (null for ordinary dirichlet bcs)
+
     PythonPeriodicMap_ptr periodicmap_;                              // periodic map for (a single) periodic bc
 
     std::vector<std::size_t> masterids_, slaveids_;                  // master and slave ids for periodic bc
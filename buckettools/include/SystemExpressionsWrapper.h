@@ -48,6 +48,11 @@ namespace buckettools
                           const std::string &expressiontype,
                           const std::string &expressionname);
 
+  bool cpp_has_expression(const std::string &systemname,             // return true if a cpp expression (user defined or translated
+                          const std::string &functionname,           // from python) exists for the given system, function & expression
+                          const std::string &expressiontype,         // name & expression type
+                          const std::string &expressionname);
+
 }
 
 #endif
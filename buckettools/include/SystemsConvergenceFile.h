@@ -79,6 +79,13 @@ namespace buckettools
     //***************************************************************|***********************************************************//
 
     void write_data(const double &norm);                             // write data to file for a simulation
+
+    //***************************************************************|***********************************************************//
+    // Bucket data
+    //***************************************************************|***********************************************************//
+
+    void refresh_bucket();                                           // recollect the systems and fields after the
+                                                                     // bucket systems have been rebuilt
     
   //*****************************************************************|***********************************************************//
   // Private functions
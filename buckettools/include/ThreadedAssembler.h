@@ -0,0 +1,137 @@
+// Copyright (C) 2013 Columbia University in the City of New York and others.
+//
+// Please see the AUTHORS file in the main source directory for a full list
+// of contributors.
+//
+// This file is part of TerraFERMA.
+//
+// TerraFERMA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TerraFERMA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TerraFERMA. If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef __THREADEDASSEMBLER_H
+#define __THREADEDASSEMBLER_H
+
+#include <dolfin.h>
+#include <map>
+#include <set>
+
+namespace buckettools
+{
+  
+  //*****************************************************************|************************************************************//
+  // ThreadedAssembler class:
+  //
+  // ThreadedAssembler assembles functionals and vectors (rank 0 and rank 1 forms) with the cell integrals spread over threads.
+  // Cells are grouped by a vertex based colouring of the mesh so that no two cells of the same colour share a degree of freedom
+  // and can be added to the tensor without locking.  Facet and vertex integrals (and any case that cannot be threaded) fall back
+  // on dolfin::Assembler.  Matrices are not threaded: the solvers assemble them with dolfin::SystemAssembler so that Dirichlet
+  // bcs are applied symmetrically and any rank 2 form passed here is assembled in serial.
+  // It can also record the time spent assembling the vector and functional cell integrals of each region of a mesh (used to
+  // rebalance the mesh partition).  Matrix assembly and solves are not included in these costs.
+  //*****************************************************************|************************************************************//
+  class ThreadedAssembler : public dolfin::AssemblerBase
+  {
+  //*****************************************************************|***********************************************************//
+  // Publicly available functions
+  //*****************************************************************|***********************************************************//
+
+  public:                                                            // accessible to everyone
+
+    //***************************************************************|***********************************************************//
+    // Constructors and destructors
+    //***************************************************************|***********************************************************//
+
+    ThreadedAssembler();                                             // default constructor
+    
+    ~ThreadedAssembler();                                            // default destructor
+
+    //***************************************************************|***********************************************************//
+    // Assembly
+    //***************************************************************|***********************************************************//
+
+    void assemble(dolfin::GenericTensor &A, const dolfin::Form &a,   // assemble the form a into the tensor A (optionally
+                  dolfin::CellFunction<double> *values=NULL,         // returning the cell and facet values of a functional)
+                  dolfin::FacetFunction<double> *facetvalues=NULL);
+
+    void assemble_functional_cells(std::vector<double> &values,      // assemble the cell integrals of several functionals on the
+                  const std::vector< const dolfin::Form* > &forms,   // same mesh in one threaded loop, returning the local
+                  std::vector< std::shared_ptr<dolfin::UFC> > &ufcs, // (unreduced) values and optionally adding the cell values
+                  const std::vector< dolfin::CellFunction<double>* > &cellvalues);
+
+    //***************************************************************|***********************************************************//
+    // Thread control
+    //***************************************************************|***********************************************************//
+
+    static void set_num_threads(const int &nthreads);                // set the number of threads used in vector and functional
+                                                                     // assembly
+
+    static const int num_threads();                                  // return the number of threads used in assembly
+
+    //***************************************************************|***********************************************************//
+    // Cost recording
+    //***************************************************************|***********************************************************//
+
+    static void set_record_costs(const dolfin::Mesh &mesh,           // record (or stop recording) the time spent assembling cells
+                                 const bool &record=true);           // in each region of the mesh
+
+    static const bool record_costs(const dolfin::Mesh &mesh);        // return true if costs are being recorded on the mesh
+
+    static const bool threaded(const dolfin::Mesh &mesh);            // return true if cell loops on the mesh go through the
+                                                                     // threaded loop (to use threads or record costs)
+
+    static const std::map< std::size_t, double >                     // return the time spent assembling the local cells of each
+                  region_costs(const dolfin::Mesh &mesh);            // region of the mesh since the last reset
+
+    static void reset_costs(const dolfin::Mesh &mesh);               // reset the recorded costs on the mesh
+
+  //*****************************************************************|***********************************************************//
+  // Private functions
+  //*****************************************************************|***********************************************************//
+
+  private:                                                           // only accessible to this class
+    
+    //***************************************************************|***********************************************************//
+    // Private member variables
+    //***************************************************************|***********************************************************//
+
+    static int num_threads_;                                         // the number of threads used in assembly
+
+    static std::set< std::size_t > record_meshes_;                   // the ids of the meshes on which costs are recorded
+
+    static std::map< std::size_t, std::map< std::size_t, double > >  // the time spent assembling cells in each region (by
+                                                          costs_;    // region id) of each mesh (by mesh id)
+
+    //***************************************************************|***********************************************************//
+    // Private member functions
+    //***************************************************************|***********************************************************//
+
+    const bool threadable_(const dolfin::Form &a,                    // can this assembly be threaded?
+                           const dolfin::CellFunction<double> *values,
+                           const dolfin::FacetFunction<double> *facetvalues) const;
+
+    void assemble_cells_(dolfin::GenericTensor &A,                   // assemble the cell integrals over threads
+                         const dolfin::Form &a, dolfin::UFC &ufc,
+                         dolfin::CellFunction<double> *values);
+
+    static const std::vector< std::vector<std::size_t> >&            // return the cells of the mesh grouped by colour
+                                colored_cells_(const dolfin::Mesh &mesh);
+
+    static const std::vector<std::size_t>&                           // return the region id of each cell of the mesh
+                                cell_regions_(const dolfin::Mesh &mesh);
+
+  };
+
+}
+#endif
@@ -93,6 +93,92 @@ def form_symbols(namespace):
    headertext = headerfile.read()
    return [line[23:].split()[0][:-1] for line in headertext.splitlines() if line.startswith("class CoefficientSpace_")]
 
+# Functions used to maintain a shared, content addressed cache of ffc output so that identical
+# forms in different builds (e.g. across a parameter sweep) are only compiled once.
+def cache_directory():
+  """Returns the directory of the ffc output cache (None if caching is disabled through TF_CACHE_DIR)."""
+  cachedir = os.getenv('TF_CACHE_DIR')
+  if cachedir is None:
+    cachedir = os.path.join(os.getenv('XDG_CACHE_HOME', os.path.join(os.path.expanduser("~"), ".cache")), "terraferma")
+  if cachedir == "" or cachedir.lower() == "none": return None
+  return cachedir
+
+def ffc_version():
+  """Returns the version of ffc (or an empty string if it can't be determined)."""
+  try:
+    import ffc as ffcmodule
+    return ffcmodule.__version__
+  except Exception:
+    return ""
+
+def code_lines(text, comment="#"):
+  """Returns the lines of ufl (or, with comment="//", cpp) text that affect the generated code."""
+  # comments (including the command that produced the file) and blank lines don't affect the generated code
+  lines = [line.rstrip() for line in text.splitlines() if not line.lstrip().startswith(comment)]
+  return [line for line in lines if line != ""]
+
+def cache_key(namespace, ufltext, form_representation, quadrature_rule, quadrature_degree):
+  """Returns a hash of the normalized ufl and the form compiler parameters that uniquely identifies the ffc output."""
+  lines = code_lines(ufltext)
+  key = hashlib.sha1()
+  # the namespace is used to name the generated classes so has to be part of the key
+  for item in [namespace, form_representation, quadrature_rule, `quadrature_degree`, ffc_version()] + lines:
+    key.update(item+os.linesep)
+  return key.hexdigest()
+
+cache_counts = {"hits":0, "misses":0}
+
+def cache_record(cachedir, hit):
+  """Record a cache hit or miss both for this process and in the cache itself."""
+  if hit:
+    cache_counts["hits"] += 1
+  else:
+    cache_counts["misses"] += 1
+  try:
+    # single character appends are atomic so concurrent builds can share the log
+    with open(os.path.join(cachedir, "events"), 'a') as eventfile:
+      eventfile.write("h" if hit else "m")
+  except IOError:
+    pass
+
+def cache_summary(cumulative=False):
+  """Returns a string summarizing the cache hit rate of this process (or of all processes using the cache if cumulative)."""
+  if cumulative:
+    cachedir = cache_directory()
+    if cachedir is None: return "UFC cache disabled."
+    try:
+      events = open(os.path.join(cachedir, "events")).read()
+    except IOError:
+      events = ""
+    hits, misses = events.count("h"), events.count("m")
+  else:
+    hits, misses = cache_counts["hits"], cache_counts["misses"]
+  total = hits + misses
+  rate = 100.*hits/total if total > 0 else 0.0
+  return "UFC cache: %d hit(s), %d miss(es) (%.0f%% hit rate)"%(hits, misses, rate)
+
+def cache_fetch(cachedir, key, filenames):
+  """Copy the cached versions of filenames (if all present) into the current directory.  Returns True on success."""
+  entry = os.path.join(cachedir, "ufc", key[:2], key)
+  if not all([os.path.isfile(os.path.join(entry, filename)) for filename in filenames]): return False
+  for filename in filenames:
+    shutil.copy(os.path.join(entry, filename), filename)
+  return True
+
+def cache_store(cachedir, key, filenames):
+  """Store filenames from the current directory in the cache under key."""
+  entry = os.path.join(cachedir, "ufc", key[:2], key)
+  if os.path.isdir(entry): return
+  try:
+    # populate a temporary directory then rename it so concurrent builds never see a partial entry
+    tmpentry = entry+".tmp"+`os.getpid()`
+    os.makedirs(tmpentry)
+    for filename in filenames:
+      shutil.copy(filename, os.path.join(tmpentry, filename))
+    os.rename(tmpentry, entry)
+  except (IOError, OSError):
+    shutil.rmtree(tmpentry, ignore_errors=True)
+
 def ffc(namespace, form_representation, quadrature_rule, quadrature_degree):
   uflfilename = namespace+".ufl"
 
@@ -144,6 +230,20 @@ def ffc(namespace, form_representation, quadrature_rule, quadrature_degree):
   if rebuild:
     # files and/or quadrature degree have changed
     shutil.copy(uflfilename+".temp", uflfilename)
+    # check if identical output has already been generated (by this or any other build)
+    cachedir = cache_directory()
+    if cachedir is not None:
+      try:
+        os.makedirs(cachedir)
+      except OSError:
+        pass
+      key = cache_key(namespace, open(uflfilename, 'r').read(), form_representation, quadrature_rule, quadrature_degree)
+      cachefilenames = [namespace+".h", namespace+".cpp"]
+      if cache_fetch(cachedir, key, cachefilenames):
+        sys.stdout.write("Using cached ffc output for: %s"%(uflfilename) + os.linesep); sys.stdout.flush()
+        cache_record(cachedir, True)
+        return
+      cache_record(cachedir, False)
     command = ["ffc", "-l", "dolfin", "-O", "-r", form_representation]
     if quadrature_degree is not None:
       command += ["-fquadrature_degree="+`quadrature_degree`]
@@ -243,4 +343,7 @@ def ffc(namespace, form_representation, quadrature_rule, quadrature_degree):
       for filename in cleanupfilenames:
         if os.path.isfile(filename):
           os.remove(filename)
+      # and make the output available to other builds
+      if cachedir is not None:
+        cache_store(cachedir, key, cachefilenames)
 
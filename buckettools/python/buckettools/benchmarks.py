@@ -0,0 +1,180 @@
+# Copyright (C) 2013 Columbia University in the City of New York and others.
+#
+# Please see the AUTHORS file in the main source directory for a full list
+# of contributors.
+#
+# This file is part of TerraFERMA.
+#
+# TerraFERMA is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# TerraFERMA is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with TerraFERMA. If not, see <http://www.gnu.org/licenses/>.
+
+"""Collect performance metrics from simulation runs, keep a history of them and flag regressions against a baseline.
+
+A benchmark record is a dictionary from the relative run directory of each simulation variant (which encodes the input file
+and parameter values) to a dictionary of metrics.  All metrics are such that lower is better."""
+
+import os
+import re
+import glob
+import json
+import time
+import socket
+from buckettools.statfile import parser
+
+# metrics that are compared against the baseline (all other recorded values are informational)
+compared_metrics = ["walltime", "startuptime", "peakmemory", "nonlineariterations", "lineariterations"]
+
+startup_re = re.compile(r"Startup timings")
+startup_item_re = re.compile(r"^(  +)(\S.*): ([-+0-9.eE]+)\s*$")
+snes_re = re.compile(r"SNES n/o iterations (\d+)")
+sneslinear_re = re.compile(r"SNES n/o linear solver iterations (\d+)")
+ksp_re = re.compile(r"^KSP n/o iterations (\d+)")  # unindented, i.e. not already counted as part of a snes solve
+
+def parselog(filename):
+  """Return the startup phase timings and iteration counts reported in a TerraFERMA log file."""
+  metrics = {"startup": {}, "nonlineariterations": 0, "lineariterations": 0}
+  instartup = False
+  phase = None
+  for line in open(filename):
+    line = line.rstrip("\n")
+    if startup_re.search(line):
+      instartup = True
+      continue
+    if instartup:
+      m = startup_item_re.match(line)
+      if m:
+        name = m.group(2).strip()
+        if len(m.group(1)) > 2 and phase is not None:
+          name = phase+"::"+name                        # per-system timings are nested under their phase
+        else:
+          phase = name
+        metrics["startup"][name] = float(m.group(3))
+        continue
+      instartup = False
+    m = snes_re.search(line)
+    if m: metrics["nonlineariterations"] += int(m.group(1))
+    m = sneslinear_re.search(line)
+    if m: metrics["lineariterations"] += int(m.group(1))
+    m = ksp_re.search(line)
+    if m: metrics["lineariterations"] += int(m.group(1))
+  return metrics
+
+def collectrun(simulation, r):
+  """Return the metrics of the r-th run of a simulation (or None if it hasn't produced any output)."""
+  dirname = os.path.join(simulation.rundirectory, "run_"+`r`.zfill(len(`simulation.nruns`)))
+  metrics = {"nprocs": simulation.getnprocs()}
+
+  if r in simulation.runtimes:
+    metrics["walltime"] = simulation.runtimes[r]
+
+  statfiles = glob.glob(os.path.join(dirname, "*.stat"))
+  if len(statfiles) > 0:
+    stat = parser(statfiles[0])
+    try:
+      metrics["timesteps"]  = stat["timestep"]["value"][-1]
+      if "walltime" not in metrics: metrics["walltime"] = stat["ElapsedWallTime"]["value"][-1]
+    except (KeyError, IndexError):
+      pass
+    # the peak memory is only in the statistics file if /io/include_memory_in_statistics is selected
+    try:
+      metrics["peakmemory"] = stat["PeakResidentMemory"]["value"][-1]
+    except (KeyError, IndexError):
+      pass
+    metrics["githash"] = stat.constants.get("GitHash", "")
+
+  # simulations are run with -l so their stdout (including the log) is redirected to terraferma.log-<rank>,
+  # the startup timings are maximums over all processes and process 0 reports every solve so only its log is needed
+  logfilename = os.path.join(dirname, "terraferma.log-0")
+  if os.path.isfile(logfilename):
+    logmetrics = parselog(logfilename)
+    if len(logmetrics["startup"]) > 0:
+      metrics["startup"] = logmetrics["startup"]
+      if "total" in logmetrics["startup"]: metrics["startuptime"] = logmetrics["startup"]["total"]
+    for k in ["nonlineariterations", "lineariterations"]:
+      metrics[k] = logmetrics[k]
+
+  if len(metrics) == 1: return None
+  return metrics
+
+def collect(batch):
+  """Return a benchmark record of all the simulation runs in a batch."""
+  import buckettools.simulations as simulations
+  record = {}
+  for simulation in batch.simulationselector(batch.runs, types=[simulations.Simulation]):
+    for r in xrange(simulation.nruns):
+      metrics = collectrun(simulation, r)
+      if metrics is not None:
+        key = os.path.relpath(os.path.join(simulation.rundirectory, "run_"+`r`.zfill(len(`simulation.nruns`))), \
+                              batch.currentdirectory)
+        record[key] = metrics
+  return record
+
+def appendhistory(filename, record):
+  """Append a benchmark record (with a timestamp and host) to a history file (one json object per line)."""
+  entry = {"time": time.strftime("%Y-%m-%dT%H:%M:%S"), "host": socket.gethostname(), "results": record}
+  historyfile = open(filename, "a")
+  historyfile.write(json.dumps(entry, sort_keys=True)+os.linesep)
+  historyfile.close()
+
+def readbaseline(filename):
+  """Return the baseline benchmark record stored in filename (or None if it doesn't exist)."""
+  try:
+    return json.load(open(filename))
+  except IOError:
+    return None
+
+def writebaseline(filename, record, baseline=None):
+  """Store a benchmark record as the baseline, keeping any baseline entries that weren't rerun."""
+  if baseline is None: baseline = {}
+  baseline.update(record)
+  baselinefile = open(filename+".tmp", "w")
+  json.dump(baseline, baselinefile, sort_keys=True, indent=1)
+  baselinefile.close()
+  os.rename(filename+".tmp", filename)
+
+def compare(record, baseline, threshold=0.1):
+  """Return a list of (key, metric, baseline value, current value) for every metric that is worse than the baseline by more
+  than the fractional threshold."""
+  regressions = []
+  for key in sorted(record.keys()):
+    if key not in baseline: continue
+    for metric in compared_metrics:
+      if metric not in record[key] or metric not in baseline[key]: continue
+      old = baseline[key][metric]
+      new = record[key][metric]
+      if new > old*(1.0+threshold):
+        regressions.append((key, metric, old, new))
+  return regressions
+
+def report(record, baseline=None, threshold=0.1, log=None):
+  """Log a table of the benchmark record (relative to the baseline if available) and return the list of regressions."""
+  if log is None:
+    def log(string): print string
+  regressions = []
+  if baseline is not None: regressions = compare(record, baseline, threshold)
+  flagged = set([(key, metric) for key, metric, old, new in regressions])
+  log("Benchmark results:")
+  for key in sorted(record.keys()):
+    log("  %s (nprocs = %d)"%(key, record[key]["nprocs"]))
+    for metric in compared_metrics:
+      if metric not in record[key]: continue
+      line = "    %-20s %14.6g"%(metric, record[key][metric])
+      if baseline is not None and key in baseline and metric in baseline[key] and baseline[key][metric] != 0:
+        line += "  (%+.1f%% vs baseline)"%(100.0*(record[key][metric]/float(baseline[key][metric]) - 1.0))
+      if (key, metric) in flagged: line += "  REGRESSION"
+      log(line)
+  if len(regressions) > 0:
+    log("%d regression(s) beyond %.0f%% of the baseline."%(len(regressions), 100.0*threshold))
+  elif baseline is not None:
+    log("No regressions beyond %.0f%% of the baseline."%(100.0*threshold))
+  return regressions
@@ -114,6 +114,38 @@ class Bucket:
         for cppexpression in coeff.cpp:
           cppexpression.write_cppheader_md5()
 
+  def buildkey(self):
+    """Return a hash of everything described by the bucket that affects the generated (and hence compiled) code.
+       Options that don't change the ufl, the form compiler parameters, the cpp expressions or the names used in the
+       wrappers (e.g. timestepping, tolerances, output periods and python expressions that are not translated to cpp)
+       are runtime only and don't change the key."""
+    items = []
+    for meshname, meshcell in sorted(self.meshes.iteritems()):
+      items.append(self.visualization_namespace(meshname))
+      items += code_lines("".join(self.visualization_ufl(meshname, meshcell)))
+    s = 0
+    for system in self.systems:
+      items += [`item` for item in [system.name, system.symbol, system.cell]]
+      for function in system.fields+system.coeffs:
+        items += [`item` for item in [function.name, function.symbol, function.type, function.rank, function.family, \
+                                      function.degree, function.size, function.shape, function.symmetry, \
+                                      function.enrichment_family, function.enrichment_degree, function.quadrature_rule]]
+        for cppexpression in function.cpp:
+          items.append(cppexpression.namespace())
+          items += code_lines("".join(cppexpression.cpp()), comment="//")
+      ufcs = [coeff.functional for coeff in system.coeffs if coeff.functional]
+      for ufc in ufcs+system.solvers+system.functionals:
+        items += [ufc.namespace(), `ufc.form_representation`, `ufc.quadrature_rule`, `ufc.quadrature_degree`]
+        items += code_lines("".join(ufc.ufl()))
+      items += code_lines("".join(system.include_systemexpressions_cpp()), comment="//")
+      items += code_lines("".join(system.cppexpression_cpp(index=s)), comment="//")
+      items += code_lines("".join(system.cppexpression_init(index=s)), comment="//")
+      s += 1
+    key = hashlib.sha1()
+    for item in items:
+      key.update(item+os.linesep)
+    return key.hexdigest()
+
   def write_ufl(self):
     """Write all ufl files described by the bucket."""
     # Write simple ufc files for visualization functionspaces
@@ -466,11 +498,19 @@ class Bucket:
     cppexpression_init.append("  void cpp_init_expression(Expression_ptr expression, const std::string &systemname, const std::string &functionname, const std::string &expressiontype, const std::string &expressionname)"+os.linesep)
     cppexpression_init.append("  {"+os.linesep)
  
+    cppexpression_has = []
+    cppexpression_has.append("  // A function to return whether a cpp expression (either user defined or translated from python) exists given a systemname, a functionname, an expressiontype and an expressionname."+os.linesep)
+    cppexpression_has.append("  bool cpp_has_expression(const std::string &systemname, const std::string &functionname, const std::string &expressiontype, const std::string &expressionname)"+os.linesep)
+    cppexpression_has.append("  {"+os.linesep)
+
     s = 0
     for system in self.systems:
       include_cpp    += system.include_systemexpressions_cpp()
       cppexpression_cpp += system.cppexpression_cpp(index=s)
       cppexpression_init += system.cppexpression_init(index=s)
+      for function in system.fields+system.coeffs:
+        for cppexpression in function.cpp:
+          cppexpression_has += cppexpression.cppexpression_has()
       s += 1
 
     include_cpp.append("#include \"SystemExpressionsWrapper.h\""+os.linesep)
@@ -491,6 +531,9 @@ class Bucket:
     cppexpression_init.append("    }"+os.linesep)
     cppexpression_init.append("  }"+os.linesep)
 
+    cppexpression_has.append("    return false;"+os.linesep)
+    cppexpression_has.append("  }"+os.linesep)
+
     cpp += include_cpp
     cpp.append(os.linesep)
     cpp.append("namespace buckettools"+os.linesep)
@@ -499,6 +542,8 @@ class Bucket:
     cpp.append(os.linesep)
     cpp += cppexpression_init
     cpp.append(os.linesep)
+    cpp += cppexpression_has
+    cpp.append(os.linesep)
     cpp.append("}"+os.linesep)
     cpp.append(os.linesep)
 
@@ -219,3 +219,15 @@ class CppExpressionBucket:
     
     return cpp
 
+  def cppexpression_has(self):
+    """Write an array of cpp strings returning true if the expression names match this cpp expression."""
+    cpp = []
+    
+    cpp.append("    if (systemname == \""+self.function.system.name+"\" && functionname == \""+self.function.name+"\" &&"+os.linesep)
+    cpp.append("        expressiontype == \""+self.basetype+"\" && expressionname == \""+self.name+"\")"+os.linesep)
+    cpp.append("    {"+os.linesep)
+    cpp.append("      return true;"+os.linesep)
+    cpp.append("    }"+os.linesep)
+    
+    return cpp
+
@@ -0,0 +1,478 @@
+# Copyright (C) 2013 Columbia University in the City of New York and others.
+#
+# Please see the AUTHORS file in the main source directory for a full list
+# of contributors.
+#
+# This file is part of TerraFERMA.
+#
+# TerraFERMA is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# TerraFERMA is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with TerraFERMA. If not, see <http://www.gnu.org/licenses/>.
+
+import ast
+import math
+import os
+
+__doc__ = """Translation of python val(x[, t]) functions into the body of the eval function of a C++ expression.
+
+Only a subset of python is supported: numeric constants, the arguments x (indexed by integers) and t, local variables,
+module level constants, arithmetic, math module functions, min, max, abs, pow and float, if/elif/else blocks,
+conditional expressions and the return of a scalar, a list/tuple (vectors) or a list/tuple of lists/tuples (tensors).
+Anything else (e.g. loops, names from the global python dictionary or python 2 integer division) raises an
+UntranslatableError so that the expression can fall back to being evaluated through the python interpreter."""
+
+class UntranslatableError(Exception):
+  """An exception raised when a python function uses constructs that cannot be translated to C++."""
+  pass
+
+# math module functions with a direct C++ equivalent: name -> (C++ function, number of arguments)
+math_functions = {
+                  "sin"      : ("std::sin",      1),
+                  "cos"      : ("std::cos",      1),
+                  "tan"      : ("std::tan",      1),
+                  "asin"     : ("std::asin",     1),
+                  "acos"     : ("std::acos",     1),
+                  "atan"     : ("std::atan",     1),
+                  "atan2"    : ("std::atan2",    2),
+                  "sinh"     : ("std::sinh",     1),
+                  "cosh"     : ("std::cosh",     1),
+                  "tanh"     : ("std::tanh",     1),
+                  "asinh"    : ("std::asinh",    1),
+                  "acosh"    : ("std::acosh",    1),
+                  "atanh"    : ("std::atanh",    1),
+                  "exp"      : ("std::exp",      1),
+                  "expm1"    : ("std::expm1",    1),
+                  "log10"    : ("std::log10",    1),
+                  "log1p"    : ("std::log1p",    1),
+                  "sqrt"     : ("std::sqrt",     1),
+                  "fabs"     : ("std::fabs",     1),
+                  "floor"    : ("std::floor",    1),
+                  "ceil"     : ("std::ceil",     1),
+                  "pow"      : ("std::pow",      2),
+                  "fmod"     : ("std::fmod",     2),
+                  "hypot"    : ("std::hypot",    2),
+                  "copysign" : ("std::copysign", 2),
+                  "erf"      : ("std::erf",      1),
+                  "erfc"     : ("std::erfc",     1),
+                 }
+
+# math module functions that need special treatment
+math_specials = ["log", "degrees", "radians"]
+
+# builtin functions with a C++ equivalent
+builtin_functions = ["abs", "min", "max", "pow", "float"]
+
+math_constants = {
+                  "pi" : math.pi,
+                  "e"  : math.e,
+                 }
+
+comparison_operators = {
+                        ast.Lt    : "<",
+                        ast.LtE   : "<=",
+                        ast.Gt    : ">",
+                        ast.GtE   : ">=",
+                        ast.Eq    : "==",
+                        ast.NotEq : "!=",
+                       }
+
+class PythonCppTranslator:
+  """A class that translates the source code of a python val(x[, t]) function into C++."""
+
+  def __init__(self, code, rank):
+    self.code = code
+    self.rank = rank              # "Scalar", "Vector" or "Tensor"
+    self.mathnames = set()        # names imported directly from the math module
+    self.mathmodule = False       # has the math module been imported
+    self.constants = {}           # module level constants (name -> python value)
+    self.xname = None             # the name of the coordinate argument
+    self.tname = None             # the name of the time argument (if any)
+    self.locals = {}              # local variables in val (name -> True if they may be integers)
+
+  def translate(self):
+    """Return the lines of C++ (as a single string) that evaluate the function into the values array."""
+    try:
+      tree = ast.parse(self.code)
+    except SyntaxError:
+      raise UntranslatableError("could not parse python")
+
+    val = None
+    for node in tree.body:
+      if isinstance(node, ast.Import):
+        for alias in node.names:
+          if alias.name != "math" or alias.asname is not None:
+            raise UntranslatableError("unsupported import of "+alias.name)
+        self.mathmodule = True
+      elif isinstance(node, ast.ImportFrom):
+        if node.module != "math":
+          raise UntranslatableError("unsupported import from "+`node.module`)
+        for alias in node.names:
+          if alias.asname is not None:
+            raise UntranslatableError("unsupported import alias "+alias.asname)
+          if alias.name == "*":
+            self.mathnames.update(math_functions.keys())
+            self.mathnames.update(math_specials)
+            self.mathnames.update(math_constants.keys())
+          elif alias.name in math_functions or alias.name in math_specials or alias.name in math_constants:
+            self.mathnames.add(alias.name)
+          else:
+            raise UntranslatableError("unsupported math import "+alias.name)
+      elif isinstance(node, ast.Assign):
+        if len(node.targets) != 1 or not isinstance(node.targets[0], ast.Name):
+          raise UntranslatableError("unsupported module level assignment")
+        self.constants[node.targets[0].id] = self.evaluate_constant(node.value)
+      elif isinstance(node, ast.FunctionDef):
+        if node.name != "val" or val is not None:
+          raise UntranslatableError("unsupported function "+node.name)
+        val = node
+      elif self.is_docstring(node):
+        continue
+      else:
+        raise UntranslatableError("unsupported module level statement")
+
+    if val is None:
+      raise UntranslatableError("no val function")
+
+    args = val.args
+    if args.vararg or args.kwarg or args.defaults or len(args.args) not in [1, 2]:
+      raise UntranslatableError("unsupported val arguments")
+    argnames = [self.argument_name(arg) for arg in args.args]
+    self.xname = argnames[0]
+    if len(argnames) == 2:
+      self.tname = argnames[1]
+    if getattr(val, "decorator_list", []):
+      raise UntranslatableError("unsupported decorator")
+
+    self.collect_locals(val.body)
+    body = self.statements(val.body, 0)
+
+    cpp = []
+    for name in sorted(self.locals.keys()):
+      cpp.append("double "+self.local_name(name)+";")
+    cpp += body
+    return os.linesep.join(cpp)
+
+  def is_docstring(self, node):
+    return isinstance(node, ast.Expr) and isinstance(node.value, ast.Str)
+
+  def argument_name(self, arg):
+    if isinstance(arg, ast.Name):                     # python 2
+      return arg.id
+    elif hasattr(arg, "arg"):                         # python 3
+      return arg.arg
+    raise UntranslatableError("unsupported argument")
+
+  def local_name(self, name):
+    """Mangle python names to avoid clashes with C++ keywords and the members of the generated expression."""
+    return "py_"+name
+
+  def evaluate_constant(self, node):
+    """Evaluate a module level constant (literals, earlier constants and math constants/functions only)."""
+    self.expression(node)                             # check that only supported constructs are used
+    namespace = {"math" : math, "__builtins__" : {"abs" : abs, "min" : min, "max" : max, "pow" : pow, "float" : float}}
+    namespace.update(self.constants)
+    for name in self.mathnames:
+      namespace[name] = getattr(math, name)
+    try:
+      value = eval(compile(ast.Expression(node), "<constant>", "eval"), namespace)
+    except Exception:
+      raise UntranslatableError("could not evaluate module level constant")
+    if isinstance(value, bool) or not isinstance(value, (int, long, float)):
+      raise UntranslatableError("unsupported module level constant")
+    return value
+
+  def collect_locals(self, statements):
+    """Find all the local variables assigned in the function (and whether they may hold integers)."""
+    for node in statements:
+      if isinstance(node, ast.Assign):
+        for target in node.targets:
+          for name in self.target_names(target):
+            if name in [self.xname, self.tname]:
+              raise UntranslatableError("assignment to an argument")
+            self.locals.setdefault(name, False)
+      elif isinstance(node, ast.AugAssign):
+        if not isinstance(node.target, ast.Name):
+          raise UntranslatableError("unsupported augmented assignment")
+        if node.target.id in [self.xname, self.tname]:
+          raise UntranslatableError("assignment to an argument")
+        self.locals.setdefault(node.target.id, False)
+      elif isinstance(node, ast.If):
+        self.collect_locals(node.body)
+        self.collect_locals(node.orelse)
+
+  def target_names(self, target):
+    if isinstance(target, ast.Name):
+      return [target.id]
+    elif isinstance(target, (ast.Tuple, ast.List)):
+      names = []
+      for elt in target.elts:
+        if not isinstance(elt, ast.Name):
+          raise UntranslatableError("unsupported assignment target")
+        names.append(elt.id)
+      return names
+    raise UntranslatableError("unsupported assignment target")
+
+  def statements(self, statements, indent):
+    cpp = []
+    pad = "  "*indent
+    for node in statements:
+      if isinstance(node, ast.Assign):
+        if len(node.targets) != 1:
+          raise UntranslatableError("unsupported chained assignment")
+        target = node.targets[0]
+        if isinstance(target, ast.Name):
+          code, isint = self.expression(node.value)
+          self.locals[target.id] = self.locals[target.id] or isint
+          cpp.append(pad+self.local_name(target.id)+" = "+code+";")
+        else:
+          values = self.unpack(node.value, len(target.elts))
+          # evaluate all the right hand sides before assigning any of them (as python does)
+          cpp.append(pad+"{")
+          for i in range(len(values)):
+            cpp.append(pad+"  const double tmp"+`i`+" = "+values[i][0]+";")
+          for i in range(len(values)):
+            name = target.elts[i].id
+            self.locals[name] = self.locals[name] or values[i][1]
+            cpp.append(pad+"  "+self.local_name(name)+" = tmp"+`i`+";")
+          cpp.append(pad+"}")
+      elif isinstance(node, ast.AugAssign):
+        name = node.target.id
+        code, isint = self.binary_operator(node.op, (self.local_name(name), self.locals[name]), self.expression(node.value))
+        self.locals[name] = self.locals[name] or isint
+        cpp.append(pad+self.local_name(name)+" = "+code+";")
+      elif isinstance(node, ast.If):
+        cpp.append(pad+"if "+self.condition(node.test))
+        cpp.append(pad+"{")
+        cpp += self.statements(node.body, indent+1)
+        cpp.append(pad+"}")
+        if node.orelse:
+          cpp.append(pad+"else")
+          cpp.append(pad+"{")
+          cpp += self.statements(node.orelse, indent+1)
+          cpp.append(pad+"}")
+      elif isinstance(node, ast.Return):
+        cpp += self.return_values(node.value, pad)
+        cpp.append(pad+"return;")
+      elif isinstance(node, ast.Pass) or self.is_docstring(node):
+        continue
+      else:
+        raise UntranslatableError("unsupported statement")
+    return cpp
+
+  def unpack(self, node, n):
+    """Return a list of n (code, isint) tuples unpacked from a tuple/list or the coordinate argument."""
+    if isinstance(node, (ast.Tuple, ast.List)):
+      if len(node.elts) != n:
+        raise UntranslatableError("mismatched unpacking")
+      return [self.expression(elt) for elt in node.elts]
+    elif isinstance(node, ast.Name) and node.id == self.xname:
+      return [("x["+`i`+"]", False) for i in range(n)]
+    raise UntranslatableError("unsupported unpacking")
+
+  def return_values(self, node, pad):
+    if node is None:
+      raise UntranslatableError("missing return value")
+    cpp = []
+    if self.rank == "Scalar":
+      if isinstance(node, (ast.Tuple, ast.List)):
+        raise UntranslatableError("sequence returned from a scalar expression")
+      cpp.append(pad+"values[0] = "+self.expression(node)[0]+";")
+    elif self.rank == "Vector":
+      if not isinstance(node, (ast.Tuple, ast.List)):
+        raise UntranslatableError("vector expressions must return a list or tuple")
+      for i in range(len(node.elts)):
+        if isinstance(node.elts[i], (ast.Tuple, ast.List)):
+          raise UntranslatableError("nested sequence returned from a vector expression")
+        cpp.append(pad+"values["+`i`+"] = "+self.expression(node.elts[i])[0]+";")
+    elif self.rank == "Tensor":
+      if not isinstance(node, (ast.Tuple, ast.List)):
+        raise UntranslatableError("tensor expressions must return a list or tuple of lists or tuples")
+      ncols = None
+      for i in range(len(node.elts)):
+        row = node.elts[i]
+        if not isinstance(row, (ast.Tuple, ast.List)):
+          raise UntranslatableError("tensor expressions must return a list or tuple of lists or tuples")
+        if ncols is None:
+          ncols = len(row.elts)
+        elif ncols != len(row.elts):
+          raise UntranslatableError("ragged tensor returned")
+        for j in range(len(row.elts)):
+          cpp.append(pad+"values["+`i*ncols+j`+"] = "+self.expression(row.elts[j])[0]+";")
+    else:
+      raise UntranslatableError("unknown rank "+`self.rank`)
+    return cpp
+
+  def condition(self, node):
+    """Return a bracketed C++ boolean expression."""
+    if isinstance(node, ast.Compare):
+      left = self.expression(node.left)[0]
+      terms = []
+      for op, comparator in zip(node.ops, node.comparators):
+        if type(op) not in comparison_operators:
+          raise UntranslatableError("unsupported comparison")
+        right = self.expression(comparator)[0]
+        terms.append("("+left+" "+comparison_operators[type(op)]+" "+right+")")
+        left = right
+      if len(terms) == 1:
+        return terms[0]
+      return "("+" && ".join(terms)+")"
+    elif isinstance(node, ast.BoolOp):
+      if isinstance(node.op, ast.And):
+        op = " && "
+      else:
+        op = " || "
+      return "("+op.join([self.condition(value) for value in node.values])+")"
+    elif isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.Not):
+      return "(!"+self.condition(node.operand)+")"
+    else:
+      return "("+self.expression(node)[0]+" != 0.0)"
+
+  def binary_operator(self, op, left, right):
+    """Return a (code, isint) tuple for a binary operator applied to two (code, isint) tuples."""
+    isint = left[1] and right[1]
+    if isinstance(op, ast.Add):
+      return ("("+left[0]+" + "+right[0]+")", isint)
+    elif isinstance(op, ast.Sub):
+      return ("("+left[0]+" - "+right[0]+")", isint)
+    elif isinstance(op, ast.Mult):
+      return ("("+left[0]+"*"+right[0]+")", isint)
+    elif isinstance(op, ast.Div):
+      if isint:
+        raise UntranslatableError("possible integer division")
+      return ("("+left[0]+"/"+right[0]+")", False)
+    elif isinstance(op, ast.FloorDiv):
+      return ("std::floor("+left[0]+"/"+right[0]+")", isint)
+    elif isinstance(op, ast.Pow):
+      return ("std::pow("+left[0]+", "+right[0]+")", False)
+    raise UntranslatableError("unsupported binary operator")
+
+  def expression(self, node):
+    """Return a (code, isint) tuple for a numeric python expression, where isint indicates it may be an integer in python."""
+    if isinstance(node, ast.Num) and not isinstance(getattr(node, "n", None), bool):
+      value = node.n
+      if isinstance(value, (int, long)):
+        return (self.literal(float(value)), True)
+      elif isinstance(value, float):
+        return (self.literal(value), False)
+      raise UntranslatableError("unsupported number")
+    elif isinstance(node, ast.Name):
+      return self.name(node.id)
+    elif isinstance(node, ast.Subscript):
+      if not (isinstance(node.value, ast.Name) and node.value.id == self.xname):
+        raise UntranslatableError("unsupported subscript")           # only integer indices of the coordinates are supported
+      index = node.slice
+      if isinstance(index, ast.Index):
+        index = index.value
+      if not (isinstance(index, ast.Num) and isinstance(index.n, (int, long)) and not isinstance(index.n, bool) \
+              and index.n >= 0):
+        raise UntranslatableError("unsupported coordinate index")
+      return ("x["+`index.n`+"]", False)
+    elif isinstance(node, ast.BinOp):
+      return self.binary_operator(node.op, self.expression(node.left), self.expression(node.right))
+    elif isinstance(node, ast.UnaryOp):
+      code, isint = self.expression(node.operand)
+      if isinstance(node.op, ast.USub):
+        return ("(-"+code+")", isint)
+      elif isinstance(node.op, ast.UAdd):
+        return (code, isint)
+      raise UntranslatableError("unsupported unary operator")
+    elif isinstance(node, ast.IfExp):
+      body = self.expression(node.body)
+      orelse = self.expression(node.orelse)
+      return ("("+self.condition(node.test)+" ? "+body[0]+" : "+orelse[0]+")", body[1] or orelse[1])
+    elif isinstance(node, ast.Call):
+      return self.call(node)
+    elif isinstance(node, ast.Attribute):
+      if self.mathmodule and isinstance(node.value, ast.Name) and node.value.id == "math" \
+         and node.attr in math_constants and "math" not in self.locals and "math" not in self.constants:
+        return (self.literal(math_constants[node.attr]), False)
+      raise UntranslatableError("unsupported attribute")
+    raise UntranslatableError("unsupported expression")
+
+  def literal(self, value):
+    if math.isinf(value) or math.isnan(value):
+      raise UntranslatableError("non-finite literal")
+    return repr(value)
+
+  def name(self, name):
+    if name == self.xname:
+      raise UntranslatableError("unsupported use of the coordinates")
+    elif name == self.tname:
+      return ("(*time())", False)
+    elif name in self.locals:
+      return (self.local_name(name), self.locals[name])
+    elif name in self.constants:
+      value = self.constants[name]
+      return (self.literal(float(value)), not isinstance(value, float))
+    elif name in self.mathnames and name in math_constants:
+      return (self.literal(math_constants[name]), False)
+    raise UntranslatableError("unknown name "+name)
+
+  def call(self, node):
+    if getattr(node, "keywords", None) or getattr(node, "starargs", None) or getattr(node, "kwargs", None):
+      raise UntranslatableError("unsupported call arguments")
+
+    if isinstance(node.func, ast.Name):
+      func = node.func.id
+      if func in self.locals or func in self.constants or func in [self.xname, self.tname]:
+        raise UntranslatableError("call of a variable")
+      if func in self.mathnames:
+        ismath = True
+      elif func in builtin_functions:
+        ismath = False
+      else:
+        raise UntranslatableError("unknown function "+func)
+    elif isinstance(node.func, ast.Attribute) and isinstance(node.func.value, ast.Name) \
+         and node.func.value.id == "math" and self.mathmodule \
+         and "math" not in self.locals and "math" not in self.constants:
+      func = node.func.attr
+      ismath = True
+    else:
+      raise UntranslatableError("unsupported call")
+
+    if ismath and func not in math_functions and func not in math_specials:
+      raise UntranslatableError("unknown math function "+func)
+
+    args = [self.expression(arg) for arg in node.args]
+    codes = [arg[0] for arg in args]
+
+    if not ismath:
+      if func == "abs" and len(args) == 1:
+        return ("std::fabs("+codes[0]+")", args[0][1])
+      elif func in ["min", "max"] and len(args) > 1:
+        code = codes[0]
+        for c in codes[1:]:
+          code = "std::"+func+"("+code+", "+c+")"
+        return (code, all([arg[1] for arg in args]))
+      elif func == "float" and len(args) == 1:
+        return (codes[0], False)
+      elif func == "pow" and len(args) == 2:                # the builtin pow keeps integers integers
+        return ("std::pow("+codes[0]+", "+codes[1]+")", args[0][1] and args[1][1])
+    elif func == "log":
+      if len(args) == 1:
+        return ("std::log("+codes[0]+")", False)
+      elif len(args) == 2:
+        return ("(std::log("+codes[0]+")/std::log("+codes[1]+"))", False)
+    elif func == "degrees" and len(args) == 1:
+      return ("("+codes[0]+"*"+self.literal(180.0/math.pi)+")", False)
+    elif func == "radians" and len(args) == 1:
+      return ("("+codes[0]+"*"+self.literal(math.pi/180.0)+")", False)
+    elif func in math_functions and len(args) == math_functions[func][1]:
+      return (math_functions[func][0]+"("+", ".join(codes)+")", False)
+
+    raise UntranslatableError("wrong number of arguments to "+func)
+
+def translate(code, rank):
+  """Translate the python val function in code into the body of a C++ eval function for an expression of the given rank
+     (Scalar, Vector or Tensor).  Raises an UntranslatableError if this is not possible."""
+  return PythonCppTranslator(code, rank).translate()
+
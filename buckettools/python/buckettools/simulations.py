@@ -25,12 +25,14 @@ import hashlib
 import shutil
 import threading
 import Queue
+import time
 import copy
 import string
 import glob
 import re
 import collections
 from buckettools.threadlibspud import *
+import buckettools.spud
 import traceback
 from functools import reduce
 import operator
@@ -309,6 +311,8 @@ class Run:
     self.variables = [Variable(name, code) for name, code in self.optionsdict["variables"].iteritems()]
 
     self.alreadyrun = False
+    # wall time (in seconds) of the commands of each successful run variant (used for benchmarking)
+    self.runtimes = {}
 
     self.dependencies = []
     if "dependencies" in self.optionsdict:
@@ -458,91 +462,110 @@ class Run:
       for dependency in self.dependencies: dependency.run(force=force)
 
     self.log("Checking in directory: %s"%(os.path.relpath(self.rundirectory, self.currentdirectory)))
-    if not self.alreadyrun and (not self.optionsdict["run_when"]["never"] or force):
-      commands = self.getcommands()
+    if self.shouldrun(force=force):
+      for r in xrange(self.nruns):
+        error = self.runvariant(r, force=force) or error
 
-      valuesdict=self.getvaluesdict()
+      self.alreadyrun = True
 
-      for r in xrange(self.nruns):
-        requiredinput = self.getrequiredinput(r)
-        requiredoutput = self.getrequiredoutput(r)
+    self.lock.release()
 
-        dirname = os.path.join(self.rundirectory, "run_"+`r`.zfill(len(`self.nruns`)))
-        try:
-          os.makedirs(dirname)
-        except OSError:
-          pass
+    if error: raise SimulationsErrorRun
 
-        input_changed = False
-        if self.optionsdict["run_when"]["input_changed"]:
-          for filepath_k, filepath_v in requiredinput.iteritems():
-            try:
-              checksum = hashlib.md5(open(os.path.join(dirname, os.path.basename(filepath_v))).read()).hexdigest()
-            except:
-              checksum = None
-            try:
-              input_changed = input_changed or checksum != hashlib.md5(open(filepath_k).read()).hexdigest()
-            except IOError:
-              self.log("WARNING: Unable to open %s"%(filepath_k))
-              input_changed = True
-
-        output_missing = False
-        if self.optionsdict["run_when"]["output_missing"]:
-          for filepath_k, filename_v in requiredoutput.iteritems():
-            try:
-              output_file = open(os.path.join(dirname, filepath_k))
-              output_file.close()
-            except IOError:
-              output_missing = True
-          if len(requiredoutput)==0: output_missing=True # don't know what output is needed so we have to force
-          
-        if output_missing or input_changed or force or self.optionsdict["run_when"]["always"]:
-          self.log("  Running in directory: %s"%(os.path.relpath(dirname, self.currentdirectory)))
-          # file has changed or a recompilation is necessary
-          for filepath_k, filepath_v in requiredoutput.iteritems():
-            try:
-              os.remove(os.path.join(dirname, filepath_k))
-            except OSError:
-              pass
-          for filepath_k, filepath_v in requiredinput.iteritems():
-            try:
-              shutil.copy(filepath_k, os.path.join(dirname, os.path.basename(filepath_v)))
-            except IOError:
-              self.log("WARNING: required input (%s) not found, continuing anyway."%(filepath_k))
-          
-          env = copy.deepcopy(os.environ)
-          try:
-            env["PYTHONPATH"] = ":".join([dirname, env["PYTHONPATH"]])
-          except KeyError:
-            env["PYTHONPATH"] = dirname
-          env["PWD"] = dirname
-
-          for i in xrange(len(commands)):
-            command = commands[i]
-            tcommand = [template(c).safe_substitute(valuesdict) for c in command]
-            logf = '_'+self.filename+self.ext+'.'+`i`+'.log'
-            retvalue = self.runcommand(tcommand, dirname, logfilename=logf)
-            error = retvalue != 0
-            if error: break
-          
-          if error:
-            # There's been an error, append failed output
-            for filepath_k, filename_v in requiredoutput.iteritems():
-              if os.path.isfile(os.path.join(dirname, filepath_k)):
-                shutil.move(os.path.join(dirname, filepath_k), os.path.join(dirname, filepath_k+".fail"))
-          else:
-            # Cleanup previous errors (if any)
-            for filepath_k, filename_v in requiredoutput.iteritems():
-              if os.path.isfile(os.path.join(dirname, filepath_k+".fail")):
-                os.remove(os.path.join(dirname, filepath_k+".fail"))
+  def shouldrun(self, force=False):
+    '''Return whether this simulation should be checked for running at all.'''
+    return not self.alreadyrun and (not self.optionsdict["run_when"]["never"] or force)
 
-          self.log("  Finished in directory: %s"%(os.path.relpath(dirname, self.currentdirectory)))
+  def runvariant(self, r, force=False):
+    '''Run (if necessary) the r-th of the nruns variants of this simulation.  Return True if an error occurred.'''
 
-      self.alreadyrun = True
+    error = False
 
-    self.lock.release()
+    commands = self.getcommands()
 
-    if error: raise SimulationsErrorRun
+    valuesdict=self.getvaluesdict()
+
+    requiredinput = self.getrequiredinput(r)
+    requiredoutput = self.getrequiredoutput(r)
+
+    dirname = os.path.join(self.rundirectory, "run_"+`r`.zfill(len(`self.nruns`)))
+    try:
+      os.makedirs(dirname)
+    except OSError:
+      pass
+
+    input_changed = False
+    if self.optionsdict["run_when"]["input_changed"]:
+      for filepath_k, filepath_v in requiredinput.iteritems():
+        try:
+          checksum = hashlib.md5(open(os.path.join(dirname, os.path.basename(filepath_v))).read()).hexdigest()
+        except:
+          checksum = None
+        try:
+          input_changed = input_changed or checksum != hashlib.md5(open(filepath_k).read()).hexdigest()
+        except IOError:
+          self.log("WARNING: Unable to open %s"%(filepath_k))
+          input_changed = True
+
+    output_missing = False
+    if self.optionsdict["run_when"]["output_missing"]:
+      for filepath_k, filename_v in requiredoutput.iteritems():
+        try:
+          output_file = open(os.path.join(dirname, filepath_k))
+          output_file.close()
+        except IOError:
+          output_missing = True
+      if len(requiredoutput)==0: output_missing=True # don't know what output is needed so we have to force
+      
+    if output_missing or input_changed or force or self.optionsdict["run_when"]["always"]:
+      self.log("  Running in directory: %s"%(os.path.relpath(dirname, self.currentdirectory)))
+      # file has changed or a recompilation is necessary
+      for filepath_k, filepath_v in requiredoutput.iteritems():
+        try:
+          os.remove(os.path.join(dirname, filepath_k))
+        except OSError:
+          pass
+      for filepath_k, filepath_v in requiredinput.iteritems():
+        try:
+          shutil.copy(filepath_k, os.path.join(dirname, os.path.basename(filepath_v)))
+        except IOError:
+          self.log("WARNING: required input (%s) not found, continuing anyway."%(filepath_k))
+      
+      env = copy.deepcopy(os.environ)
+      try:
+        env["PYTHONPATH"] = ":".join([dirname, env["PYTHONPATH"]])
+      except KeyError:
+        env["PYTHONPATH"] = dirname
+      env["PWD"] = dirname
+
+      starttime = time.time()
+      for i in xrange(len(commands)):
+        command = commands[i]
+        tcommand = [template(c).safe_substitute(valuesdict) for c in command]
+        logf = '_'+self.filename+self.ext+'.'+`i`+'.log'
+        retvalue = self.runcommand(tcommand, dirname, logfilename=logf)
+        error = retvalue != 0
+        if error: break
+      if not error: self.runtimes[r] = time.time() - starttime
+      
+      if error:
+        # There's been an error, append failed output
+        for filepath_k, filename_v in requiredoutput.iteritems():
+          if os.path.isfile(os.path.join(dirname, filepath_k)):
+            shutil.move(os.path.join(dirname, filepath_k), os.path.join(dirname, filepath_k+".fail"))
+        self.log("  Failed in directory: %s"%(os.path.relpath(dirname, self.currentdirectory)))
+      else:
+        # Cleanup previous errors (if any)
+        for filepath_k, filename_v in requiredoutput.iteritems():
+          if os.path.isfile(os.path.join(dirname, filepath_k+".fail")):
+            os.remove(os.path.join(dirname, filepath_k+".fail"))
+        self.log("  Finished in directory: %s"%(os.path.relpath(dirname, self.currentdirectory)))
+
+    return error
+
+  def getnprocs(self):
+    # generic runs are assumed to be serial
+    return 1
 
   def checkpointrun(self, index=-1):
     pass
@@ -768,6 +791,10 @@ class Simulation(Run):
 
     self.tfdirectory = tfdirectory
     self.builddirectory = self.getbuilddirectory()
+    # a hash of the options that affect the generated code (None if unknown)
+    self.buildkey = None
+    # the build directory whose executable we run (differs from builddirectory if we're sharing another build)
+    self.executabledirectory = self.builddirectory
 
   def writeoptions(self):
     
@@ -789,6 +816,16 @@ class Simulation(Run):
     
     libspud.write_options(os.path.join(self.builddirectory, self.filename+self.ext))
 
+    # work out which options affect the generated code so that builds that only differ in runtime options can be shared
+    try:
+      bucket = buckettools.spud.SpudBucket()
+      bucket.fill()
+      self.buildkey = bucket.buildkey()
+    except Exception as e:
+      self.log("WARNING: unable to evaluate the build key, this build will not be shared:")
+      self.log("%s"%e)
+      self.buildkey = None
+
     threadlibspud.clear_options()
 
   def writecheckpointoptions(self, basedir, basefile):
@@ -866,6 +903,39 @@ class Simulation(Run):
     command = ["make"]
     self.runcommand(command, dirname, exception=SimulationsErrorBuild, logfilename="make.log", verbose=True)
 
+    # register this build so that later invocations with the same build key can share it
+    if self.buildkey is not None:
+      keyfile = open(os.path.join(dirname, "buildkey"), 'w')
+      keyfile.write(self.buildkey)
+      keyfile.close()
+      keydirectory = self.getbuildkeydirectory()
+      try:
+        os.makedirs(keydirectory)
+      except OSError:
+        pass
+      keyfile = open(os.path.join(keydirectory, self.buildkey), 'w')
+      keyfile.write(self.builddirectory)
+      keyfile.close()
+
+  def getbuildkeydirectory(self):
+    '''Return the directory in which builds of this simulation are registered by their build key.'''
+    return os.path.join(self.basedirectory, self.filename+self.ext+".build", "buildkeys")
+
+  def getregisteredbuild(self):
+    '''Return a previously built directory with the same build key as this simulation (or None if there isn't one).'''
+    if self.buildkey is None: return None
+    try:
+      builddirectory = open(os.path.join(self.getbuildkeydirectory(), self.buildkey)).read().strip()
+    except IOError:
+      return None
+    # check the registered build hasn't since been rebuilt with a different key
+    try:
+      buildkey = open(os.path.join(builddirectory, "build", "buildkey")).read().strip()
+    except IOError:
+      return None
+    if buildkey != self.buildkey or not os.path.isfile(os.path.join(builddirectory, "build", self.filename)): return None
+    return builddirectory
+
   def cleanbuild(self):
     try:
       shutil.rmtree(os.path.join(self.basedirectory, self.filename+self.ext+".build"))
@@ -969,7 +1039,7 @@ class Simulation(Run):
       commands[0] += ["mpiexec", "-np", `nprocs`]
     if valgrind_opts is not None:
       commands[0] += ["valgrind"]+valgrind_opts
-    commands[0] += [os.path.join(self.builddirectory, "build", self.filename), "-vINFO", "-l", basefile]
+    commands[0] += [os.path.join(self.executabledirectory, "build", self.filename), "-vINFO", "-l", basefile]
     return commands
 
   def getnprocs(self):
@@ -1000,7 +1070,7 @@ class Simulation(Run):
 
 class SimulationBatch:
   def __init__(self, globaloptionsdict, filename, currentdirectory, tfdirectory, \
-               tests={}, nthreads=1):
+               tests={}, nthreads=1, ncores=None):
 
     self.globaloptionsdict = globaloptionsdict
     self.currentdirectory = currentdirectory
@@ -1012,6 +1082,7 @@ class SimulationBatch:
       self.basedirectory = os.path.normpath(os.path.join(currentdirectory, dirname))
     self.logprefix = os.path.relpath(filename, currentdirectory)
     self.nthreads = nthreads
+    self.ncores = ncores
 
     # set up the list of simulations/runs in this batch
     self.simulations = []
@@ -1200,9 +1271,50 @@ class SimulationBatch:
         error = ex_type, ex_value, ''.join(traceback.format_tb(tb))
     queue.put(error)
 
+  def sharebuilds(self, builds, force=False):
+    '''Return the subset of builds that actually need configuring and building.  Builds that only differ from another 
+       (or from a previously registered build) in their runtime options share its executable instead.'''
+
+    unique = []
+    shared = {}    # builddirectory -> builddirectory of the executable to use
+    keys = {}      # (filename, buildkey) -> builddirectory
+    # the build key each build directory in this batch is about to be (re)built with
+    batchkeys = dict([(simulation.builddirectory, getattr(simulation, "buildkey", None)) \
+                      for simulation in builds if hasattr(simulation, "builddirectory")])
+    for simulation in builds:
+      if not hasattr(simulation, "buildkey") or simulation.buildkey is None:
+        unique.append(simulation)
+        continue
+      # the executable is named after the input file so only builds of the same file can be shared
+      key = (simulation.filename, simulation.buildkey)
+      if key in keys:
+        shared[simulation.builddirectory] = keys[key]
+        continue
+      registered = None if force else simulation.getregisteredbuild()
+      if registered in batchkeys and batchkeys[registered] != simulation.buildkey:
+        # the registered build is about to be rebuilt with a different key so can't be shared
+        registered = None
+      if registered is not None and registered != simulation.builddirectory:
+        shared[simulation.builddirectory] = registered
+        keys[key] = registered
+        continue
+      keys[key] = simulation.builddirectory
+      unique.append(simulation)
+
+    # point every run at the executable it should use
+    for run in self.runs.itervalues():
+      simulation = run['simulation']
+      if hasattr(simulation, "builddirectory") and simulation.builddirectory in shared and \
+         simulation.executabledirectory != shared[simulation.builddirectory]:
+        simulation.executabledirectory = shared[simulation.builddirectory]
+        simulation.log("Sharing build in directory: %s (only runtime options differ)"% \
+                       (os.path.relpath(simulation.executabledirectory, simulation.currentdirectory)))
+
+    return unique
+
   def configure(self, level=None, dlevel=0, types=None, force=False):
     threadlist=[]
-    self.threadbuilds = ThreadIterator(self.simulationselector(self.builds, level=level, dlevel=dlevel, types=types))
+    self.threadbuilds = ThreadIterator(self.sharebuilds(self.simulationselector(self.builds, level=level, dlevel=dlevel, types=types), force=force))
     for i in xrange(self.nthreads):
       queue = Queue.Queue()
       threadlist.append([threading.Thread(target=self.threadconfigure, args=[queue], kwargs={'force':force}), queue])
@@ -1229,7 +1341,7 @@ class SimulationBatch:
 
   def build(self, level=None, dlevel=0, types=None, force=False):
     threadlist=[]
-    self.threadbuilds = ThreadIterator(self.simulationselector(self.builds, level=level, dlevel=dlevel, types=types))
+    self.threadbuilds = ThreadIterator(self.sharebuilds(self.simulationselector(self.builds, level=level, dlevel=dlevel, types=types), force=force))
     for i in xrange(self.nthreads):
       queue = Queue.Queue()
       threadlist.append([threading.Thread(target=self.threadbuild, args=[queue], kwargs={'force':force}), queue]) 
@@ -1255,21 +1367,24 @@ class SimulationBatch:
     queue.put(error)
 
   def run(self, level=None, dlevel=0, types=None, force=False):
-    threadlist=[]
-    self.threadruns = ThreadIterator(self.simulationselector(self.runs, level=level, dlevel=dlevel, types=types))
-    for i in xrange(self.nthreads):
-      queue = Queue.Queue()
-      threadlist.append([threading.Thread(target=self.threadrun, args=[queue], kwargs={'force':force, 'rundependencies':level==None}), queue])
-      threadlist[-1][0].start()
-    for t in threadlist:
-      # wait until all threads finish
-      t[0].join()
-    for t in threadlist:
-      error = t[1].get()
-      if error is not None:
-        ex_type, ex_value, tb_str = error
-        message = '%s (in thread)%s%s' % (ex_value.message, os.linesep, tb_str)
-        raise ex_type(message) 
+    if self.ncores is not None:
+      self.schedulerun(level=level, dlevel=dlevel, types=types, force=force)
+    else:
+      threadlist=[]
+      self.threadruns = ThreadIterator(self.simulationselector(self.runs, level=level, dlevel=dlevel, types=types))
+      for i in xrange(self.nthreads):
+        queue = Queue.Queue()
+        threadlist.append([threading.Thread(target=self.threadrun, args=[queue], kwargs={'force':force, 'rundependencies':level==None}), queue])
+        threadlist[-1][0].start()
+      for t in threadlist:
+        # wait until all threads finish
+        t[0].join()
+      for t in threadlist:
+        error = t[1].get()
+        if error is not None:
+          ex_type, ex_value, tb_str = error
+          message = '%s (in thread)%s%s' % (ex_value.message, os.linesep, tb_str)
+          raise ex_type(message) 
 
     dlevel += 1
     # we request level=None here to make sure we recurse to all dlevels
@@ -1279,6 +1394,91 @@ class SimulationBatch:
       self.build(level=level, dlevel=dlevel, types=types, force=force)
       self.run(level=level, dlevel=dlevel, types=types, force=force)
 
+  def schedulerun(self, level=None, dlevel=0, types=None, force=False):
+    '''Run the selected simulations concurrently, packing their variants onto ncores cores by the number of 
+       processes each one requests while making sure that dependencies finish before their dependents start.'''
+
+    runs = self.simulationselector(self.runs, level=level, dlevel=dlevel, types=types)
+    # only dependencies that are part of this selection need to be waited for (the rest have already been run 
+    # at a lower dlevel or are deliberately excluded by the level)
+    selected = set(runs)
+
+    # set up the list of tasks, one per variant of each simulation that needs running
+    tasks = []
+    for simulation in runs:
+      simulation.log("Checking in directory: %s"%(os.path.relpath(simulation.rundirectory, simulation.currentdirectory)))
+      if simulation.shouldrun(force=force):
+        nprocs = simulation.getnprocs()
+        if nprocs > self.ncores:
+          simulation.log("WARNING: requested %d processes but only %d cores available, oversubscribing."%(nprocs, self.ncores))
+        tasks += [(simulation, r, nprocs) for r in xrange(simulation.nruns)]
+      else:
+        simulation.alreadyrun = True
+    # largest first so that wide runs aren't starved by a stream of narrow ones
+    tasks.sort(key=lambda task: task[2], reverse=True)
+
+    remaining = {}                    # number of unfinished variants of each simulation
+    for task in tasks: remaining[task[0]] = remaining.get(task[0], 0) + 1
+    failed = set()                    # simulations with at least one failed (or skipped) variant
+    condition = threading.Condition()
+    state = {"free" : self.ncores, "running" : 0, "coreseconds" : 0.0}
+
+    def blocked(simulation):
+      # a simulation is blocked if any of its selected dependencies have variants outstanding
+      return any(dependency in selected and remaining.get(dependency, 0) > 0 for dependency in simulation.dependencies)
+
+    def dependencyfailed(simulation):
+      return any(dependency in failed for dependency in simulation.dependencies)
+
+    def runtask(task, ncores):
+      simulation, r, nprocs = task
+      starttime = time.time()
+      try:
+        error = simulation.runvariant(r, force=force)
+      except Exception:
+        simulation.log("ERROR: running variant %d raised an exception:"%(r))
+        simulation.log(traceback.format_exc())
+        error = True
+      elapsed = time.time() - starttime
+      condition.acquire()
+      if error: failed.add(simulation)
+      remaining[simulation] -= 1
+      if remaining[simulation] == 0: simulation.alreadyrun = True
+      state["free"] += ncores
+      state["running"] -= 1
+      state["coreseconds"] += elapsed*nprocs
+      condition.notify()
+      condition.release()
+
+    starttime = time.time()
+    nvariants = len(tasks)
+    condition.acquire()
+    while len(tasks) > 0 or state["running"] > 0:
+      # drop variants whose dependencies failed
+      for task in [task for task in tasks if dependencyfailed(task[0])]:
+        task[0].log("ERROR: not running variant %d as a dependency failed."%(task[1]))
+        tasks.remove(task)
+        failed.add(task[0])
+        remaining[task[0]] -= 1
+      # launch as many ready variants as will fit on the free cores (an oversized run gets the whole machine)
+      for task in list(tasks):
+        if blocked(task[0]): continue
+        ncores = min(task[2], self.ncores)
+        if ncores <= state["free"]:
+          tasks.remove(task)
+          state["free"] -= ncores
+          state["running"] += 1
+          threading.Thread(target=runtask, args=[task, ncores]).start()
+      if state["running"] > 0: condition.wait()
+    condition.release()
+    elapsed = time.time() - starttime
+
+    if nvariants > 0 and elapsed > 0.0:
+      self.log("Ran %d variant(s) on %d core(s) in %.1fs: %.2f variants/hour, %.0f%% core utilization."% \
+               (nvariants, self.ncores, elapsed, nvariants*3600./elapsed, 100.*state["coreseconds"]/(self.ncores*elapsed)))
+
+    if len(failed) > 0: raise SimulationsErrorRun
+
   def threadcheckpointrun(self, queue, index=-1):
     error = None
     for simulation in self.threadruns: 
@@ -1561,7 +1761,7 @@ class SimulationHarnessBatch(SimulationBatch):
   '''A derived SimulationBatch that takes in a list of spud based harnessfiles and sets up
      subgroups of SimulationBatches based on them.'''
 
-  def __init__(self, harnessfiles, filename, currentdirectory, tfdirectory, nthreads=1, parameters={}):
+  def __init__(self, harnessfiles, filename, currentdirectory, tfdirectory, nthreads=1, ncores=None, parameters={}):
     '''Initialize a SimulationHarnessBatch.'''
 
     # record the current directory from where the script calling this is being run
@@ -1578,6 +1778,8 @@ class SimulationHarnessBatch(SimulationBatch):
     self.logprefix = None
     # number of threads we are to run processes over
     self.nthreads = nthreads
+    # number of cores to pack runs onto (None to run them over nthreads instead)
+    self.ncores = ncores
     # any parameter values we want to overload
     self.parameters = parameters
 
@@ -1608,7 +1810,7 @@ class SimulationHarnessBatch(SimulationBatch):
       # append the details of this harnessfile to the list of simulation test groups
       self.simulationtestgroups.append(SimulationBatch(harnessfileoptionsdict, \
                                                        harnessfile, currentdirectory, tfdirectory, \
-                                                       tests=tests, nthreads=nthreads))
+                                                       tests=tests, nthreads=nthreads, ncores=ncores))
       # add to the global options dictionary for this 'super' SimulationBatch
       self.globaloptionsdict.update(harnessfileoptionsdict)
       # clear the options so the next shml file can be loaded
@@ -20,7 +20,9 @@
 
 import libspud
 import buckettools.cppexpressionbucket
+import buckettools.pythoncpp
 import sys
+import os
 
 class SpudCppExpressionBucket(buckettools.cppexpressionbucket.CppExpressionBucket):
   """A class that stores all the information necessary to write the cpp for a user defined expression 
@@ -37,6 +39,31 @@ class SpudCppExpressionBucket(buckettools.cppexpressionbucket.CppExpressionBucke
     if libspud.have_option(optionpath+"/cpp/include"):
       self.include = libspud.get_option(optionpath+"/cpp/include")
 
+    self.fill_type(optionpath)
+    self.fill_rank(libspud.get_option(optionpath+"/cpp/rank"))
+
+  def fill_python(self, optionpath, name, function):
+    """Fill a cpp expression class by translating the python function at the given optionpath into C++.
+       Returns False (leaving the python to be evaluated by the interpreter) if the python cannot be translated."""
+    self.name     = name
+    self.members  = ""
+    self.initfunc = ""
+    self.function = function
+
+    self.fill_type(optionpath)
+    self.fill_rank(libspud.get_option(optionpath+"/python/rank"))
+
+    try:
+      self.evalfunc = buckettools.pythoncpp.translate(libspud.get_option(optionpath+"/python"), self.rank)
+    except buckettools.pythoncpp.UntranslatableError, e:
+      # report on stderr as some scripts return information on stdout
+      sys.stderr.write("Cannot translate python at "+optionpath+" to cpp ("+str(e)+"), using the python interpreter."+os.linesep)
+      return False
+
+    return True
+
+  def fill_type(self, optionpath):
+    """Fill in the type of this expression (initial_condition, value or boundary_condition) using libspud."""
     self.basetype     = libspud.get_option(optionpath+"/type")
     if self.basetype=="initial_condition":
       self.nametype = "IC"
@@ -49,7 +76,8 @@ class SpudCppExpressionBucket(buckettools.cppexpressionbucket.CppExpressionBucke
       print "Unknown type."
       sys.exit(1)
 
-    rank          = libspud.get_option(optionpath+"/cpp/rank")
+  def fill_rank(self, rank):
+    """Fill in the rank of this expression given the rank string from the options tree."""
     if rank=="0": # for consistency with other parts of the code convert this to a human parseable string
       self.rank = "Scalar"
     elif rank=="1":
@@ -84,6 +84,8 @@ class SpudFunctionBucket(buckettools.functionbucket.FunctionBucket):
         self.cpp.append(cppexpression)
         # done with this expression
         del cppexpression
+      elif libspud.have_option(cpp_optionpath+"/python/translate_to_cpp"):
+        self.fill_python_cpp(cpp_optionpath, libspud.get_option(cpp_optionpath+"/name"))
 
     for j in range(libspud.option_count(optionpath+"/type/rank/boundary_condition")):
       bc_optionpath = optionpath+"/type/rank/boundary_condition["+`j`+"]"
@@ -103,6 +105,8 @@ class SpudFunctionBucket(buckettools.functionbucket.FunctionBucket):
           self.cpp.append(cppexpression)
           # done with this expression
           del cppexpression
+        elif libspud.have_option(cpp_optionpath+"/python/translate_to_cpp"):
+          self.fill_python_cpp(cpp_optionpath, bc_name + bc_comp_name)
 
     for k in range(libspud.option_count(optionpath+"/type/rank/value")):
       cpp_optionpath = optionpath+"/type/rank/value["+`k`+"]"
@@ -115,4 +119,12 @@ class SpudFunctionBucket(buckettools.functionbucket.FunctionBucket):
         self.cpp.append(cppexpression)
         # done with this expression
         del cppexpression
+      elif libspud.have_option(cpp_optionpath+"/python/translate_to_cpp"):
+        self.fill_python_cpp(cpp_optionpath, libspud.get_option(cpp_optionpath+"/name"))
+
+  def fill_python_cpp(self, optionpath, name):
+    """Translate the python function at the given optionpath into a cpp expression and, if successful, let the function know about it."""
+    cppexpression = buckettools.spud.SpudCppExpressionBucket()
+    if cppexpression.fill_python(optionpath, name, self):
+      self.cpp.append(cppexpression)
 